@@ -0,0 +1,90 @@
+// Shared by the culling passes; the layouts are vkUtil::CullMesh,
+// CullConstants and CullCounters in render_structs.h.
+
+#define MESH_TYPES 3	// meshTypeCount
+#define MAX_LODS 8	// maxDrawLods
+#define SLOTS (MESH_TYPES * MAX_LODS)
+#define CULLED 0xFFFFFFFFu
+
+struct Lod {
+	uint indexCount;
+	uint firstIndex;
+	int vertexOffset;
+	float error;
+};
+
+struct Mesh {
+	vec4 sphere;	// center, radius
+	vec4 extent;
+	uint lodCount;	// 0 while not loaded
+	uint padding0, padding1, padding2;
+	Lod lods[MAX_LODS];
+};
+
+struct DrawCommand {
+	uint indexCount;
+	uint instanceCount;
+	uint firstIndex;
+	int vertexOffset;
+	uint firstInstance;
+};
+
+layout(std140, set = 0, binding = 0) readonly buffer storageBuffer {
+	mat4 model[];
+} ObjectData;
+
+layout(std430, set = 0, binding = 1) readonly buffer objectTypeBuffer {
+	uint type[];
+} ObjectTypes;
+
+layout(std430, set = 0, binding = 2) readonly buffer meshBuffer {
+	Mesh mesh[MESH_TYPES];
+} Meshes;
+
+layout(std430, set = 0, binding = 3) buffer counterBuffer {
+	uint drawCount[MESH_TYPES];
+	uint visible;
+	uint culled;
+	uint occluded;
+	uint slotInstances[SLOTS];
+	uint slotFirst[SLOTS];
+} Counters;
+
+// slot, place in the slot
+layout(std430, set = 0, binding = 4) buffer objectSlotBuffer {
+	uvec2 slot[];
+} ObjectSlots;
+
+layout(std430, set = 0, binding = 5) writeonly buffer drawCommandBuffer {
+	DrawCommand command[SLOTS];
+} DrawCommands;
+
+layout(std430, set = 0, binding = 6) writeonly buffer objectIndexBuffer {
+	uint object[];
+} ObjectIndices;
+
+// farthest depth, texel t of mip m covering depth pixels [t, t + 1) * 2^(m + 1)
+layout(set = 0, binding = 7) uniform sampler2D depthPyramid;
+
+// per object, whether the last late pass found it visible
+layout(std430, set = 0, binding = 8) buffer objectVisibilityBuffer {
+	uint visible[];
+} ObjectVisibility;
+
+layout(set = 0, binding = 9) uniform UBO {
+	mat4 view;
+	mat4 projection;
+	mat4 viewProjection;
+} cameraData;
+
+#define PHASE_EARLY 0
+#define PHASE_LATE 1
+
+layout(push_constant) uniform CullConstants {
+	vec4 planes[6];
+	vec4 eye;	// w = pixels per unit at distance 1
+	uint objectCount;
+	float maxPixelError;
+	uint phase;
+	uint depthSize;	// width | height << 16
+} constants;
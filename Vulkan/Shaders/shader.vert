@@ -11,6 +11,10 @@ layout(set = 0, binding = 0) uniform UBO {
 	mat4 model[];
  } ObjectData;
 
+ layout(std430, set = 0, binding = 3) readonly buffer objectIndexBuffer {
+	uint object[];
+ } ObjectIndices;
+
 layout(location = 0) in vec3 vertexPosition;
 layout(location = 1) in vec3 vertexColor;
 layout(location = 2) in vec2 vertexTexCoord;
@@ -18,11 +22,12 @@ layout(location = 3) in vec3 vertexNormal;
 
 layout(location = 0) out vec3 fragColor;
 layout(location = 1) out vec2 fragTexCoord;
-layout(location = 2) out vec3 fragNomral;
+layout(location = 2) out vec3 fragNormal;
 
 void main() {
-	gl_Position = cameraData.viewProjection * ObjectData.model[gl_InstanceIndex] * vec4(vertexPosition, 1.0);
+	mat4 model = ObjectData.model[ObjectIndices.object[gl_InstanceIndex]];
+	gl_Position = cameraData.viewProjection * model * vec4(vertexPosition, 1.0);
 	fragColor = vertexColor;
 	fragTexCoord = vertexTexCoord;
-	fragNormal = normalize((ObjectData.model[gl_InstanceIndex] * vec4(vertexNormal, 0.0)).xyz);
+	fragNormal = normalize((model * vec4(vertexNormal, 0.0)).xyz);
 }
\ No newline at end of file
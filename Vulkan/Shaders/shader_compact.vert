@@ -0,0 +1,49 @@
+#version 450
+
+layout(set = 0, binding = 0) uniform UBO {
+	mat4 view;
+	mat4 projection;
+	mat4 viewProjection;
+ } cameraData;
+
+ layout(std140, set = 0, binding = 1) readonly buffer storageBuffer {
+	mat4 model[];
+ } ObjectData;
+
+ layout(std430, set = 0, binding = 3) readonly buffer objectIndexBuffer {
+	uint object[];
+ } ObjectIndices;
+
+ layout(std430, set = 0, binding = 2) readonly buffer paletteBuffer {
+	vec4 color[];
+ } MaterialPalette;
+
+layout(push_constant) uniform MeshBounds {
+	vec4 origin;
+	vec4 scale;
+} meshBounds;
+
+layout(location = 0) in uvec4 vertexPosition;	// unorm16 xyz in mesh bounds, w = palette index
+layout(location = 2) in vec2 vertexTexCoord;
+layout(location = 3) in vec2 vertexNormal;	// octahedral
+
+layout(location = 0) out vec3 fragColor;
+layout(location = 1) out vec2 fragTexCoord;
+layout(location = 2) out vec3 fragNormal;
+
+vec3 decode_octahedral(vec2 encoded) {
+	vec3 normal = vec3(encoded, 1.0 - abs(encoded.x) - abs(encoded.y));
+	float fold = max(-normal.z, 0.0);
+	normal.x += normal.x >= 0.0 ? -fold : fold;
+	normal.y += normal.y >= 0.0 ? -fold : fold;
+	return normalize(normal);
+}
+
+void main() {
+	mat4 model = ObjectData.model[ObjectIndices.object[gl_InstanceIndex]];
+	vec3 position = meshBounds.origin.xyz + vec3(vertexPosition.xyz) * meshBounds.scale.xyz;
+	gl_Position = cameraData.viewProjection * model * vec4(position, 1.0);
+	fragColor = MaterialPalette.color[vertexPosition.w].rgb;
+	fragTexCoord = vertexTexCoord;
+	fragNormal = normalize((model * vec4(decode_octahedral(vertexNormal), 0.0)).xyz);
+}
@@ -1,2 +1,7 @@
 "C:\VulkanSDK\Bin\glslc.exe" shader.vert -o vertex.spv
-"C:\VulkanSDK\Bin\glslc.exe" shader.frag -o fragment.spv
\ No newline at end of file
+"C:\VulkanSDK\Bin\glslc.exe" shader.frag -o fragment.spv
+"C:\VulkanSDK\Bin\glslc.exe" shader_compact.vert -o vertex_compact.spv
+"C:\VulkanSDK\Bin\glslc.exe" cull.comp -o cull.spv
+"C:\VulkanSDK\Bin\glslc.exe" draw_commands.comp -o draw_commands.spv
+"C:\VulkanSDK\Bin\glslc.exe" scatter.comp -o scatter.spv
+"C:\VulkanSDK\Bin\glslc.exe" depth_pyramid.comp -o depth_pyramid.spv
\ No newline at end of file
@@ -0,0 +1,367 @@
+#include "allocator.h"
+#include "memory.h"
+#include <bit>
+
+namespace {
+	uint32_t most_significant_bit(uint64_t value) { return 63 - static_cast<uint32_t>(std::countl_zero(value)); }
+	uint32_t least_significant_bit(uint64_t value) { return static_cast<uint32_t>(std::countr_zero(value)); }
+
+	vk::DeviceSize align_up(vk::DeviceSize value, vk::DeviceSize alignment) {
+		return (value + alignment - 1) & ~(alignment - 1);
+	}
+
+	// smallest block a pool reserves, however small its heap
+	constexpr vk::DeviceSize minBlockSize = vk::DeviceSize(1) << 20;
+}
+
+vkUtil::TlsfHeap::TlsfHeap(vk::DeviceSize capacity)
+	: total(capacity)
+{
+	for (auto& lists : freeLists) lists.fill(none);
+	if (capacity) {
+		last = new_region({ 0, capacity, none, none, none, none, true });
+		insert_free(last);
+	}
+}
+
+void vkUtil::TlsfHeap::mapping(vk::DeviceSize size, uint32_t& fl, uint32_t& sl)
+{
+	// sizes below slCount get a list each, above that every power of two is
+	// split into slCount steps
+	if (size < slCount) {
+		fl = 0;
+		sl = static_cast<uint32_t>(size);
+		return;
+	}
+	uint32_t top = most_significant_bit(size);
+	fl = top - slBits + 1;
+	sl = static_cast<uint32_t>(size >> (top - slBits)) & (slCount - 1);
+}
+
+uint32_t vkUtil::TlsfHeap::new_region(const Region& region)
+{
+	if (unusedRegions.empty()) {
+		regions.push_back(region);
+		return static_cast<uint32_t>(regions.size() - 1);
+	}
+	uint32_t index = unusedRegions.back();
+	unusedRegions.pop_back();
+	regions[index] = region;
+	return index;
+}
+
+void vkUtil::TlsfHeap::insert_free(uint32_t index)
+{
+	uint32_t fl, sl;
+	mapping(regions[index].size, fl, sl);
+	uint32_t head = freeLists[fl][sl];
+	regions[index].free = true;
+	regions[index].prevFree = none;
+	regions[index].nextFree = head;
+	if (head != none) regions[head].prevFree = index;
+	freeLists[fl][sl] = index;
+	slBitmaps[fl] |= 1u << sl;
+	flBitmap |= uint64_t(1) << fl;
+}
+
+void vkUtil::TlsfHeap::remove_free(uint32_t index)
+{
+	uint32_t fl, sl;
+	mapping(regions[index].size, fl, sl);
+	Region& region = regions[index];
+	if (region.prevFree != none) regions[region.prevFree].nextFree = region.nextFree;
+	if (region.nextFree != none) regions[region.nextFree].prevFree = region.prevFree;
+	if (freeLists[fl][sl] == index) {
+		freeLists[fl][sl] = region.nextFree;
+		if (region.nextFree == none) {
+			slBitmaps[fl] &= ~(1u << sl);
+			if (!slBitmaps[fl]) flBitmap &= ~(uint64_t(1) << fl);
+		}
+	}
+	region.free = false;
+}
+
+void vkUtil::TlsfHeap::split(uint32_t index, vk::DeviceSize size)
+{
+	Region tail = { regions[index].offset + size, regions[index].size - size, index, regions[index].nextPhysical, none, none, true };
+	uint32_t tailIndex = new_region(tail);
+	if (tail.nextPhysical != none) regions[tail.nextPhysical].prevPhysical = tailIndex;
+	if (last == index) last = tailIndex;
+	regions[index].size = size;
+	regions[index].nextPhysical = tailIndex;
+	insert_free(tailIndex);
+}
+
+uint32_t vkUtil::TlsfHeap::merge(uint32_t first, uint32_t second)
+{
+	regions[first].size += regions[second].size;
+	regions[first].nextPhysical = regions[second].nextPhysical;
+	if (regions[second].nextPhysical != none) regions[regions[second].nextPhysical].prevPhysical = first;
+	if (last == second) last = first;
+	unusedRegions.push_back(second);
+	return first;
+}
+
+uint32_t vkUtil::TlsfHeap::allocate(vk::DeviceSize size, vk::DeviceSize alignment)
+{
+	size = std::max<vk::DeviceSize>(size, 1);
+	alignment = std::max<vk::DeviceSize>(alignment, 1);
+	if (size > total) return none;
+
+	// Head of the first list whose regions all hold at least request bytes:
+	// round up to the next size class, then take the first non-empty list at
+	// or above it.
+	auto find_free = [this](vk::DeviceSize request) {
+		if (request >= slCount) request += (vk::DeviceSize(1) << (most_significant_bit(request) - slBits)) - 1;
+		uint32_t fl, sl;
+		mapping(request, fl, sl);
+		uint32_t slMap = slBitmaps[fl] & (~0u << sl);
+		if (!slMap) {
+			uint64_t flMap = fl + 1 < flCount ? flBitmap & (~uint64_t(0) << (fl + 1)) : 0;
+			if (!flMap) return none;
+			fl = least_significant_bit(flMap);
+			slMap = slBitmaps[fl];
+		}
+		return freeLists[fl][least_significant_bit(slMap)];
+	};
+
+	auto fits = [&](uint32_t index) {
+		return align_up(regions[index].offset, alignment) + size <= regions[index].offset + regions[index].size;
+	};
+
+	// room for the worst case padding first, so any region found fits;
+	// failing that, a region of size's own class may still hold it (the
+	// exact fit a dedicated block relies on), which takes a walk of that list
+	uint32_t index = size + alignment - 1 <= total ? find_free(size + alignment - 1) : none;
+	if (index == none) {
+		uint32_t fl, sl;
+		mapping(size, fl, sl);
+		for (index = freeLists[fl][sl]; index != none && !fits(index); index = regions[index].nextFree) {}
+		if (index == none) return none;
+	}
+	remove_free(index);
+
+	// the padding in front stays free; neighbours of a free region are in use,
+	// so neither it nor the tail below has anything to merge with
+	vk::DeviceSize padding = align_up(regions[index].offset, alignment) - regions[index].offset;
+	if (padding) {
+		split(index, padding);
+		uint32_t aligned = regions[index].nextPhysical;
+		remove_free(aligned);
+		insert_free(index);
+		index = aligned;
+	}
+	if (regions[index].size > size) split(index, size);
+
+	used += regions[index].size;
+	return index;
+}
+
+void vkUtil::TlsfHeap::free(uint32_t index)
+{
+	used -= regions[index].size;
+
+	uint32_t previous = regions[index].prevPhysical;
+	if (previous != none && regions[previous].free) {
+		remove_free(previous);
+		index = merge(previous, index);
+	}
+	uint32_t next = regions[index].nextPhysical;
+	if (next != none && regions[next].free) {
+		remove_free(next);
+		index = merge(index, next);
+	}
+	insert_free(index);
+}
+
+void vkUtil::TlsfHeap::grow(vk::DeviceSize capacity)
+{
+	if (capacity <= total) return;
+	vk::DeviceSize extra = capacity - total;
+	if (last != none && regions[last].free) {
+		remove_free(last);
+		regions[last].size += extra;
+		insert_free(last);
+	}
+	else {
+		uint32_t tail = new_region({ total, extra, last, none, none, none, true });
+		if (last != none) regions[last].nextPhysical = tail;
+		last = tail;
+		insert_free(tail);
+	}
+	total = capacity;
+}
+
+vk::DeviceSize vkUtil::TlsfHeap::largest_free_range() const
+{
+	if (!flBitmap) return 0;
+	uint32_t fl = most_significant_bit(flBitmap);
+	uint32_t sl = most_significant_bit(slBitmaps[fl]);
+	vk::DeviceSize largest = 0;
+	for (uint32_t index = freeLists[fl][sl]; index != none; index = regions[index].nextFree) {
+		largest = std::max(largest, regions[index].size);
+	}
+	return largest;
+}
+
+vkUtil::DeviceAllocator::DeviceAllocator(vk::Device device, vk::PhysicalDevice physicalDevice, vk::DeviceSize blockSize)
+	: device(device), physicalDevice(physicalDevice), blockSize(blockSize)
+{
+	memoryProperties = physicalDevice.getMemoryProperties();
+	bufferImageGranularity = physicalDevice.getProperties().limits.bufferImageGranularity;
+}
+
+vkUtil::DeviceAllocator::~DeviceAllocator()
+{
+	for (auto& pool : pools) {
+		for (uint32_t i = 0; i < pool.blocks.size(); ++i) {
+			if (!pool.blocks[i]) continue;
+#ifndef NDEBUG
+			if (pool.blocks[i]->allocationCount) {
+				std::cerr << pool.blocks[i]->allocationCount << " allocations still alive in memory type " << pool.memoryTypeIndex << std::endl;
+			}
+#endif
+			destroy_block(pool, i);
+		}
+	}
+}
+
+uint32_t vkUtil::DeviceAllocator::find_pool(uint32_t memoryTypeIndex, bool linear)
+{
+	// Linear and optimal resources closer than bufferImageGranularity may
+	// alias on some hardware. Giving them separate pools keeps them apart
+	// without padding every allocation.
+	if (bufferImageGranularity <= 1) linear = true;
+
+	for (uint32_t i = 0; i < pools.size(); ++i) {
+		if (pools[i].memoryTypeIndex == memoryTypeIndex && pools[i].linear == linear) return i;
+	}
+
+	const auto& type = memoryProperties.memoryTypes[memoryTypeIndex];
+	vk::DeviceSize heapSize = memoryProperties.memoryHeaps[type.heapIndex].size;
+
+	Pool pool;
+	pool.memoryTypeIndex = memoryTypeIndex;
+	pool.linear = linear;
+	// small heaps (a 256 MiB BAR window) are not handed out in one go
+	pool.blockSize = std::min(blockSize, std::max(heapSize / 8, minBlockSize));
+	// only coherent memory is mapped: writes through the pointer are never flushed
+	vk::MemoryPropertyFlags mappable = vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent;
+	pool.hostVisible = (type.propertyFlags & mappable) == mappable;
+	pools.push_back(std::move(pool));
+	return static_cast<uint32_t>(pools.size() - 1);
+}
+
+uint32_t vkUtil::DeviceAllocator::create_block(Pool& pool, vk::DeviceSize size, bool dedicated)
+{
+	vk::MemoryAllocateInfo allocInfo;
+	allocInfo.allocationSize = size;
+	allocInfo.memoryTypeIndex = pool.memoryTypeIndex;
+
+	auto block = std::unique_ptr<Block>(new Block{ nullptr, TlsfHeap(size), nullptr, 0, dedicated });
+	try {
+		block->memory = device.allocateMemory(allocInfo);
+		if (pool.hostVisible) block->mapped = static_cast<char*>(device.mapMemory(block->memory, 0, size));
+	}
+	catch (vk::SystemError err) {
+#ifndef NDEBUG
+		std::cerr << "Failed to allocate a " << size << " byte block of memory type " << pool.memoryTypeIndex << std::endl;
+#endif
+		if (block->memory) device.freeMemory(block->memory);
+		return TlsfHeap::none;
+	}
+	++deviceAllocations;
+
+	for (uint32_t i = 0; i < pool.blocks.size(); ++i) {
+		if (pool.blocks[i]) continue;
+		pool.blocks[i] = std::move(block);
+		return i;
+	}
+	pool.blocks.push_back(std::move(block));
+	return static_cast<uint32_t>(pool.blocks.size() - 1);
+}
+
+void vkUtil::DeviceAllocator::destroy_block(Pool& pool, uint32_t index)
+{
+	// freeing mapped memory unmaps it
+	device.freeMemory(pool.blocks[index]->memory);
+	pool.blocks[index].reset();
+	--deviceAllocations;
+}
+
+vkUtil::Allocation vkUtil::DeviceAllocator::allocate(const vk::MemoryRequirements& requirements, vk::MemoryPropertyFlags properties, bool linear)
+{
+	uint32_t memoryTypeIndex = findMemoryTypeIndex(physicalDevice, requirements.memoryTypeBits, properties);
+	uint32_t poolIndex = find_pool(memoryTypeIndex, linear);
+	Pool& pool = pools[poolIndex];
+
+	Allocation allocation;
+	auto place = [&](uint32_t blockIndex) {
+		Block& block = *pool.blocks[blockIndex];
+		uint32_t region = block.heap.allocate(requirements.size, requirements.alignment);
+		if (region == TlsfHeap::none) return false;
+
+		allocation.memory = block.memory;
+		allocation.offset = block.heap.offset(region);
+		allocation.size = requirements.size;
+		allocation.mapped = block.mapped ? block.mapped + allocation.offset : nullptr;
+		allocation.allocator = this;
+		allocation.pool = poolIndex;
+		allocation.block = blockIndex;
+		allocation.region = region;
+		++block.allocationCount;
+		return true;
+	};
+
+	if (requirements.size > pool.blockSize / 2) {
+		uint32_t blockIndex = create_block(pool, requirements.size, true);
+		if (blockIndex != TlsfHeap::none && place(blockIndex)) return allocation;
+	}
+	else {
+		for (uint32_t i = 0; i < pool.blocks.size(); ++i) {
+			if (pool.blocks[i] && !pool.blocks[i]->dedicated && place(i)) return allocation;
+		}
+		uint32_t blockIndex = create_block(pool, pool.blockSize, false);
+		if (blockIndex != TlsfHeap::none && place(blockIndex)) return allocation;
+	}
+
+#ifndef NDEBUG
+	std::cerr << "Failed to allocate " << requirements.size << " bytes of memory type " << memoryTypeIndex << std::endl;
+#endif
+	return Allocation();
+}
+
+void vkUtil::DeviceAllocator::free(const Allocation& allocation)
+{
+	Pool& pool = pools[allocation.pool];
+	Block& block = *pool.blocks[allocation.block];
+	block.heap.free(allocation.region);
+	if (--block.allocationCount) return;
+
+	// keep one empty block around so a pool that drains and refills does not
+	// go back to the driver every time
+	bool spare = false;
+	for (uint32_t i = 0; i < pool.blocks.size(); ++i) {
+		if (i != allocation.block && pool.blocks[i] && !pool.blocks[i]->dedicated && !pool.blocks[i]->allocationCount) spare = true;
+	}
+	if (block.dedicated || spare) destroy_block(pool, allocation.block);
+}
+
+std::vector<vkUtil::MemoryPoolStats> vkUtil::DeviceAllocator::stats() const
+{
+	std::vector<MemoryPoolStats> result;
+	for (const auto& pool : pools) {
+		MemoryPoolStats stats{ pool.memoryTypeIndex, pool.linear, 0, 0, 0, 0, 0, 0 };
+		for (const auto& block : pool.blocks) {
+			if (!block) continue;
+			++stats.blockCount;
+			if (block->dedicated) ++stats.dedicatedBlockCount;
+			stats.allocationCount += block->allocationCount;
+			stats.reservedBytes += block->heap.capacity();
+			stats.usedBytes += block->heap.used_bytes();
+			stats.largestFreeRange = std::max(stats.largestFreeRange, block->heap.largest_free_range());
+		}
+		result.push_back(stats);
+	}
+	return result;
+}
@@ -0,0 +1,138 @@
+#pragma once
+#include "config.h"
+#include <array>
+
+namespace vkUtil {
+	// Two-level segregated fit (TLSF) free list over the byte range
+	// [0, capacity). It only does the bookkeeping, memory lives elsewhere.
+	// Allocation and free are O(1): the first level splits sizes by power of
+	// two, the second into slCount linear steps, and a bitmap per level finds
+	// the smallest non-empty list that is guaranteed to fit.
+	class TlsfHeap {
+	public:
+		static constexpr uint32_t none = UINT32_MAX;
+
+		explicit TlsfHeap(vk::DeviceSize capacity);
+
+		// Index of the region holding size bytes at a multiple of alignment
+		// (a power of two), or none when nothing fits.
+		uint32_t allocate(vk::DeviceSize size, vk::DeviceSize alignment);
+		void free(uint32_t region);
+		// Extends the range to [0, capacity); regions keep their indices.
+		void grow(vk::DeviceSize capacity);
+
+		vk::DeviceSize offset(uint32_t region) const { return regions[region].offset; }
+		vk::DeviceSize size(uint32_t region) const { return regions[region].size; }
+
+		vk::DeviceSize capacity() const { return total; }
+		vk::DeviceSize used_bytes() const { return used; }
+		vk::DeviceSize largest_free_range() const;
+		bool empty() const { return used == 0; }
+
+	private:
+		static constexpr uint32_t slBits = 5;
+		static constexpr uint32_t slCount = 1u << slBits;
+		static constexpr uint32_t flCount = 64;
+
+		struct Region {
+			vk::DeviceSize offset, size;
+			// neighbours in address order
+			uint32_t prevPhysical, nextPhysical;
+			// neighbours in the free list of this size class
+			uint32_t prevFree, nextFree;
+			bool free;
+		};
+
+		std::vector<Region> regions;
+		std::vector<uint32_t> unusedRegions;
+		uint64_t flBitmap = 0;
+		std::array<uint32_t, flCount> slBitmaps{};
+		std::array<std::array<uint32_t, slCount>, flCount> freeLists;
+		vk::DeviceSize total, used = 0;
+		// region at the end of the range
+		uint32_t last = none;
+
+		static void mapping(vk::DeviceSize size, uint32_t& fl, uint32_t& sl);
+		uint32_t new_region(const Region& region);
+		void insert_free(uint32_t index);
+		void remove_free(uint32_t index);
+		// splits the tail past size off index into a free region
+		void split(uint32_t index, vk::DeviceSize size);
+		// merges index into its previous neighbour, returns the survivor
+		uint32_t merge(uint32_t first, uint32_t second);
+	};
+
+	class DeviceAllocator;
+
+	// A range of device memory, either carved out of a DeviceAllocator block
+	// or (without allocator) a whole vkAllocateMemory of its own.
+	struct Allocation {
+		vk::DeviceMemory memory;
+		vk::DeviceSize offset = 0, size = 0;
+		// start of the range, host-visible memory only
+		void* mapped = nullptr;
+
+		DeviceAllocator* allocator = nullptr;
+		uint32_t pool = 0, block = 0, region = 0;
+	};
+
+	struct MemoryPoolStats {
+		uint32_t memoryTypeIndex;
+		// pools are split into buffers/linear images and optimal images when
+		// the device's bufferImageGranularity asks for it
+		bool linear;
+		size_t blockCount, dedicatedBlockCount, allocationCount;
+		vk::DeviceSize reservedBytes, usedBytes, largestFreeRange;
+	};
+
+	// Reserves blocks of device memory per memory type and sub-allocates
+	// buffers and images from them, keeping vkAllocateMemory calls (and
+	// maxMemoryAllocationCount) down to a handful. Host-visible blocks are
+	// mapped once, for as long as they live. Requests over half a block get
+	// a block of their own. Not thread safe.
+	class DeviceAllocator {
+	public:
+		DeviceAllocator(vk::Device device, vk::PhysicalDevice physicalDevice, vk::DeviceSize blockSize = vk::DeviceSize(64) << 20);
+		~DeviceAllocator();
+
+		DeviceAllocator(const DeviceAllocator&) = delete;
+		DeviceAllocator& operator=(const DeviceAllocator&) = delete;
+
+		// linear: buffers and linear images, as opposed to optimal tiling images
+		Allocation allocate(const vk::MemoryRequirements& requirements, vk::MemoryPropertyFlags properties, bool linear);
+		void free(const Allocation& allocation);
+
+		std::vector<MemoryPoolStats> stats() const;
+		// vkAllocateMemory calls currently alive
+		size_t device_allocation_count() const { return deviceAllocations; }
+
+	private:
+		struct Block {
+			vk::DeviceMemory memory;
+			TlsfHeap heap;
+			char* mapped;
+			size_t allocationCount;
+			bool dedicated;
+		};
+		struct Pool {
+			uint32_t memoryTypeIndex;
+			bool linear;
+			vk::DeviceSize blockSize;
+			bool hostVisible;
+			// freed blocks leave a null entry so indices held by allocations stay put
+			std::vector<std::unique_ptr<Block>> blocks;
+		};
+
+		vk::Device device;
+		vk::PhysicalDevice physicalDevice;
+		vk::PhysicalDeviceMemoryProperties memoryProperties;
+		vk::DeviceSize blockSize, bufferImageGranularity;
+		std::vector<Pool> pools;
+		size_t deviceAllocations = 0;
+
+		uint32_t find_pool(uint32_t memoryTypeIndex, bool linear);
+		// index of a new block in pool, or none if the device is out of memory
+		uint32_t create_block(Pool& pool, vk::DeviceSize size, bool dedicated);
+		void destroy_block(Pool& pool, uint32_t index);
+	};
+}
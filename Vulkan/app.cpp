@@ -9,6 +9,9 @@ static auto destroyGLFWwidow = [](GLFWwindow* window) noexcept {
 	}
 };
 
+// frames between the steps of --geometry-churn
+static constexpr uint64_t geometryChurnInterval = 120;
+
 void App::build_glfw_window(const int& width, const int& height, const bool& debugMode)
 {
 	glfwInit();
@@ -29,7 +32,14 @@ void App::calculateFrameRate()
 
 	if (delta >= 1) {
 		auto framerate = std::max(1, int(numFrames / delta));
-		std::stringstream title{}; title << "Running at " << framerate << " fps.";
+		auto culling = graphicsEngine->cull_stats();
+		std::stringstream title{}; title << "Running at " << framerate << " fps, "
+			<< culling.visible << " visible, " << culling.culled << " culled, " << culling.occluded << " occluded.";
+		auto occlusion = graphicsEngine->occlusion_stats();
+		if (occlusion.occluders) {
+			title << " Occlusion: " << occlusion.occluders << " occluders, " << occlusion.triangles << " triangles, raster "
+				<< std::fixed << std::setprecision(2) << occlusion.rasterMilliseconds << " ms, test " << occlusion.testMilliseconds << " ms.";
+		}
 		glfwSetWindowTitle(window.get(), title.str().c_str());
 		lastTime = currentTime;
 		numFrames = -1;
@@ -39,11 +49,34 @@ void App::calculateFrameRate()
 	++numFrames;
 }
 
-App::App(const int& width, const int& height, const bool& debug)
+void App::churn_geometry()
+{
+	if (!geometryChurn || ++framesRendered % geometryChurnInterval) return;
+
+	switch (framesRendered / geometryChurnInterval % 4) {
+	case 0:
+		// over itself: the old ranges are still in flight, so the buffers grow
+		graphicsEngine->load_mesh(meshTypes::GIRL, "Models/girl.obj", "Models/girl.mtl");
+		break;
+	case 1:
+		graphicsEngine->compact_geometry();
+		break;
+	case 2:
+		graphicsEngine->unload_mesh(meshTypes::GIRL);
+		break;
+	case 3:
+		// into the ranges the unload freed
+		graphicsEngine->load_mesh(meshTypes::GIRL, "Models/girl.obj", "Models/girl.mtl");
+		break;
+	}
+}
+
+App::App(const int& width, const int& height, const bool& debug, VertexFormat vertexFormat, CullingMode cullingMode, bool geometryChurn, size_t objectCount)
+	: geometryChurn(geometryChurn)
 {
 	build_glfw_window(width, height, debug);
-	graphicsEngine = std::make_unique<Engine>(width, height, window, debug);
-	scene = std::make_shared<Scene>();
+	graphicsEngine = std::make_unique<Engine>(width, height, window, debug, vertexFormat, cullingMode);
+	scene = std::make_shared<Scene>(objectCount);
 }
 
 App::~App()
@@ -57,5 +90,6 @@ void App::run()
 		graphicsEngine->render(scene);
 		graphicsEngine->present();
 		calculateFrameRate();
+		churn_geometry();
 	}
 }
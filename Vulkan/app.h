@@ -14,12 +14,22 @@ private:
 	int numFrames;
 	float frameTime;
 
+	// --geometry-churn: the girl is reloaded, the geometry compacted, the
+	// girl unloaded and loaded again, a step every geometryChurnInterval
+	// frames, so growth, deferred frees and compaction run with frames in
+	// flight
+	bool geometryChurn;
+	uint64_t framesRendered = 0;
+
 	void build_glfw_window(const int& width, const int& height, const bool& debugMode);
 
 	void calculateFrameRate();
+	void churn_geometry();
 
 public:
-	App(const int& width, const int& height, const bool& debug);
+	// objectCount: see Scene, 0 for the default scene
+	App(const int& width, const int& height, const bool& debug, VertexFormat vertexFormat = VertexFormat::FULL,
+		CullingMode cullingMode = CullingMode::GPU, bool geometryChurn = false, size_t objectCount = 0);
 	~App();
 	void run();
 };
@@ -0,0 +1,500 @@
+#include "benchmark.h"
+#include "obj_mesh.h"
+#include "mesh_cache.h"
+#include "mesh_optimizer.h"
+#include "mesh_simplifier.h"
+#include "obj_stream.h"
+#include "worker_pool.h"
+#include "transform_kernel.h"
+#include "frustum_culling.h"
+#include "occlusion_rasterizer.h"
+#include <chrono>
+#include <filesystem>
+#include <cstring>
+#include <limits>
+#include <random>
+#include <stdexcept>
+#include <glm/gtc/quaternion.hpp>
+
+namespace {
+	using Clock = std::chrono::steady_clock;
+
+	// The original loader: std::getline + split() + std::stof/std::stol,
+	// kept here as the baseline for the parser benchmark.
+	struct LegacyObjMesh {
+		std::vector<float> vertices;
+		std::vector<uint32_t> indices;
+		std::unordered_map<std::string, uint32_t> history;
+		std::unordered_map<std::string, glm::vec3> colors;
+		glm::vec3 brushColor;
+		std::vector<glm::vec3> v, vn;
+		std::vector<glm::vec2> vt;
+
+		LegacyObjMesh(const char* objFilepath, const char* mtlFilepath) {
+			std::ifstream file;
+			file.open(mtlFilepath);
+			std::string line;
+			std::string materialName;
+			std::vector<std::string> words;
+
+			while (std::getline(file, line)) {
+				words = split(line, " ");
+				if (!words[0].compare("newmtl")) materialName = words[1];
+				if (!words[0].compare("Kd")) {
+					brushColor = glm::vec3(std::stof(words[1]), std::stof(words[2]), std::stof(words[3]));
+					colors.insert({ materialName, brushColor });
+				}
+			}
+			file.close();
+
+			file.open(objFilepath);
+			while (std::getline(file, line)) {
+				words = split(line, " ");
+				if (!words[0].compare("v")) v.push_back(glm::vec3(std::stof(words[1]), std::stof(words[2]), std::stof(words[3])));
+				if (!words[0].compare("vt")) vt.push_back(glm::vec2(std::stof(words[1]), std::stof(words[2])));
+				if (!words[0].compare("vn")) vn.push_back(glm::vec3(std::stof(words[1]), std::stof(words[2]), std::stof(words[3])));
+				if (!words[0].compare("usemtl")) brushColor = colors.contains(words[1]) ? colors[words[1]] : glm::vec3(1.0f);
+				if (!words[0].compare("f")) {
+					size_t triangleCount = words.size() - 3;
+					for (size_t i = 0; i < triangleCount; ++i) {
+						read_corner(words[1]);
+						read_corner(words[2 + i]);
+						read_corner(words[3 + i]);
+					}
+				}
+			}
+			file.close();
+		}
+
+		void read_corner(const std::string& description) {
+			if (history.contains(description)) {
+				indices.push_back(history[description]);
+				return;
+			}
+			uint32_t index = static_cast<uint32_t>(history.size());
+			history.insert({ description, index });
+			indices.push_back(index);
+
+			std::vector<std::string> v_vt_vn = split(description, "/");
+			glm::vec3 pos = v[std::stol(v_vt_vn[0]) - 1];
+			glm::vec2 texcoord = glm::vec2(0.0f, 0.0f);
+			if (v_vt_vn.size() == 3 && v_vt_vn[1].size() > 0) texcoord = vt[std::stol(v_vt_vn[1]) - 1];
+			glm::vec3 normal = v[std::stol(v_vt_vn[2]) - 1];
+			for (float attribute : { pos[0], pos[1], pos[2], brushColor.r, brushColor.g, brushColor.b,
+				texcoord[0], texcoord[1], normal[0], normal[1], normal[2] }) {
+				vertices.push_back(attribute);
+			}
+		}
+	};
+
+	template<typename Loader>
+	double best_seconds(int repeats, Loader load) {
+		double best = std::numeric_limits<double>::max();
+		for (int i = 0; i < repeats; ++i) {
+			auto start = Clock::now();
+			load();
+			best = std::min(best, std::chrono::duration<double>(Clock::now() - start).count());
+		}
+		return best;
+	}
+
+	// Random positions within +-100, rotations, and scales of 0.5 to 2, in
+	// the ten float streams Scene keeps.
+	struct RandomTransforms {
+		std::array<std::vector<float>, 10> streams;
+
+		RandomTransforms(size_t count, std::mt19937& random) {
+			std::uniform_real_distribution<float> coordinate(-100.0f, 100.0f), unit(-1.0f, 1.0f), size(0.5f, 2.0f);
+			for (auto& stream : streams) stream.resize(count);
+			for (size_t i = 0; i < count; ++i) {
+				glm::quat rotation = glm::normalize(glm::quat(unit(random), unit(random), unit(random), unit(random)));
+				float components[10] = { coordinate(random), coordinate(random), coordinate(random),
+					rotation.x, rotation.y, rotation.z, rotation.w, size(random), size(random), size(random) };
+				for (int stream = 0; stream < 10; ++stream) streams[stream][i] = components[stream];
+			}
+		}
+
+		vkUtil::TransformStreams view() const {
+			return {
+				{ streams[0].data(), streams[1].data(), streams[2].data() },
+				{ streams[3].data(), streams[4].data(), streams[5].data(), streams[6].data() },
+				{ streams[7].data(), streams[8].data(), streams[9].data() }
+			};
+		}
+
+		glm::vec3 scale(size_t i) const { return glm::vec3(streams[7][i], streams[8][i], streams[9][i]); }
+
+		// glm's translate * mat4_cast * scale
+		glm::mat4 matrix(size_t i) const {
+			glm::quat rotation(streams[6][i], streams[3][i], streams[4][i], streams[5][i]);
+			return glm::translate(glm::mat4(1.0f), glm::vec3(streams[0][i], streams[1][i], streams[2][i]))
+				* glm::mat4_cast(rotation) * glm::scale(glm::mat4(1.0f), scale(i));
+		}
+	};
+
+	// cull_objects' test one object at a time on a glm matrix: outside when
+	// the volume's center is farther behind a plane than the tighter of the
+	// box and the sphere reaches.
+	bool reference_visible(const vkUtil::Frustum& frustum, const glm::mat4& model, glm::vec3 scale, const vkMesh::MeshVolume& volume) {
+		glm::vec3 center = glm::vec3(model * glm::vec4(volume.center, 1.0f));
+		float sphereRadius = volume.radius * std::max({ std::abs(scale.x), std::abs(scale.y), std::abs(scale.z) });
+		for (const auto& plane : frustum.planes) {
+			glm::vec3 normal = glm::vec3(plane);
+			float boxRadius = 0.0f;
+			for (int axis = 0; axis < 3; ++axis) boxRadius += std::abs(glm::dot(normal, glm::vec3(model[axis]))) * volume.extent[axis];
+			if (glm::dot(normal, center) + plane.w < -std::min(boxRadius, sphereRadius)) return false;
+		}
+		return true;
+	}
+
+	// The engine's camera.
+	const glm::vec3 engineEye(-2.0f, 5.0f, 10.0f), engineCenter(10.0f, 0.0f, 0.0f);
+
+	// and its projection at 16:9
+	glm::mat4 engine_view_projection() {
+		glm::mat4 view = glm::lookAt(engineEye, engineCenter, glm::vec3(0.0f, 0.0f, 2.0f));
+		glm::mat4 projection = glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 0.1f, 100.0f);
+		projection[1][1] *= -1;
+		return projection * view;
+	}
+
+	// A cube from -1 to 1 as an occluder.
+	vkUtil::OccluderMesh cube_occluder() {
+		std::vector<float> vertices;
+		for (int corner = 0; corner < 8; ++corner) {
+			vertices.insert(vertices.end(), { corner & 1 ? 1.0f : -1.0f, corner & 2 ? 1.0f : -1.0f, corner & 4 ? 1.0f : -1.0f });
+		}
+		std::vector<uint32_t> indices = {
+			0, 2, 1, 1, 2, 3, 4, 5, 6, 5, 7, 6, 0, 1, 4, 1, 5, 4,
+			2, 6, 3, 3, 6, 7, 0, 4, 2, 2, 4, 6, 1, 3, 5, 3, 7, 5
+		};
+		return vkUtil::make_occluder(vertices, 3, indices, {});
+	}
+}
+
+void vkBench::obj_loader_throughput(const char* objFilepath, const char* mtlFilepath, int repeats)
+{
+	std::error_code error;
+	auto bytes = std::filesystem::file_size(objFilepath, error);
+	if (error) {
+		std::cerr << "Benchmark: can't read \"" << objFilepath << "\"" << std::endl;
+		return;
+	}
+	double megabytes = static_cast<double>(bytes) / (1024.0 * 1024.0);
+
+	double legacySeconds = best_seconds(repeats, [&] { LegacyObjMesh mesh(objFilepath, mtlFilepath); });
+	double mappedSeconds = best_seconds(repeats, [&] { vkMesh::ObjMesh mesh(objFilepath, mtlFilepath, glm::mat4(1.0f)); });
+
+	vkUtil::WorkerPool workers;
+	double parallelSeconds = best_seconds(repeats, [&] { vkMesh::ObjMesh mesh(objFilepath, mtlFilepath, glm::mat4(1.0f), &workers); });
+
+	LegacyObjMesh legacy(objFilepath, mtlFilepath);
+	vkMesh::ObjMesh mapped(objFilepath, mtlFilepath, glm::mat4(1.0f));
+	vkMesh::ObjMesh parallel(objFilepath, mtlFilepath, glm::mat4(1.0f), &workers);
+	bool identical = parallel.vertices == mapped.vertices && parallel.indices == mapped.indices;
+	auto dedup = mapped.history.stats();
+
+	std::cout << std::fixed << std::setprecision(1)
+		<< objFilepath << " (" << megabytes << " MB)\n"
+		<< "\tgetline + split: " << megabytes / legacySeconds << " MB/s, "
+		<< vkMesh::VertexWriter<vkMesh::FullVertex>::vertex_count(legacy.vertices) << " vertices, " << legacy.indices.size() << " indices\n"
+		<< "\tmapped parser:   " << megabytes / mappedSeconds << " MB/s ("
+		<< legacySeconds / mappedSeconds << "x), "
+		<< vkMesh::VertexWriter<vkMesh::FullVertex>::vertex_count(mapped.vertices) << " vertices, " << mapped.indices.size() << " indices\n"
+		<< "\tmapped, " << workers.size() << " threads: " << megabytes / parallelSeconds << " MB/s ("
+		<< legacySeconds / parallelSeconds << "x), output " << (identical ? "identical" : "DIFFERS") << "\n"
+		<< std::setprecision(3)
+		<< "\tdedup hit rate " << dedup.hit_rate() << ", load factor " << dedup.load_factor()
+		<< ", table " << mapped.history.memory_bytes() / (1024.0 * 1024.0) << " MB" << std::endl;
+}
+
+void vkBench::mesh_cache_load(const char* objFilepath, const char* mtlFilepath, int repeats)
+{
+	glm::mat4 preTransform = glm::mat4(1.0f);
+	vkMesh::MeshImportOptions options;
+	vkMesh::ObjMesh mesh(objFilepath, mtlFilepath, preTransform);
+	vkMesh::optimize_mesh(mesh, options.optimize);
+	vkMesh::build_lod_chain(mesh, options.lods);
+	if (!vkMesh::MeshCache::write(objFilepath, mtlFilepath, preTransform, options, mesh)) {
+		std::cerr << "Benchmark: can't write the mesh cache for \"" << objFilepath << "\"" << std::endl;
+		return;
+	}
+
+	size_t bytes = mesh.vertices.size() * sizeof(float) + mesh.indices.size() * sizeof(uint32_t);
+	std::vector<char> staging(bytes);
+	bool valid = true;
+
+	double cacheSeconds = best_seconds(repeats, [&] {
+		vkMesh::MeshCache cache(objFilepath, mtlFilepath, preTransform, options);
+		valid = valid && cache.is_valid();
+		if (!cache.is_valid()) return;
+		memcpy(staging.data(), cache.vertices().data(), cache.vertices().size_bytes());
+		memcpy(staging.data() + cache.vertices().size_bytes(), cache.indices().data(), cache.indices().size_bytes());
+	});
+	double memcpySeconds = best_seconds(repeats, [&] {
+		memcpy(staging.data(), mesh.vertices.data(), mesh.vertices.size() * sizeof(float));
+		memcpy(staging.data() + mesh.vertices.size() * sizeof(float), mesh.indices.data(), mesh.indices.size() * sizeof(uint32_t));
+	});
+
+	double megabytes = static_cast<double>(bytes) / (1024.0 * 1024.0);
+	std::cout << std::fixed << std::setprecision(2)
+		<< objFilepath << " mesh cache (" << megabytes << " MB of geometry)\n"
+		<< "\tcache open + copy: " << cacheSeconds * 1000.0 << " ms\n"
+		<< "\tmemcpy only:       " << memcpySeconds * 1000.0 << " ms\n"
+		<< "\tcache " << (valid ? "valid" : "INVALID") << std::endl;
+}
+
+void vkBench::mesh_optimization(const char* objFilepath, const char* mtlFilepath)
+{
+	vkMesh::ObjMesh mesh(objFilepath, mtlFilepath, glm::mat4(1.0f));
+
+	vkMesh::MeshOptimizeOptions options;
+	options.overdraw = true;
+
+	auto start = Clock::now();
+	auto stats = vkMesh::optimize_mesh(mesh, options);
+	double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+	std::cout << std::fixed << std::setprecision(3)
+		<< objFilepath << " mesh optimization (" << mesh.indices.size() / 3 << " triangles)\n"
+		<< "\tACMR " << stats.before.acmr << " -> " << stats.after.acmr << "\n"
+		<< "\tATVR " << stats.before.atvr << " -> " << stats.after.atvr << "\n"
+		<< "\toverfetch " << stats.fetchBefore.overfetch << " -> " << stats.fetchAfter.overfetch << "\n"
+		<< "\toverdraw " << stats.overdrawBefore.overdraw << " -> " << stats.overdrawAfter.overdraw << "\n"
+		<< std::setprecision(1) << "\toptimized in " << seconds * 1000.0 << " ms" << std::endl;
+
+	start = Clock::now();
+	vkMesh::build_lod_chain(mesh);
+	seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+	std::cout << "\tLOD chain built in " << seconds * 1000.0 << " ms\n";
+	for (size_t level = 0; level < mesh.lods.size(); ++level) {
+		std::cout << "\t\tLOD " << level << ": " << mesh.lods[level].indexCount / 3 << " triangles, error "
+			<< std::setprecision(5) << mesh.lods[level].error << std::setprecision(1) << "\n";
+	}
+	std::cout << std::flush;
+}
+
+void vkBench::streaming_import(const char* objFilepath, const char* mtlFilepath, size_t memoryBudget)
+{
+	auto start = Clock::now();
+	vkMesh::ObjMesh mesh(objFilepath, mtlFilepath, glm::mat4(1.0f));
+	double wholeSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+	// everything ObjMesh holds on to until the import is done
+	size_t wholeBytes = mesh.vertices.capacity() * sizeof(float) + mesh.indices.capacity() * sizeof(uint32_t)
+		+ mesh.v.capacity() * sizeof(glm::vec3) + mesh.vn.capacity() * sizeof(glm::vec3) + mesh.vt.capacity() * sizeof(glm::vec2)
+		+ mesh.history.memory_bytes();
+
+	vkMesh::StreamingOptions options;
+	options.memoryBudget = memoryBudget;
+	size_t blockBytes = 0;
+	start = Clock::now();
+	vkMesh::ObjStream stream(objFilepath, mtlFilepath, glm::mat4(1.0f), options);
+	auto stats = stream.emit([&](const vkMesh::MeshBlock& block) {
+		blockBytes += block.vertices.size_bytes() + block.indices.size_bytes();
+	});
+	double streamSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+	std::cout << std::fixed << std::setprecision(2)
+		<< objFilepath << " streaming import (" << memoryBudget / 1024 << " KB budget)\n"
+		<< "\twhole:    " << wholeSeconds * 1000.0 << " ms, " << wholeBytes / (1024.0 * 1024.0) << " MB held, "
+		<< vkMesh::VertexWriter<vkMesh::FullVertex>::vertex_count(mesh.vertices) << " vertices\n"
+		<< "\tstreamed: " << streamSeconds * 1000.0 << " ms, " << stats.peakBytes / (1024.0 * 1024.0) << " MB held + "
+		<< stagingRingSize / (1024.0 * 1024.0) << " MB shared staging ring, " << stats.vertexCount << " vertices in "
+		<< stats.blockCount << " blocks (" << blockBytes / (1024.0 * 1024.0) << " MB), "
+		<< stats.windowResets << " window restarts" << std::endl;
+}
+
+void vkBench::transform_build(size_t objectCount, int repeats)
+{
+	std::mt19937 random(1);
+	RandomTransforms objects(objectCount, random);
+	const auto& streams = objects.streams;
+	vkUtil::TransformStreams input = objects.view();
+	std::vector<glm::mat4> matrices(objectCount);
+
+	float largestError = 0.0f;
+	vkUtil::build_transforms(input, 0, objectCount, matrices.data(), vkUtil::best_simd_path());
+	for (size_t i = 0; i < objectCount; ++i) {
+		glm::mat4 reference = objects.matrix(i);
+		for (int c = 0; c < 4; ++c) {
+			for (int r = 0; r < 4; ++r) largestError = std::max(largestError, std::abs(reference[c][r] - matrices[i][c][r]));
+		}
+	}
+
+	double millions = static_cast<double>(objectCount) / 1e6;
+	std::cout << std::fixed << std::setprecision(1) << "Transform build (" << objectCount << " objects)\n";
+
+	double glmSeconds = best_seconds(repeats, [&] {
+		for (size_t i = 0; i < objectCount; ++i) {
+			glm::quat rotation(streams[6][i], streams[3][i], streams[4][i], streams[5][i]);
+			matrices[i] = glm::scale(glm::translate(glm::mat4(1.0f), glm::vec3(streams[0][i], streams[1][i], streams[2][i])) * glm::mat4_cast(rotation),
+				glm::vec3(streams[7][i], streams[8][i], streams[9][i]));
+		}
+	});
+	std::cout << "\tglm:     " << millions / glmSeconds << " M matrices/s\n";
+
+	std::vector<vkUtil::SimdPath> paths = { vkUtil::SimdPath::SCALAR };
+	if (vkUtil::best_simd_path() != vkUtil::SimdPath::SCALAR) paths.push_back(vkUtil::SimdPath::SSE);
+	if (vkUtil::best_simd_path() == vkUtil::SimdPath::AVX) paths.push_back(vkUtil::SimdPath::AVX);
+	for (auto path : paths) {
+		double seconds = best_seconds(repeats, [&] { vkUtil::build_transforms(input, 0, objectCount, matrices.data(), path); });
+		std::cout << "\t" << vkUtil::simd_path_name(path) << ": " << std::string(8 - std::strlen(vkUtil::simd_path_name(path)), ' ')
+			<< millions / seconds << " M matrices/s (" << glmSeconds / seconds << "x)\n";
+	}
+
+	vkUtil::WorkerPool workers;
+	double poolSeconds = best_seconds(repeats, [&] { vkUtil::build_transforms(input, objectCount, matrices.data(), &workers); });
+	std::cout << "\t" << workers.size() << " threads: " << millions / poolSeconds << " M matrices/s, "
+		<< millions / poolSeconds / workers.size() << " M per core\n";
+
+	// what a frame rebuilds when a tenth of the scene moved
+	std::vector<uint32_t> changed(objectCount / 10);
+	for (size_t i = 0; i < changed.size(); ++i) changed[i] = static_cast<uint32_t>(i * 10);
+	double changedSeconds = best_seconds(repeats, [&] { vkUtil::build_transforms(input, changed, matrices.data(), vkUtil::best_simd_path()); });
+	std::cout << "\tscattered tenth: " << static_cast<double>(changed.size()) / 1e6 / changedSeconds << " M matrices/s\n"
+		<< std::setprecision(7) << "\tlargest difference from glm " << largestError << std::endl;
+}
+
+void vkBench::frustum_culling(size_t objectCount, int repeats)
+{
+	std::mt19937 random(2);
+	RandomTransforms objects(objectCount, random);
+	vkUtil::TransformStreams input = objects.view();
+
+	std::uniform_int_distribution<size_t> type(0, meshTypeCount - 1);
+	std::vector<meshTypes> types(objectCount);
+	for (auto& objectType : types) objectType = static_cast<meshTypes>(type(random));
+	std::uniform_real_distribution<float> corner(-3.0f, 3.0f);
+	std::array<vkMesh::MeshVolume, meshTypeCount> volumes;
+	for (auto& volume : volumes) {
+		glm::vec3 a(corner(random), corner(random), corner(random)), b(corner(random), corner(random), corner(random));
+		volume = vkMesh::mesh_volume(glm::min(a, b), glm::max(a, b));
+	}
+	vkUtil::Frustum frustum = vkUtil::extract_frustum(engine_view_projection());
+
+	std::vector<uint8_t> visible(objectCount), expected(objectCount);
+	size_t visibleCount = vkUtil::cull_objects(frustum, input, types, volumes, visible.data(), nullptr);
+
+	double millions = static_cast<double>(objectCount) / 1e6;
+	std::cout << std::fixed << std::setprecision(1) << "Frustum culling (" << objectCount << " objects, "
+		<< 100.0 * visibleCount / objectCount << "% visible)\n";
+
+	double referenceSeconds = best_seconds(repeats, [&] {
+		for (size_t i = 0; i < objectCount; ++i) {
+			expected[i] = reference_visible(frustum, objects.matrix(i), objects.scale(i), volumes[static_cast<size_t>(types[i])]);
+		}
+	});
+	std::cout << "\tglm reference: " << millions / referenceSeconds << " M objects/s\n";
+	size_t mismatches = 0;
+	for (size_t i = 0; i < objectCount; ++i) {
+		if ((expected[i] != 0) != (visible[i] != 0)) ++mismatches;
+	}
+
+	double serialSeconds = best_seconds(repeats, [&] { vkUtil::cull_objects(frustum, input, types, volumes, visible.data(), nullptr); });
+	std::cout << "\tcull_objects:  " << millions / serialSeconds << " M objects/s (" << referenceSeconds / serialSeconds << "x)\n";
+
+	vkUtil::WorkerPool workers;
+	double poolSeconds = best_seconds(repeats, [&] { vkUtil::cull_objects(frustum, input, types, volumes, visible.data(), &workers); });
+	std::cout << "\t" << workers.size() << " threads: " << millions / poolSeconds << " M objects/s, "
+		<< millions / poolSeconds / workers.size() << " M per core\n"
+		<< "\t" << mismatches << " objects disagree with the reference" << std::endl;
+}
+
+void vkBench::occlusion_culling(size_t objectCount, int repeats)
+{
+	glm::mat4 viewProjection = engine_view_projection();
+	std::array<vkMesh::MeshVolume, meshTypeCount> volumes;
+	volumes.fill(vkMesh::mesh_volume(glm::vec3(-1.0f), glm::vec3(1.0f)));
+
+	// Halfway along the view ray a cube of side 4 hides a cube of side 1 at
+	// the center of the view; another one a fifth of the way stays in front.
+	// Only the ground type has an occluder, so the small cubes are just tested.
+	std::mt19937 random(3);
+	RandomTransforms known(3, random);
+	glm::vec3 places[3] = { glm::mix(engineEye, engineCenter, 0.5f), engineCenter, glm::mix(engineEye, engineCenter, 0.2f) };
+	float sizes[3] = { 2.0f, 0.5f, 0.5f };
+	for (size_t i = 0; i < 3; ++i) {
+		float components[10] = { places[i].x, places[i].y, places[i].z, 0.0f, 0.0f, 0.0f, 1.0f, sizes[i], sizes[i], sizes[i] };
+		for (int stream = 0; stream < 10; ++stream) known.streams[stream][i] = components[stream];
+	}
+	std::vector<meshTypes> knownTypes = { meshTypes::GROUND, meshTypes::SKULL, meshTypes::SKULL };
+
+	RandomTransforms objects(objectCount, random);
+	std::uniform_int_distribution<size_t> type(0, meshTypeCount - 1);
+	std::vector<meshTypes> types(objectCount);
+	for (auto& objectType : types) objectType = static_cast<meshTypes>(type(random));
+	std::vector<uint8_t> inFrustum(objectCount);
+	size_t frustumCount = vkUtil::cull_objects(vkUtil::extract_frustum(viewProjection), objects.view(), types, volumes, inFrustum.data(), nullptr);
+
+	std::cout << std::fixed << std::setprecision(2) << "Occlusion culling (" << objectCount << " objects, " << frustumCount << " in the frustum)\n";
+
+	struct Run {
+		std::vector<float> knownDepth, depth;
+		std::vector<uint8_t> knownVisible, visible;
+		vkUtil::OcclusionStats best;
+	};
+	vkUtil::WorkerPool workers;
+	auto run = [&](vkUtil::SimdPath path) {
+		Run result;
+		vkUtil::OcclusionRasterizer rasterizer(1600, 900, path);
+		size_t depthSize = size_t(rasterizer.width()) * rasterizer.height();
+
+		rasterizer.set_occluder(meshTypes::GROUND, cube_occluder());
+		result.knownVisible.assign(3, 1);
+		rasterizer.render(viewProjection, engineEye, known.view(), knownTypes, volumes, result.knownVisible.data(), nullptr);
+		rasterizer.cull_occluded(known.view(), knownTypes, volumes, result.knownVisible.data(), nullptr);
+		result.knownDepth.assign(rasterizer.depth(), rasterizer.depth() + depthSize);
+
+		for (size_t type = 0; type < meshTypeCount; ++type) rasterizer.set_occluder(static_cast<meshTypes>(type), cube_occluder());
+		result.best.rasterMilliseconds = result.best.testMilliseconds = std::numeric_limits<double>::max();
+		for (int i = 0; i < repeats; ++i) {
+			result.visible = inFrustum;
+			rasterizer.render(viewProjection, engineEye, objects.view(), types, volumes, result.visible.data(), &workers);
+			rasterizer.cull_occluded(objects.view(), types, volumes, result.visible.data(), &workers);
+			vkUtil::OcclusionStats stats = rasterizer.stats();
+			stats.rasterMilliseconds = std::min(stats.rasterMilliseconds, result.best.rasterMilliseconds);
+			stats.testMilliseconds = std::min(stats.testMilliseconds, result.best.testMilliseconds);
+			result.best = stats;
+		}
+		result.depth.assign(rasterizer.depth(), rasterizer.depth() + depthSize);
+
+		const char* name = path == vkUtil::SimdPath::AVX ? "AVX" : "scalar";
+		std::cout << "\t" << name << ": " << result.best.occluders << " occluders, " << result.best.triangles << " triangles in "
+			<< result.best.rasterMilliseconds << " ms, " << result.best.rejected << " of " << frustumCount << " rejected in "
+			<< result.best.testMilliseconds << " ms\n";
+		return result;
+	};
+
+	Run scalar = run(vkUtil::SimdPath::SCALAR);
+	if (!scalar.knownVisible[2]) throw std::runtime_error("occlusion culling rejected a box in front of the occluder!");
+	if (scalar.knownVisible[1]) throw std::runtime_error("occlusion culling kept a box behind the occluder!");
+	if (vkUtil::best_simd_path() == vkUtil::SimdPath::AVX) {
+		Run avx = run(vkUtil::SimdPath::AVX);
+		if (avx.knownDepth != scalar.knownDepth || avx.depth != scalar.depth || avx.knownVisible != scalar.knownVisible
+			|| avx.visible != scalar.visible) {
+			throw std::runtime_error("the AVX occlusion buffer differs from the scalar one!");
+		}
+		std::cout << "\tAVX and scalar depth buffers match\n";
+	}
+	std::cout << "\tbox behind the occluder rejected, box in front kept" << std::endl;
+}
+
+void vkBench::run_all()
+{
+	obj_loader_throughput("Models/ground.obj", "Models/ground.mtl");
+	obj_loader_throughput("Models/girl.obj", "Models/girl.mtl");
+
+	mesh_cache_load("Models/ground.obj", "Models/ground.mtl");
+	mesh_cache_load("Models/girl.obj", "Models/girl.mtl");
+
+	mesh_optimization("Models/ground.obj", "Models/ground.mtl");
+	mesh_optimization("Models/girl.obj", "Models/girl.mtl");
+
+	streaming_import("Models/ground.obj", "Models/ground.mtl");
+	streaming_import("Models/girl.obj", "Models/girl.mtl");
+
+	transform_build();
+	frustum_culling();
+	occlusion_culling();
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include "config.h"
+
+namespace vkBench {
+	// Times the string/getline OBJ loader against vkMesh::ObjMesh, serial and
+	// on a worker pool, and reports throughput in MB/s, whether the serial and
+	// parallel outputs match, and the corner dedup counters.
+	void obj_loader_throughput(const char* objFilepath, const char* mtlFilepath, int repeats = 5);
+
+	// Times opening the binary mesh cache and copying its blobs out, next to a
+	// plain memcpy of the same bytes (the staging buffer write it replaces).
+	void mesh_cache_load(const char* objFilepath, const char* mtlFilepath, int repeats = 5);
+
+	// Reports ACMR/ATVR, vertex overfetch and overdraw of the imported mesh
+	// before and after vkMesh::optimize_mesh, plus the time it took, then
+	// the triangle count and error of every level of the LOD chain.
+	void mesh_optimization(const char* objFilepath, const char* mtlFilepath);
+
+	// Imports the model whole and streamed with a memoryBudget byte budget,
+	// and reports the time and the most host memory each held, with the
+	// vertex count the bounded dedup window ends up with.
+	void streaming_import(const char* objFilepath, const char* mtlFilepath, size_t memoryBudget = size_t(4) << 20);
+
+	// Builds objectCount model matrices from random transforms on every SIMD
+	// path, then on a worker pool and for a scattered tenth of the objects,
+	// and reports matrices per second per core and the largest difference
+	// from glm's translate * mat4_cast * scale.
+	void transform_build(size_t objectCount = 100000, int repeats = 20);
+
+	// Culls objectCount random objects against the engine's view frustum with
+	// vkUtil::cull_objects, serial and on a worker pool, and reports objects
+	// per second next to a scalar plane/box test on glm matrices, and how many
+	// objects the two disagree on.
+	void frustum_culling(size_t objectCount = 100000, int repeats = 20);
+
+	// Draws a cube occluder with vkUtil::OcclusionRasterizer and throws unless
+	// a box behind it is rejected and one in front is kept, then times
+	// rendering and testing objectCount random objects in the engine's
+	// frustum. Throws when the AVX and scalar depth buffers differ.
+	void occlusion_culling(size_t objectCount = 100000, int repeats = 20);
+
+	// Runs every benchmark on the engine's models, for "Vulkan.exe --benchmark".
+	void run_all();
+}
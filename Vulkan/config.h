@@ -19,10 +19,41 @@ enum class meshTypes {
 	GIRL,
 	SKULL
 };
+// number of meshTypes, for tables indexed by them
+constexpr size_t meshTypeCount = 3;
 
 enum class PipelineTypes {
 	SKY,
 	STANDARD
 };
 
+// Bytes of the persistently mapped staging ring every upload goes through.
+constexpr size_t stagingRingSize = size_t(32) << 20;
+
+// Objects the per-frame transform and instance buffers start out with; they
+// double whenever a scene outgrows them.
+constexpr size_t initialInstanceCapacity = 1024;
+
+// CPU: prepare_frame culls the objects, picks their levels of detail and
+// records one draw per batch. CPU_OCCLUSION: CPU, and objects hidden behind
+// the largest-looking ones in a depth buffer the CPU rasterizes are left out
+// too. GPU: compute passes do all of that and the frame is drawn with
+// indirect draws; devices that can't run it use CPU_OCCLUSION. GPU is the
+// default, --cpu-culling and --cpu-occlusion pick the others.
+enum class CullingMode {
+	CPU,
+	CPU_OCCLUSION,
+	GPU
+};
+
+// Levels of detail per mesh the GPU path draws, coarser ones are never
+// picked. Shaders/culling.glsl has the same number.
+constexpr uint32_t maxDrawLods = 8;
+
+// FULL: 44-byte vkMesh::FullVertex. COMPACT: 16-byte vkMesh::CompactVertex.
+enum class VertexFormat {
+	FULL,
+	COMPACT
+};
+
 std::vector<std::string> split(std::string line, std::string delimiter);
\ No newline at end of file
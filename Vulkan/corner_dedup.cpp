@@ -0,0 +1,82 @@
+#include "corner_dedup.h"
+
+namespace {
+	// grow once the table is 70% full
+	constexpr size_t maxLoadNumerator = 7, maxLoadDenominator = 10;
+	constexpr size_t minCapacity = 64;
+}
+
+vkMesh::CornerDedupTable::CornerDedupTable()
+{
+	rehash(minCapacity);
+}
+
+size_t vkMesh::CornerDedupTable::hash(const CornerKey& key)
+{
+	uint64_t low = static_cast<uint64_t>(key.v) | static_cast<uint64_t>(key.vt) << 32;
+	uint64_t high = static_cast<uint64_t>(key.vn) | static_cast<uint64_t>(key.material) << 32;
+
+	// 128 -> 64 bit mix, then the murmur3 finalizer
+	uint64_t h = low * 0x9E3779B97F4A7C15ull ^ (high + 0x632BE59BD9B4E019ull) * 0xC2B2AE3D27D4EB4Full;
+	h ^= h >> 33;
+	h *= 0xFF51AFD7ED558CCDull;
+	h ^= h >> 33;
+	h *= 0xC4CEB9FE1A85EC53ull;
+	h ^= h >> 33;
+	return static_cast<size_t>(h);
+}
+
+bool vkMesh::CornerDedupTable::find_or_insert(const CornerKey& key, uint32_t& index)
+{
+	++lookups;
+
+	size_t slot = hash(key) & mask;
+	while (slots[slot].index != emptySlot) {
+		if (slots[slot].key == key) {
+			++hits;
+			index = slots[slot].index;
+			return true;
+		}
+		slot = (slot + 1) & mask;
+	}
+
+	index = static_cast<uint32_t>(count++);
+	slots[slot] = { key, index };
+
+	if (count * maxLoadDenominator > slots.size() * maxLoadNumerator) rehash(slots.size() * 2);
+	return false;
+}
+
+void vkMesh::CornerDedupTable::reserve(size_t expected)
+{
+	size_t capacity = slots.size();
+	while (expected * maxLoadDenominator > capacity * maxLoadNumerator) capacity *= 2;
+	if (capacity != slots.size()) rehash(capacity);
+}
+
+void vkMesh::CornerDedupTable::clear()
+{
+	std::fill(slots.begin(), slots.end(), Slot{ {}, emptySlot });
+	count = 0;
+}
+
+size_t vkMesh::CornerDedupTable::capacity_for(size_t bytes)
+{
+	size_t capacity = minCapacity;
+	while (capacity * 2 * sizeof(Slot) <= bytes) capacity *= 2;
+	return capacity * maxLoadNumerator / maxLoadDenominator;
+}
+
+void vkMesh::CornerDedupTable::rehash(size_t capacity)
+{
+	std::vector<Slot> old(capacity, Slot{ {}, emptySlot });
+	old.swap(slots);
+	mask = capacity - 1;
+
+	for (const auto& entry : old) {
+		if (entry.index == emptySlot) continue;
+		size_t slot = hash(entry.key) & mask;
+		while (slots[slot].index != emptySlot) slot = (slot + 1) & mask;
+		slots[slot] = entry;
+	}
+}
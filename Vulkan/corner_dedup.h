@@ -0,0 +1,57 @@
+#pragma once
+#include "config.h"
+
+namespace vkMesh {
+	// One face corner of an .obj: 0-based attribute indices plus the
+	// material it was drawn with. Missing attributes are noAttribute.
+	struct CornerKey {
+		static constexpr uint32_t noAttribute = UINT32_MAX;
+
+		uint32_t v, vt, vn, material;
+
+		bool operator==(const CornerKey& other) const = default;
+	};
+
+	struct CornerDedupStats {
+		size_t lookups, hits;
+		size_t size, capacity;
+
+		double hit_rate() const { return lookups ? static_cast<double>(hits) / lookups : 0.0; }
+		double load_factor() const { return capacity ? static_cast<double>(size) / capacity : 0.0; }
+	};
+
+	// Open-addressing (linear probing) map from CornerKey to vertex index.
+	// Vertex indices are handed out in insertion order.
+	class CornerDedupTable {
+	public:
+		CornerDedupTable();
+
+		// Looks key up; on a miss it is inserted with index size().
+		// Returns true if the corner was already known.
+		bool find_or_insert(const CornerKey& key, uint32_t& index);
+
+		void reserve(size_t count);
+		// Forgets every corner but keeps the slots; indices restart at 0.
+		void clear();
+		// Most corners a table can hold without outgrowing bytes of slots.
+		static size_t capacity_for(size_t bytes);
+		size_t size() const { return count; }
+		size_t memory_bytes() const { return slots.size() * sizeof(Slot); }
+		CornerDedupStats stats() const { return { lookups, hits, count, slots.size() }; }
+
+	private:
+		static constexpr uint32_t emptySlot = UINT32_MAX;
+
+		struct Slot {
+			CornerKey key;
+			uint32_t index;
+		};
+
+		std::vector<Slot> slots;
+		size_t mask = 0, count = 0;
+		size_t lookups = 0, hits = 0;
+
+		static size_t hash(const CornerKey& key);
+		void rehash(size_t capacity);
+	};
+}
@@ -0,0 +1,117 @@
+#include "depth_pyramid.h"
+#include "image.h"
+#include "descriptor.h"
+
+uint32_t vkUtil::depth_pyramid_levels(int width, int height)
+{
+	uint32_t size = static_cast<uint32_t>(std::max((width + 1) / 2, (height + 1) / 2));
+	uint32_t levels = 1;
+	while (size > 1) {
+		size /= 2;
+		++levels;
+	}
+	return levels;
+}
+
+void vkUtil::DepthPyramid::create(const DepthPyramidInput& input)
+{
+	device = input.device;
+	sampler = input.sampler;
+	width = static_cast<uint32_t>((input.width + 1) / 2);
+	height = static_cast<uint32_t>((input.height + 1) / 2);
+	levelCount = std::min(depth_pyramid_levels(input.width, input.height), maxDepthPyramidLevels);
+
+	vkImage::ImageCreateInput imageInfo;
+	imageInfo.device = device;
+	imageInfo.physicalDevice = input.physicalDevice;
+	imageInfo.tiling = vk::ImageTiling::eOptimal;
+	imageInfo.usage = vk::ImageUsageFlagBits::eStorage | vk::ImageUsageFlagBits::eSampled;
+	imageInfo.memoryProperties = vk::MemoryPropertyFlagBits::eDeviceLocal;
+	imageInfo.width = static_cast<int>(width);
+	imageInfo.height = static_cast<int>(height);
+	imageInfo.format = vk::Format::eR32Sfloat;
+	imageInfo.allocator = input.allocator;
+	imageInfo.mipLevels = levelCount;
+	image = vkImage::create_image(imageInfo);
+	memory = vkImage::create_image_memory(imageInfo, image);
+	view = vkImage::create_image_view(device, image, vk::Format::eR32Sfloat, vk::ImageAspectFlagBits::eColor, 0, levelCount);
+
+	for (uint32_t level = 0; level < levelCount; ++level) {
+		levelViews.push_back(vkImage::create_image_view(device, image, vk::Format::eR32Sfloat, vk::ImageAspectFlagBits::eColor, level, 1));
+	}
+
+	// level 0 reads the depth buffer, every other the level above it
+	for (uint32_t level = 0; level < levelCount; ++level) {
+		vk::DescriptorSet set = vkInit::allocate_descriptor_set(device, input.descriptorPool, input.setLayout);
+		levelSets.push_back(set);
+
+		vk::DescriptorImageInfo source;
+		source.sampler = sampler;
+		source.imageView = level ? levelViews[level - 1] : input.depthView;
+		source.imageLayout = level ? vk::ImageLayout::eGeneral : vk::ImageLayout::eShaderReadOnlyOptimal;
+
+		vk::DescriptorImageInfo destination;
+		destination.imageView = levelViews[level];
+		destination.imageLayout = vk::ImageLayout::eGeneral;
+
+		std::array<vk::WriteDescriptorSet, 2> writes;
+		writes[0].dstSet = set;
+		writes[0].dstBinding = 0;
+		writes[0].descriptorCount = 1;
+		writes[0].descriptorType = vk::DescriptorType::eCombinedImageSampler;
+		writes[0].pImageInfo = &source;
+		writes[1].dstSet = set;
+		writes[1].dstBinding = 1;
+		writes[1].descriptorCount = 1;
+		writes[1].descriptorType = vk::DescriptorType::eStorageImage;
+		writes[1].pImageInfo = &destination;
+		device.updateDescriptorSets(writes, nullptr);
+	}
+}
+
+void vkUtil::DepthPyramid::record_build(vk::CommandBuffer commandBuffer, vk::Pipeline pipeline, vk::PipelineLayout pipelineLayout)
+{
+	vk::ImageMemoryBarrier barrier;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.image = image;
+
+	// last frame's contents are overwritten, and may still be read by its cull
+	barrier.oldLayout = vk::ImageLayout::eUndefined;
+	barrier.newLayout = vk::ImageLayout::eGeneral;
+	barrier.srcAccessMask = vk::AccessFlagBits::eShaderRead;
+	barrier.dstAccessMask = vk::AccessFlagBits::eShaderWrite;
+	barrier.subresourceRange = vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 0, levelCount, 0, 1);
+	commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eComputeShader,
+		vk::DependencyFlags(), nullptr, nullptr, barrier);
+
+	commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, pipeline);
+	barrier.oldLayout = vk::ImageLayout::eGeneral;
+	barrier.srcAccessMask = vk::AccessFlagBits::eShaderWrite;
+	barrier.dstAccessMask = vk::AccessFlagBits::eShaderRead;
+	uint32_t levelWidth = width, levelHeight = height;
+	for (uint32_t level = 0; level < levelCount; ++level) {
+		commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, pipelineLayout, 0, levelSets[level], nullptr);
+		commandBuffer.dispatch((levelWidth + 7) / 8, (levelHeight + 7) / 8, 1);
+
+		barrier.subresourceRange = vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, level, 1, 0, 1);
+		commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eComputeShader,
+			vk::DependencyFlags(), nullptr, nullptr, barrier);
+
+		levelWidth = std::max(levelWidth / 2, 1u);
+		levelHeight = std::max(levelHeight / 2, 1u);
+	}
+}
+
+void vkUtil::DepthPyramid::destroy()
+{
+	if (!device) return;
+	for (auto levelView : levelViews) device.destroyImageView(levelView);
+	levelViews.clear();
+	// the sets go with their pool
+	levelSets.clear();
+	device.destroyImageView(view);
+	device.destroyImage(image);
+	freeMemory(device, memory);
+	device = nullptr;
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include "config.h"
+#include "allocator.h"
+
+namespace vkUtil {
+	struct DepthPyramidInput {
+		vk::Device device;
+		vk::PhysicalDevice physicalDevice;
+		DeviceAllocator* allocator;
+		// the depth buffer, sampled in eShaderReadOnlyOptimal while building
+		vk::ImageView depthView;
+		int width, height;
+		// nearest, clamped; reads the depth buffer and the pyramid
+		vk::Sampler sampler;
+		// sets of Shaders/depth_pyramid.comp, one per level
+		vk::DescriptorPool descriptorPool;
+		vk::DescriptorSetLayout setLayout;
+	};
+
+	// Farthest-depth mip chain of a depth buffer for occlusion tests. Mip 0
+	// halves the depth buffer rounding up, later mips halve the one above
+	// rounding down as Vulkan sizes them, and the last texel of a row or
+	// column also takes the one an odd size leaves over. So texel t of mip m
+	// covers depth pixels [t, t + 1) * 2^(m + 1), the last ones through the
+	// edge: the depth buffer itself is level 0 and is not copied. Lives in
+	// eGeneral.
+	class DepthPyramid {
+	public:
+		void create(const DepthPyramidInput& input);
+		void destroy();
+
+		// Every mip from the one above it, each finished before the next
+		// reads it, and the last before any later compute shader reads.
+		void record_build(vk::CommandBuffer commandBuffer, vk::Pipeline pipeline, vk::PipelineLayout pipelineLayout);
+
+		// all mips, for sampling
+		vk::ImageView view;
+		vk::Sampler sampler;
+		uint32_t width = 0, height = 0, levelCount = 0;
+
+	private:
+		vk::Device device;
+		vk::Image image;
+		Allocation memory;
+		std::vector<vk::ImageView> levelViews;
+		std::vector<vk::DescriptorSet> levelSets;
+	};
+
+	// Levels a pyramid over a width x height depth buffer has, a full mip
+	// chain of its mip 0; at most 16 up to 65536 pixels a side.
+	uint32_t depth_pyramid_levels(int width, int height);
+	constexpr uint32_t maxDepthPyramidLevels = 16;
+}
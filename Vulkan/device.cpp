@@ -67,6 +67,20 @@ vk::PhysicalDevice vkInit::choose_physical_device(vk::Instance& instance)
 	return nullptr;
 }
 
+vkInit::IndirectDrawSupport vkInit::query_indirect_draw_support(const vk::PhysicalDevice& physicalDevice)
+{
+	vk::PhysicalDeviceVulkan12Features features12;
+	vk::PhysicalDeviceFeatures2 features;
+	features.pNext = &features12;
+	physicalDevice.getFeatures2(&features);
+
+	IndirectDrawSupport support;
+	support.multiDraw = features.features.multiDrawIndirect;
+	support.firstInstance = features.features.drawIndirectFirstInstance;
+	support.drawCount = features12.drawIndirectCount;
+	return support;
+}
+
 vk::Device vkInit::create_logical_device(const vk::PhysicalDevice& physicalDevice, const vk::SurfaceKHR& surface)
 {
 	auto indices = vkUtil::findQueueFamilies(physicalDevice, surface);
@@ -75,6 +89,10 @@ vk::Device vkInit::create_logical_device(const vk::PhysicalDevice& physicalDevic
 	if (indices.graphicsFamily.value() != indices.presentFamily.value()) {
 		uniqueIndices.push_back(indices.presentFamily.value());
 	}
+	if (indices.transferFamily.has_value()
+		&& std::find(uniqueIndices.begin(), uniqueIndices.end(), indices.transferFamily.value()) == uniqueIndices.end()) {
+		uniqueIndices.push_back(indices.transferFamily.value());
+	}
 	float queuePriority = 1.0f;
 	std::vector<vk::DeviceQueueCreateInfo> queueCreateInfo{};
 	for (const auto& queueFamilyIndex : uniqueIndices) {
@@ -89,13 +107,21 @@ vk::Device vkInit::create_logical_device(const vk::PhysicalDevice& physicalDevic
 #endif // !NDEBUG
 
 
+	auto indirect = query_indirect_draw_support(physicalDevice);
 	auto deviceFeatures = vk::PhysicalDeviceFeatures();
+	deviceFeatures.multiDrawIndirect = indirect.multiDraw;
+	deviceFeatures.drawIndirectFirstInstance = indirect.firstInstance;
+	// upload completion is tracked with timeline semaphores (core since 1.2)
+	vk::PhysicalDeviceVulkan12Features features12;
+	features12.timelineSemaphore = VK_TRUE;
+	features12.drawIndirectCount = indirect.drawCount;
 	auto deviceInfo = vk::DeviceCreateInfo(
 		vk::DeviceCreateFlags(),
 		queueCreateInfo.size(), queueCreateInfo.data(),
 		enabledLayers.size(), enabledLayers.data(),
 		deviceExtensions.size(), deviceExtensions.data(), &deviceFeatures
 	);
+	deviceInfo.pNext = &features12;
 
 	try {
 		auto device = physicalDevice.createDevice(deviceInfo);
@@ -113,11 +139,12 @@ vk::Device vkInit::create_logical_device(const vk::PhysicalDevice& physicalDevic
 
 }
 
-std::array<vk::Queue, 2> vkInit::get_queues(const vk::PhysicalDevice& physicalDevice, const vk::Device& device, const vk::SurfaceKHR& surface)
+std::array<vk::Queue, 3> vkInit::get_queues(const vk::PhysicalDevice& physicalDevice, const vk::Device& device, const vk::SurfaceKHR& surface)
 {
 	auto indices = vkUtil::findQueueFamilies(physicalDevice, surface);
 	return
 	{
-		{ device.getQueue(indices.graphicsFamily.value(), 0), device.getQueue(indices.presentFamily.value(), 0) }
+		{ device.getQueue(indices.graphicsFamily.value(), 0), device.getQueue(indices.presentFamily.value(), 0),
+		device.getQueue(indices.uploadFamily(), 0) }
 	};
 }
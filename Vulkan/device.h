@@ -9,8 +9,22 @@ namespace vkInit {
 
 	vk::PhysicalDevice choose_physical_device(vk::Instance& instance);
 
+	// Optional features of indirect drawing; the GPU-driven path needs
+	// firstInstance and does without the others.
+	struct IndirectDrawSupport {
+		// drawCount > 1 in one call
+		bool multiDraw = false;
+		// firstInstance other than 0 in the commands
+		bool firstInstance = false;
+		// drawIndexedIndirectCount, core since 1.2
+		bool drawCount = false;
+	};
+
+	IndirectDrawSupport query_indirect_draw_support(const vk::PhysicalDevice& physicalDevice);
+
+	// Enables the features of query_indirect_draw_support that are there.
 	vk::Device create_logical_device(const vk::PhysicalDevice& physicalDevice, const vk::SurfaceKHR& surface);
 
-	std::array<vk::Queue, 2> get_queues(const vk::PhysicalDevice& physicalDevice, const vk::Device& device, const vk::SurfaceKHR& surface);
+	std::array<vk::Queue, 3> get_queues(const vk::PhysicalDevice& physicalDevice, const vk::Device& device, const vk::SurfaceKHR& surface);
 	
 }
\ No newline at end of file
@@ -10,18 +10,24 @@
 #include "render_structs.h"
 #include "descriptor.h"
 #include "obj_mesh.h"
+#include "mesh_cache.h"
+#include "mesh_optimizer.h"
+#include "mesh_simplifier.h"
 #include "mesh.h"
+#include <filesystem>
 
 
 
-Engine::Engine(const int& width, const int& height, std::shared_ptr<GLFWwindow> window, const bool& debugMode)
-	: width(width), height(height), window(window), debugMode(debugMode)
+Engine::Engine(const int& width, const int& height, std::shared_ptr<GLFWwindow> window, const bool& debugMode, VertexFormat vertexFormat,
+	CullingMode cullingMode)
+	: width(width), height(height), window(window), debugMode(debugMode), vertexFormat(vertexFormat), cullingMode(cullingMode)
 {
 	if (debugMode) { std::cout << "Making a graphic engine\n"; }
 	create_instance();
 	create_device();
 	create_descriptor_set_layouts();
 	create_pipeline();
+	create_culling_pipelines();
 	finalize_setup();
 	create_assets();
 }
@@ -42,18 +48,33 @@ void Engine::create_instance()
 
 enum {
 	eGRAPHICS,
-	ePRESENTING
+	ePRESENTING,
+	eTRANSFER
 };
 
 void Engine::create_device()
 {
 	physicalDevice = vkInit::choose_physical_device(instance);
+	indirectSupport = vkInit::query_indirect_draw_support(physicalDevice);
+	if (cullingMode == CullingMode::GPU && !indirectSupport.firstInstance) {
+		if (debugMode) std::cout << "No drawIndirectFirstInstance, culling on the CPU with software occlusion\n";
+		cullingMode = CullingMode::CPU_OCCLUSION;
+	}
+	else if (cullingMode == CullingMode::GPU && debugMode) {
+		std::cout << "Culling on the GPU, drawing with " << (indirectSupport.drawCount ? "drawIndexedIndirectCount\n"
+			: indirectSupport.multiDraw ? "drawIndexedIndirect\n" : "one drawIndexedIndirect per level\n");
+	}
 	device = vkInit::create_logical_device(physicalDevice, surface);
 	auto queues = vkInit::get_queues(physicalDevice, device, surface);
 	graphicsQueue = queues[eGRAPHICS];
 	presentQueue = queues[ePRESENTING];
+	transferQueue = queues[eTRANSFER];
+	allocator = std::make_unique<vkUtil::DeviceAllocator>(device, physicalDevice);
 
 	create_swapchain();
+	if (cullingMode == CullingMode::CPU_OCCLUSION) {
+		occlusion = std::make_unique<vkUtil::OcclusionRasterizer>(swapchainExtent.width, swapchainExtent.height);
+	}
 
 	frameNumber = 0;
 	// vkInit::query_swapchain_support(physicalDevice, surface, debugMode);
@@ -68,12 +89,16 @@ void Engine::create_swapchain()
 	swapchainExtent = bundle.extent;
 
 	maxFramesInFlight = swapchainFrames.size();
+	frameSerials.assign(maxFramesInFlight, framesSubmitted);
+	imagesInFlight.assign(swapchainFrames.size(), nullptr);
 
 	for (auto& frame : swapchainFrames) {
 		frame.device = device;
 		frame.physicalDevice = physicalDevice;
+		frame.allocator = allocator.get();
 		frame.width = swapchainExtent.width;
 		frame.height = swapchainExtent.height;
+		frame.gpuCulling = cullingMode == CullingMode::GPU;
 
 		frame.create_depth_resources();
 	}
@@ -92,6 +117,7 @@ void Engine::recreate_swapchain()
 	device.waitIdle();
 	cleanup_swapchain();
 	create_swapchain();
+	if (occlusion) occlusion->resize(swapchainExtent.width, swapchainExtent.height);
 	create_framebuffers();
 	create_frame_resources();
 	vkInit::commandBufferInputChunk commandBufferInput = { device, commandPool, swapchainFrames };
@@ -114,6 +140,21 @@ void Engine::create_descriptor_set_layouts()
 	bindings.counts.push_back(1);
 	bindings.stages.push_back(vk::ShaderStageFlagBits::eVertex);
 
+	if (vertexFormat == VertexFormat::COMPACT) {
+		bindings.count = 3;
+		bindings.indices.push_back(2);
+		bindings.types.push_back(vk::DescriptorType::eStorageBuffer);
+		bindings.counts.push_back(1);
+		bindings.stages.push_back(vk::ShaderStageFlagBits::eVertex);
+	}
+
+	// instance -> scene object
+	bindings.count++;
+	bindings.indices.push_back(3);
+	bindings.types.push_back(vk::DescriptorType::eStorageBuffer);
+	bindings.counts.push_back(1);
+	bindings.stages.push_back(vk::ShaderStageFlagBits::eVertex);
+
 	frameSetLayout[PipelineTypes::STANDARD] = vkInit::create_descriptor_set_layout(device, bindings);
 
 	bindings.count = 1;
@@ -132,13 +173,43 @@ void Engine::create_descriptor_set_layouts()
 
 
 	meshSetLayout[PipelineTypes::STANDARD] = vkInit::create_descriptor_set_layout(device, bindings);
+
+	if (cullingMode != CullingMode::GPU) return;
+
+	// Shaders/culling.glsl
+	bindings = vkInit::descriptorSetLayoutData();
+	bindings.count = 10;
+	for (int binding = 0; binding < bindings.count; ++binding) {
+		bindings.indices.push_back(binding);
+		bindings.types.push_back(binding == 7 ? vk::DescriptorType::eCombinedImageSampler
+			: binding == 9 ? vk::DescriptorType::eUniformBuffer : vk::DescriptorType::eStorageBuffer);
+		bindings.counts.push_back(1);
+		bindings.stages.push_back(vk::ShaderStageFlagBits::eCompute);
+	}
+	cullSetLayout = vkInit::create_descriptor_set_layout(device, bindings);
+
+	// Shaders/depth_pyramid.comp: the level above, the level written
+	bindings = vkInit::descriptorSetLayoutData();
+	bindings.count = 2;
+	bindings.indices = { 0, 1 };
+	bindings.types = { vk::DescriptorType::eCombinedImageSampler, vk::DescriptorType::eStorageImage };
+	bindings.counts = { 1, 1 };
+	bindings.stages = { vk::ShaderStageFlagBits::eCompute, vk::ShaderStageFlagBits::eCompute };
+	pyramidSetLayout = vkInit::create_descriptor_set_layout(device, bindings);
 }
 
 void Engine::create_pipeline()
 {
 	vkInit::PipelineBuilder pipelineBuilder(device);
-	pipelineBuilder.specify_vertex_format(vkMesh::getPosColorBindingDescriptions(), vkMesh::getPosColorAttributeDescriptions());
-	pipelineBuilder.specify_vertex_shader("Shaders/vertex.spv");
+	if (vertexFormat == VertexFormat::COMPACT) {
+		pipelineBuilder.specify_vertex_format(vkMesh::getCompactBindingDescriptions(), vkMesh::getCompactAttributeDescriptions());
+		pipelineBuilder.specify_vertex_shader("Shaders/vertex_compact.spv");
+		pipelineBuilder.specify_push_constants(vk::ShaderStageFlagBits::eVertex, sizeof(vkMesh::MeshBounds));
+	}
+	else {
+		pipelineBuilder.specify_vertex_format(vkMesh::getPosColorBindingDescriptions(), vkMesh::getPosColorAttributeDescriptions());
+		pipelineBuilder.specify_vertex_shader("Shaders/vertex.spv");
+	}
 	pipelineBuilder.specify_fragment_shader("Shaders/fragment.spv");
 	pipelineBuilder.specify_swapchain_extent(swapchainExtent);
 	pipelineBuilder.specify_depth_attachment(swapchainFrames[0].depthFormat, 1);
@@ -169,6 +240,58 @@ void Engine::create_pipeline()
 	pipeline = output.pipeline;*/
 }
 
+void Engine::create_culling_pipelines()
+{
+	if (cullingMode != CullingMode::GPU) return;
+
+	vkInit::ComputePipelineInBundle specification;
+	specification.device = device;
+	specification.shaderFilePaths = { "Shaders/cull.spv", "Shaders/draw_commands.spv", "Shaders/scatter.spv" };
+	specification.descriptorSetLayouts = { cullSetLayout };
+	specification.pushConstantSize = sizeof(vkUtil::CullConstants);
+
+	auto output = vkInit::create_compute_pipelines(specification);
+	cullPipelineLayout = output.layout;
+	if (output.pipelines.size() == 3) {
+		cullPipeline = output.pipelines[0];
+		drawCommandsPipeline = output.pipelines[1];
+		scatterPipeline = output.pipelines[2];
+	}
+
+	specification.shaderFilePaths = { "Shaders/depth_pyramid.spv" };
+	specification.descriptorSetLayouts = { pyramidSetLayout };
+	specification.pushConstantSize = 0;
+	output = vkInit::create_compute_pipelines(specification);
+	pyramidPipelineLayout = output.layout;
+	if (output.pipelines.size() == 1) pyramidPipeline = output.pipelines[0];
+
+	// the modules ship in Shaders/, so a missing one is a broken install,
+	// not a device to fall back on
+	if (!cullPipeline || !drawCommandsPipeline || !scatterPipeline || !pyramidPipeline) {
+		throw std::runtime_error("failed to create the culling pipelines!");
+	}
+
+	splitRenderpasses = vkInit::create_split_renderpasses(device, swapchainFormat, swapchainFrames[0].depthFormat);
+
+	// texelFetch only, so nearest and clamped
+	vk::SamplerCreateInfo samplerInfo;
+	samplerInfo.minFilter = vk::Filter::eNearest;
+	samplerInfo.magFilter = vk::Filter::eNearest;
+	samplerInfo.mipmapMode = vk::SamplerMipmapMode::eNearest;
+	samplerInfo.addressModeU = vk::SamplerAddressMode::eClampToEdge;
+	samplerInfo.addressModeV = vk::SamplerAddressMode::eClampToEdge;
+	samplerInfo.addressModeW = vk::SamplerAddressMode::eClampToEdge;
+	samplerInfo.maxLod = static_cast<float>(vkUtil::maxDepthPyramidLevels);
+	try {
+		depthSampler = device.createSampler(samplerInfo);
+	}
+	catch (vk::SystemError err) {
+#ifndef NDEBUG
+		std::cerr << "Failed to create the depth pyramid sampler" << std::endl;
+#endif
+	}
+}
+
 void Engine::finalize_setup()
 {
 	create_framebuffers();
@@ -179,6 +302,13 @@ void Engine::finalize_setup()
 	mainCommandBuffer = vkInit::make_command_buffer(commandBufferInput);
 	vkInit::create_frame_command_buffers(commandBufferInput);
 
+	auto queueFamilies = vkUtil::findQueueFamilies(physicalDevice, surface);
+	transfer = std::make_unique<vkUtil::TransferQueue>(device, transferQueue, queueFamilies.uploadFamily(), queueFamilies.graphicsFamily.value());
+	stagingRing = std::make_unique<vkUtil::StagingRing>(device, physicalDevice, allocator.get(), *transfer, stagingRingSize);
+	if (debugMode) {
+		std::cout << (transfer->dedicated() ? "Uploading on a dedicated transfer queue\n" : "Uploading on the graphics queue\n");
+	}
+
 	create_frame_resources();
 	
 }
@@ -199,9 +329,32 @@ void Engine::create_frame_resources()
 	bindings.count = 2;
 	bindings.types.push_back(vk::DescriptorType::eUniformBuffer);
 	bindings.types.push_back(vk::DescriptorType::eStorageBuffer);
+	if (vertexFormat == VertexFormat::COMPACT) {
+		bindings.count = 3;
+		bindings.types.push_back(vk::DescriptorType::eStorageBuffer);
+	}
+	bindings.count++;
+	bindings.types.push_back(vk::DescriptorType::eStorageBuffer);
 
 	frameDescriptorPool = vkInit::create_descriptor_pool(device, static_cast<uint32_t>(swapchainFrames.size()), bindings);
-	
+
+	if (cullingMode == CullingMode::GPU) {
+		// each binding of Shaders/culling.glsl once a frame
+		bindings = vkInit::descriptorSetLayoutData();
+		bindings.count = 10;
+		for (int binding = 0; binding < bindings.count; ++binding) {
+			bindings.types.push_back(binding == 7 ? vk::DescriptorType::eCombinedImageSampler
+				: binding == 9 ? vk::DescriptorType::eUniformBuffer : vk::DescriptorType::eStorageBuffer);
+		}
+		cullDescriptorPool = vkInit::create_descriptor_pool(device, static_cast<uint32_t>(swapchainFrames.size()), bindings);
+
+		// a set per pyramid level
+		bindings = vkInit::descriptorSetLayoutData();
+		bindings.count = 2;
+		bindings.types = { vk::DescriptorType::eCombinedImageSampler, vk::DescriptorType::eStorageImage };
+		pyramidDescriptorPool = vkInit::create_descriptor_pool(device,
+			vkUtil::maxDepthPyramidLevels * static_cast<uint32_t>(swapchainFrames.size()), bindings);
+	}
 
 	for (auto& frame : swapchainFrames) {
 		frame.inFlight = vkInit::make_fence(device);
@@ -210,30 +363,64 @@ void Engine::create_frame_resources()
 
 		frame.create_descriptor_resources();
 		frame.descriptorSet = vkInit::allocate_descriptor_set(device, frameDescriptorPool, frameSetLayout[PipelineTypes::STANDARD]);
+		if (cullingMode == CullingMode::GPU) {
+			frame.cullDescriptorSet = vkInit::allocate_descriptor_set(device, cullDescriptorPool, cullSetLayout);
+
+			vkUtil::DepthPyramidInput pyramidInput;
+			pyramidInput.device = device;
+			pyramidInput.physicalDevice = physicalDevice;
+			pyramidInput.allocator = allocator.get();
+			pyramidInput.depthView = frame.depthBufferView;
+			pyramidInput.width = frame.width;
+			pyramidInput.height = frame.height;
+			pyramidInput.sampler = depthSampler;
+			pyramidInput.descriptorPool = pyramidDescriptorPool;
+			pyramidInput.setLayout = pyramidSetLayout;
+			frame.depthPyramid.create(pyramidInput);
+		}
+		bind_material_palette(frame);
 	}
 }
 
+void Engine::bind_material_palette(vkUtil::SwapChainFrame& frame)
+{
+	if (!meshes || vertexFormat != VertexFormat::COMPACT) return;
+
+	frame.materialPaletteBufferDescriptor.buffer = meshes->palette_buffer().buffer;
+	frame.materialPaletteBufferDescriptor.offset = 0;
+	frame.materialPaletteBufferDescriptor.range = meshes->palette_bytes();
+}
+
 void Engine::create_assets()
 {
-	meshes = std::make_unique<VertexManagerie>();
+	workers = std::make_unique<vkUtil::WorkerPool>();
+	meshes = std::make_unique<VertexManagerie>(vertexFormat);
 	// Meshes
 	std::unordered_map<meshTypes, std::vector<const char*>> modelFilenames = {
 		{ meshTypes::GROUND, { "Models/ground.obj", "Models/ground.mtl" } },
 		{ meshTypes::GIRL, { "Models/girl.obj", "Models/girl.mtl" } },
 	};
 
-	for (auto& pair : modelFilenames) {
-		vkMesh::ObjMesh model(pair.second[0], pair.second[1], glm::mat4(1.0f));
-		meshes->consume(pair.first, model.vertices, model.indices);
-	}
+	for (auto& pair : modelFilenames) import_mesh(pair.first, pair.second[0], pair.second[1]);
 
 
+	// geometry and textures go up together in one submission
+	vkUtil::UploadBatch uploads(*transfer, *stagingRing);
+
 	FinalizationChunk finalizationInfo;
 	finalizationInfo.device = device;
 	finalizationInfo.physicalDevice = physicalDevice;
-	finalizationInfo.commandBuffer = mainCommandBuffer;
-	finalizationInfo.queue = graphicsQueue;
+	finalizationInfo.uploads = &uploads;
+	finalizationInfo.allocator = allocator.get();
 	meshes->finalize(finalizationInfo);
+	for (auto& frame : swapchainFrames) bind_material_palette(frame);
+	if (debugMode) {
+		auto geometry = meshes->stats();
+		std::cout << "Vertex buffer: " << geometry.vertexBytes << " bytes (" << meshes->unusedVertexBytes << " unused), index buffers: " << geometry.indexBytes << " bytes\n";
+		auto clusters = vkMesh::analyze_meshlets(meshes->all_meshlets());
+		std::cout << "Meshlets: " << clusters.meshletCount << ", " << clusters.averageVertices << " vertices / "
+			<< clusters.averageTriangles << " triangles on average\n";
+	}
 
 	// Materials
 	std::unordered_map<meshTypes, std::string> filenames = {
@@ -241,32 +428,134 @@ void Engine::create_assets()
 		{meshTypes::GIRL, "Textures/none.png"},
 	};
 
+	// room for every mesh type, load_mesh adds the ones loaded later
 	vkInit::descriptorSetLayoutData bindings;
 	bindings.count = 1;
 	bindings.types.push_back(vk::DescriptorType::eCombinedImageSampler);
-	meshDescriptorPool = vkInit::create_descriptor_pool(device, static_cast<uint32_t>(filenames.size()), bindings);
+	meshDescriptorPool = vkInit::create_descriptor_pool(device, static_cast<uint32_t>(meshTypeCount), bindings);
+
+	for (const auto& [object, filename] : filenames) create_material(object, filename.c_str(), uploads);
+
+	// the first frame waits for it on the GPU, nothing blocks here
+	uploads.submit_async();
+	if (debugMode) {
+		auto stats = uploads.stats();
+		std::cout << "Uploads: " << stats.submissions << " submissions, " << stats.bufferCopies << " buffer copies, "
+			<< stats.imageCopies << " image copies, " << stats.barriers << " barriers, "
+			<< stats.stagedBytes << " bytes staged, " << stats.directBytes << " bytes written in place\n";
+		std::cout << "Staging ring: " << stagingRing->bytesStaged << " bytes through " << stagingRing->capacity
+			<< " bytes, waited " << stagingRing->waits << " times\n";
+		std::cout << "Device memory: " << allocator->device_allocation_count() << " allocations\n";
+		for (const auto& pool : allocator->stats()) {
+			std::cout << "\tmemory type " << pool.memoryTypeIndex << (pool.linear ? " (linear)" : " (optimal)") << ": "
+				<< pool.usedBytes << " of " << pool.reservedBytes << " bytes used by " << pool.allocationCount << " allocations in "
+				<< pool.blockCount << " blocks (" << pool.dedicatedBlockCount << " dedicated), largest free range "
+				<< pool.largestFreeRange << " bytes\n";
+		}
+	}
+}
+
+void Engine::import_mesh(meshTypes type, const char* objFilepath, const char* mtlFilepath)
+{
+	vkMesh::MeshImportOptions importOptions;
+	importOptions.optimize.overdraw = true;
+	vkMesh::StreamingOptions streamingOptions;
+	glm::mat4 preTransform = glm::mat4(1.0f);
+
+	std::error_code error;
+	if (std::filesystem::file_size(objFilepath, error) >= streamingOptions.minFileSize && !error) {
+		if (debugMode) std::cout << objFilepath << ": streaming with a " << streamingOptions.memoryBudget << " byte budget\n";
+		// nothing of it stays on the CPU to rasterize, so it never occludes
+		meshes->stream(type, objFilepath, mtlFilepath, preTransform, streamingOptions);
+		if (occlusion) occlusion->clear_occluder(type);
+		return;
+	}
+
+	vkMesh::MeshCache cache(objFilepath, mtlFilepath, preTransform, importOptions);
+	if (cache.is_valid()) {
+		if (debugMode) std::cout << objFilepath << ": loaded from mesh cache\n";
+		meshes->consume(type, cache.vertices(), cache.indices(), cache.lods());
+		if (occlusion) occlusion->set_occluder(type, vkUtil::make_occluder(cache.vertices(), vkMesh::fullVertexFloats, cache.indices(), cache.lods()));
+		return;
+	}
+
+	vkMesh::ObjMesh model(objFilepath, mtlFilepath, preTransform, workers.get());
+	if (debugMode) {
+		auto dedup = model.history.stats();
+		std::cout << objFilepath << ": " << dedup.size << " unique vertices, dedup hit rate "
+			<< dedup.hit_rate() << ", load factor " << dedup.load_factor() << "\n";
+	}
+	auto optimization = vkMesh::optimize_mesh(model, importOptions.optimize);
+	if (debugMode) {
+		std::cout << objFilepath << ": vertex cache ACMR " << optimization.before.acmr << " -> " << optimization.after.acmr
+			<< ", ATVR " << optimization.before.atvr << " -> " << optimization.after.atvr
+			<< ", overfetch " << optimization.fetchBefore.overfetch << " -> " << optimization.fetchAfter.overfetch
+			<< ", overdraw " << optimization.overdrawBefore.overdraw << " -> " << optimization.overdrawAfter.overdraw << "\n";
+	}
+	vkMesh::build_lod_chain(model, importOptions.lods);
+	if (debugMode) {
+		std::cout << objFilepath << ": " << model.lods.size() << " LODs,";
+		for (const auto& lod : model.lods) std::cout << " " << lod.indexCount / 3 << " triangles (error " << lod.error << ")";
+		std::cout << "\n";
+	}
+	vkMesh::MeshCache::write(objFilepath, mtlFilepath, preTransform, importOptions, model);
+	meshes->consume(type, model.vertices, model.indices, model.lods);
+	if (occlusion) occlusion->set_occluder(type, vkUtil::make_occluder(model.vertices, vkMesh::fullVertexFloats, model.indices, model.lods));
+}
 
-	// make a descriptor pool
+void Engine::create_material(meshTypes type, const char* filename, vkUtil::UploadBatch& uploads)
+{
 	vkImage::TextureInput textureInfo;
-	textureInfo.commandBuffer = mainCommandBuffer;
+	textureInfo.uploads = &uploads;
+	textureInfo.allocator = allocator.get();
 	textureInfo.device = device;
-	textureInfo.queue = graphicsQueue;
 	textureInfo.physicalDevice = physicalDevice;
 	textureInfo.layout = meshSetLayout[PipelineTypes::STANDARD]; // TODO: change later!!
 	textureInfo.descriptorPool = meshDescriptorPool; // TODO: change later!!
+	textureInfo.filename = filename;
+	materials[type] = std::make_unique<vkImage::Texture>(textureInfo);
+}
 
-	for (const auto& [object, filename] : filenames) {
-		textureInfo.filename = filename;
-		materials[object] = std::make_unique<vkImage::Texture>(textureInfo);
+void Engine::load_mesh(meshTypes type, const char* objFilepath, const char* mtlFilepath, const char* textureFilepath)
+{
+	unload_mesh(type);
+	import_mesh(type, objFilepath, mtlFilepath);
+
+	vkUtil::UploadBatch uploads(*transfer, *stagingRing);
+	// the draws bind a material for every mesh they find
+	if (!materials.contains(type)) create_material(type, textureFilepath, uploads);
+	FinalizationChunk finalizationInfo;
+	finalizationInfo.device = device;
+	finalizationInfo.physicalDevice = physicalDevice;
+	finalizationInfo.uploads = &uploads;
+	finalizationInfo.allocator = allocator.get();
+	meshes->finalize(finalizationInfo);
+	uploads.submit_async();
+	if (debugMode) {
+		auto geometry = meshes->stats();
+		std::cout << objFilepath << ": loaded, vertex buffer " << geometry.usedVertexBytes << " of " << geometry.vertexBytes
+			<< " bytes used, " << geometry.relocatedBytes << " bytes relocated so far\n";
 	}
 }
 
+void Engine::unload_mesh(meshTypes type)
+{
+	auto handle = meshes->handles.find(type);
+	if (handle != meshes->handles.end()) meshes->remove(handle->second);
+	if (occlusion) occlusion->clear_occluder(type);
+}
+
+void Engine::compact_geometry()
+{
+	vk::DeviceSize moved = meshes->compact();
+	if (debugMode) std::cout << "Compacting geometry: moving " << moved << " bytes\n";
+}
+
 void Engine::prepare_scene(vk::CommandBuffer commandBuffer)
 {
-	auto vertexBuffers = { meshes->vertexBuffer.buffer };
+	auto vertexBuffers = { meshes->vertex_buffer().buffer };
 	vk::DeviceSize offsets[] = {0};
 	commandBuffer.bindVertexBuffers(0, 1, vertexBuffers.begin(), offsets);
-	commandBuffer.bindIndexBuffer(meshes->indexBuffer.buffer, 0, vk::IndexType::eUint32);
 }
 
 void Engine::prepare_frame(uint32_t imageIndex, std::shared_ptr<Scene> scene)
@@ -278,7 +567,8 @@ void Engine::prepare_frame(uint32_t imageIndex, std::shared_ptr<Scene> scene)
 	glm::vec3 up = { 0.0f, 0.0f, 2.0f };
 	glm::mat4 view = glm::lookAt(eye, center, up);
 
-	glm::mat4 projection = glm::perspective(glm::radians(45.0f), static_cast<float>(swapchainExtent.width) / static_cast<float>(swapchainExtent.height), 0.1f, 100.0f);
+	float fovY = glm::radians(45.0f);
+	glm::mat4 projection = glm::perspective(fovY, static_cast<float>(swapchainExtent.width) / static_cast<float>(swapchainExtent.height), 0.1f, 100.0f);
 	projection[1][1] *= -1;
 
 	frame.cameraData.view = view;
@@ -287,36 +577,301 @@ void Engine::prepare_frame(uint32_t imageIndex, std::shared_ptr<Scene> scene)
 
 	memcpy(frame.cameraDataWriteLocation, &(frame.cameraData), sizeof(vkUtil::UBO));
 
-	size_t i = 0;
+	// screen size of one unit at distance 1, for projecting LOD errors
+	float pixelsPerUnit = static_cast<float>(swapchainExtent.height) / (2.0f * std::tan(fovY * 0.5f));
 
-	for (auto& pair : scene->positions) 
-		for (auto& position : pair.second)
-			frame.modelTransforms[i++] = glm::translate(glm::mat4(1.0f), position);
-		
-	
-	memcpy(frame.modelTransformsWriteLocation, frame.modelTransforms.data(), i * sizeof(glm::mat4));
+	// only the matrices of objects that changed are rebuilt, and each frame's
+	// buffer gets every change it has not seen yet
+	auto changed = scene->take_changes();
+	if (scene.get() != transformSource) {
+		transformSource = scene.get();
+		for (auto& each : swapchainFrames) each.allTransformsStale = true;
+	}
+	else if (!changed.empty()) {
+		for (auto& each : swapchainFrames) {
+			if (!each.allTransformsStale) each.staleTransforms.insert(each.staleTransforms.end(), changed.begin(), changed.end());
+		}
+	}
+	if (frame.reserve_instances(scene->size()) && debugMode) {
+		std::cout << "Instance buffers of frame " << imageIndex << " grown to " << frame.instanceCapacity
+			<< " objects, peak " << frame.peakInstances << "\n";
+	}
+	frame.write_transforms(scene->transform_streams(), scene->mesh_types(), workers.get());
 
+	// the palette buffer moves when it grows
+	bind_material_palette(frame);
 	frame.write_descriptor_set();
+
+	if (cullingMode == CullingMode::GPU) {
+		reserve_visibility(scene->size());
+		frame.write_cull_descriptor_set({ objectVisibilityBuffer.buffer, 0, visibilityCapacity * sizeof(uint32_t) });
+		prepare_culling(frame, eye, pixelsPerUnit, scene->size());
+		return;
+	}
+
+	// objects whose bounds are outside the view get no instance at all
+	const auto& types = scene->mesh_types();
+	std::array<const MeshRecord*, meshTypeCount> records;
+	std::array<vkMesh::MeshVolume, meshTypeCount> volumes{};
+	for (size_t t = 0; t < meshTypeCount; ++t) {
+		records[t] = meshes->find(static_cast<meshTypes>(t));
+		if (records[t]) volumes[t] = records[t]->volume;
+	}
+	visibility.resize(types.size());
+	vkUtil::cull_objects(vkUtil::extract_frustum(frame.cameraData.viewProjection), scene->transform_streams(),
+		types, volumes, visibility.data(), workers.get());
+	// then those behind the nearest big ones
+	size_t occluded = 0;
+	if (occlusion) {
+		// objects of meshes that aren't loaded are drawn by nothing and hide nothing
+		for (size_t k = 0; k < types.size(); ++k) {
+			if (!records[static_cast<size_t>(types[k])]) visibility[k] = 0;
+		}
+		occlusion->render(frame.cameraData.viewProjection, eye, scene->transform_streams(), types, volumes, visibility.data(), workers.get());
+		occluded = occlusion->cull_occluded(scene->transform_streams(), types, volumes, visibility.data(), workers.get());
+	}
+
+	// instances are grouped by mesh and level so every level is one
+	// instanced draw; first count them, then lay out the batches
+	std::unordered_map<meshTypes, std::vector<uint32_t>> counts;
+	std::vector<uint32_t> levels(types.size());
+	size_t drawable = 0;
+	for (size_t k = 0; k < types.size(); ++k) {
+		const MeshRecord* record = records[static_cast<size_t>(types[k])];
+		if (record) ++drawable;
+		if (!record || !visibility[k]) {
+			levels[k] = UINT32_MAX;
+			continue;
+		}
+		auto& perLevel = counts[types[k]];
+		if (perLevel.empty()) perLevel.assign(record->lods.size(), 0);
+		levels[k] = vkMesh::select_lod(record->lods, glm::distance(eye, scene->position(static_cast<uint32_t>(k))), pixelsPerUnit);
+		perLevel[levels[k]]++;
+	}
+
+	drawBatches.clear();
+	uint32_t instanceCount = 0;
+	for (auto& [type, perLevel] : counts) {
+		for (uint32_t lod = 0; lod < perLevel.size(); ++lod) {
+			if (perLevel[lod] == 0) continue;
+			drawBatches.push_back({ type, lod, instanceCount, perLevel[lod] });
+			// from here on the next free instance of the batch
+			uint32_t first = instanceCount;
+			instanceCount += perLevel[lod];
+			perLevel[lod] = first;
+		}
+	}
+
+	frame.objectIndices.resize(instanceCount);
+	for (size_t k = 0; k < types.size(); ++k) {
+		if (levels[k] != UINT32_MAX) frame.objectIndices[counts[types[k]][levels[k]]++] = static_cast<uint32_t>(k);
+	}
+	memcpy(frame.objectIndicesWriteLocation, frame.objectIndices.data(), instanceCount * sizeof(uint32_t));
+	cullStats = { instanceCount, drawable - instanceCount - occluded, occluded };
 }
 
-void Engine::render_objects(vk::CommandBuffer commandBuffer, meshTypes objectType, uint32_t& startInstance, uint32_t instanceCount)
+void Engine::prepare_culling(vkUtil::SwapChainFrame& frame, glm::vec3 eye, float pixelsPerUnit, size_t objectCount)
 {
-	int indexCount = meshes->indexCounts.find(objectType)->second;
-	int firstIndex = meshes->firstIndices.find(objectType)->second;
-	materials[objectType]->use(commandBuffer, pipelineLayouts[PipelineTypes::STANDARD]);
-	commandBuffer.drawIndexed(indexCount, instanceCount, firstIndex, 0, startInstance);
-	startInstance += instanceCount;
+	// counted by the last cull recorded on this frame, which has finished:
+	// drawn early, then drawn, culled and occluded late
+	auto counted = static_cast<const uint32_t*>(frame.cullReadbackLocation);
+	cullStats = { counted[0] + counted[1], counted[2], counted[3] };
+
+	// geometry offsets change with growth and compaction, and meshes come
+	// and go; the table is small enough to write every frame
+	auto cullMeshes = static_cast<vkUtil::CullMesh*>(frame.cullMeshesWriteLocation);
+	for (size_t t = 0; t < meshTypeCount; ++t) {
+		vkUtil::CullMesh mesh{};
+		if (const MeshRecord* record = meshes->find(static_cast<meshTypes>(t))) {
+			mesh.sphere = glm::vec4(record->volume.center, record->volume.radius);
+			mesh.extent = glm::vec4(record->volume.extent, 0.0f);
+			mesh.lodCount = static_cast<uint32_t>(std::min<size_t>(record->lods.size(), maxDrawLods));
+			for (uint32_t lod = 0; lod < mesh.lodCount; ++lod) {
+				const auto& level = record->lods[lod];
+				mesh.lods[lod] = { level.indexCount, record->firstIndex + level.firstIndex, record->vertexOffset, level.error };
+			}
+		}
+		cullMeshes[t] = mesh;
+	}
+
+	vkUtil::Frustum frustum = vkUtil::extract_frustum(frame.cameraData.viewProjection);
+	std::copy(std::begin(frustum.planes), std::end(frustum.planes), cullConstants.planes);
+	cullConstants.eye = glm::vec4(eye, pixelsPerUnit);
+	cullConstants.objectCount = static_cast<uint32_t>(objectCount);
+	cullConstants.maxPixelError = 1.0f;
+	cullConstants.depthSize = static_cast<uint32_t>(frame.width) | static_cast<uint32_t>(frame.height) << 16;
 }
 
-void Engine::record_draw_commands(vk::CommandBuffer commandBuffer, uint32_t imageIndex, std::shared_ptr<Scene> scene)
+void Engine::reserve_visibility(size_t count)
 {
-	vk::CommandBufferBeginInfo beginInfo = {};
+	if (count <= visibilityCapacity) return;
 
-	try { commandBuffer.begin(beginInfo); }
-	catch (vk::SystemError err) { if (debugMode) std::cout << "Failed to begin recording command buffer" << std::endl; }
+	// every frame in flight culls against it
+	device.waitIdle();
+	vkUtil::destroyBuffer(device, objectVisibilityBuffer);
+	visibilityCapacity = std::max({ count, 2 * visibilityCapacity, initialInstanceCapacity });
+
+	vkUtil::BufferInput input;
+	input.device = device;
+	input.physicalDevice = physicalDevice;
+	input.memoryProperties = vk::MemoryPropertyFlagBits::eDeviceLocal;
+	input.size = visibilityCapacity * sizeof(uint32_t);
+	input.usage = vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst;
+	input.allocator = allocator.get();
+	objectVisibilityBuffer = vkUtil::createBuffer(input);
+
+	// nothing was visible, so the first late cull draws everything
+	visibilityStale = true;
+}
+
+void Engine::record_culling(vk::CommandBuffer commandBuffer, vkUtil::SwapChainFrame& frame, uint32_t phase)
+{
+	auto computeBarrier = [&](vk::AccessFlags srcAccess, vk::PipelineStageFlags srcStages, vk::AccessFlags dstAccess, vk::PipelineStageFlags dstStages) {
+		vk::MemoryBarrier barrier;
+		barrier.srcAccessMask = srcAccess;
+		barrier.dstAccessMask = dstAccess;
+		commandBuffer.pipelineBarrier(srcStages, dstStages, vk::DependencyFlags(), barrier, nullptr, nullptr);
+	};
+	const auto shaderAccess = vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite;
+	const auto computeStage = vk::PipelineStageFlagBits::eComputeShader;
+	uint32_t objectGroups = (cullConstants.objectCount + 63) / 64;
+
+	// the early draws still read what the late phase rewrites, and the last
+	// frame's late cull wrote the visibility this one reads
+	computeBarrier(vk::AccessFlagBits::eShaderWrite,
+		computeStage | vk::PipelineStageFlagBits::eDrawIndirect | vk::PipelineStageFlagBits::eVertexShader | vk::PipelineStageFlagBits::eTransfer,
+		vk::AccessFlagBits::eTransferWrite | shaderAccess, vk::PipelineStageFlagBits::eTransfer | computeStage);
+	commandBuffer.fillBuffer(frame.cullCountersBuffer.buffer, 0, sizeof(vkUtil::CullCounters), 0);
+	if (visibilityStale) {
+		commandBuffer.fillBuffer(objectVisibilityBuffer.buffer, 0, visibilityCapacity * sizeof(uint32_t), 0);
+		visibilityStale = false;
+	}
+	computeBarrier(vk::AccessFlagBits::eTransferWrite, vk::PipelineStageFlagBits::eTransfer, shaderAccess, computeStage);
+
+	cullConstants.phase = phase;
+	commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, cullPipelineLayout, 0, frame.cullDescriptorSet, nullptr);
+	commandBuffer.pushConstants(cullPipelineLayout, vk::ShaderStageFlagBits::eCompute, 0, sizeof(vkUtil::CullConstants), &cullConstants);
 
+	if (objectGroups) {
+		commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, cullPipeline);
+		commandBuffer.dispatch(objectGroups, 1, 1);
+		computeBarrier(vk::AccessFlagBits::eShaderWrite, computeStage, shaderAccess, computeStage);
+	}
+
+	commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, drawCommandsPipeline);
+	commandBuffer.dispatch(1, 1, 1);
+	computeBarrier(vk::AccessFlagBits::eShaderWrite, computeStage, shaderAccess, computeStage);
+
+	if (objectGroups) {
+		commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, scatterPipeline);
+		commandBuffer.dispatch(objectGroups, 1, 1);
+	}
+	computeBarrier(vk::AccessFlagBits::eShaderWrite, computeStage,
+		vk::AccessFlagBits::eIndirectCommandRead | vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eTransferRead,
+		vk::PipelineStageFlagBits::eDrawIndirect | vk::PipelineStageFlagBits::eVertexShader | vk::PipelineStageFlagBits::eTransfer);
+
+	// for cull_stats once the frame is done: early, visible; late, visible,
+	// culled and occluded
+	vk::BufferCopy region;
+	region.srcOffset = offsetof(vkUtil::CullCounters, visible);
+	region.dstOffset = phase == vkUtil::cullPhaseEarly ? 0 : sizeof(uint32_t);
+	region.size = (phase == vkUtil::cullPhaseEarly ? 1 : 3) * sizeof(uint32_t);
+	commandBuffer.copyBuffer(frame.cullCountersBuffer.buffer, frame.cullReadbackBuffer.buffer, region);
+	// prepare_culling reads it on the host after the frame's fence
+	computeBarrier(vk::AccessFlagBits::eTransferWrite, vk::PipelineStageFlagBits::eTransfer,
+		vk::AccessFlagBits::eHostRead, vk::PipelineStageFlagBits::eHost);
+}
+
+void Engine::record_depth_pyramid(vk::CommandBuffer commandBuffer, vkUtil::SwapChainFrame& frame)
+{
+	vk::ImageMemoryBarrier depthBarrier;
+	depthBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	depthBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	depthBarrier.image = frame.depthBuffer;
+	vk::ImageAspectFlags aspect = vk::ImageAspectFlagBits::eDepth;
+	if (frame.depthFormat == vk::Format::eD24UnormS8Uint) aspect |= vk::ImageAspectFlagBits::eStencil;
+	depthBarrier.subresourceRange = vk::ImageSubresourceRange(aspect, 0, 1, 0, 1);
+
+	// the early pass's depth, sampled by the first level
+	depthBarrier.oldLayout = vk::ImageLayout::eDepthStencilAttachmentOptimal;
+	depthBarrier.newLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
+	depthBarrier.srcAccessMask = vk::AccessFlagBits::eDepthStencilAttachmentWrite;
+	depthBarrier.dstAccessMask = vk::AccessFlagBits::eShaderRead;
+	commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eLateFragmentTests, vk::PipelineStageFlagBits::eComputeShader,
+		vk::DependencyFlags(), nullptr, nullptr, depthBarrier);
+
+	frame.depthPyramid.record_build(commandBuffer, pyramidPipeline, pyramidPipelineLayout);
+
+	// back for the late pass to test and write
+	depthBarrier.oldLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
+	depthBarrier.newLayout = vk::ImageLayout::eDepthStencilAttachmentOptimal;
+	depthBarrier.srcAccessMask = vk::AccessFlags();
+	depthBarrier.dstAccessMask = vk::AccessFlagBits::eDepthStencilAttachmentRead | vk::AccessFlagBits::eDepthStencilAttachmentWrite;
+	commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader,
+		vk::PipelineStageFlagBits::eEarlyFragmentTests | vk::PipelineStageFlagBits::eLateFragmentTests,
+		vk::DependencyFlags(), nullptr, nullptr, depthBarrier);
+
+	// the late pass loads the early pass's color
+	vk::MemoryBarrier colorBarrier;
+	colorBarrier.srcAccessMask = vk::AccessFlagBits::eColorAttachmentWrite;
+	colorBarrier.dstAccessMask = vk::AccessFlagBits::eColorAttachmentRead | vk::AccessFlagBits::eColorAttachmentWrite;
+	commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eColorAttachmentOutput, vk::PipelineStageFlagBits::eColorAttachmentOutput,
+		vk::DependencyFlags(), colorBarrier, nullptr, nullptr);
+}
+
+void Engine::record_indirect_draws(vk::CommandBuffer commandBuffer, vkUtil::SwapChainFrame& frame)
+{
+	// a call per mesh whatever the instance count; its levels of detail are
+	// its draws
+	constexpr uint32_t stride = sizeof(vk::DrawIndexedIndirectCommand);
+	std::optional<vk::IndexType> boundIndexType;
+	for (size_t t = 0; t < meshTypeCount; ++t) {
+		auto type = static_cast<meshTypes>(t);
+		const MeshRecord* mesh = meshes->find(type);
+		if (!mesh) continue;
+
+		if (boundIndexType != mesh->indexType) {
+			commandBuffer.bindIndexBuffer(meshes->index_buffer(mesh->indexType).buffer, 0, mesh->indexType);
+			boundIndexType = mesh->indexType;
+		}
+		materials.at(type)->use(commandBuffer, pipelineLayouts[PipelineTypes::STANDARD]);
+		if (vertexFormat == VertexFormat::COMPACT) {
+			commandBuffer.pushConstants(pipelineLayouts[PipelineTypes::STANDARD], vk::ShaderStageFlagBits::eVertex, 0, sizeof(vkMesh::MeshBounds), &mesh->bounds);
+		}
+
+		uint32_t lodCount = static_cast<uint32_t>(std::min<size_t>(mesh->lods.size(), maxDrawLods));
+		vk::DeviceSize offset = t * maxDrawLods * stride;
+		if (indirectSupport.drawCount) {
+			commandBuffer.drawIndexedIndirectCount(frame.drawCommandsBuffer.buffer, offset, frame.cullCountersBuffer.buffer,
+				offsetof(vkUtil::CullCounters, drawCounts) + t * sizeof(uint32_t), lodCount, stride);
+		}
+		else if (indirectSupport.multiDraw) {
+			// the levels past the mesh's draw count have no instances
+			commandBuffer.drawIndexedIndirect(frame.drawCommandsBuffer.buffer, offset, lodCount, stride);
+		}
+		else {
+			for (uint32_t lod = 0; lod < lodCount; ++lod) {
+				commandBuffer.drawIndexedIndirect(frame.drawCommandsBuffer.buffer, offset + lod * stride, 1, stride);
+			}
+		}
+	}
+}
+
+void Engine::render_objects(vk::CommandBuffer commandBuffer, const vkUtil::DrawBatch& batch)
+{
+	const MeshRecord& mesh = *meshes->find(batch.type);
+	const auto& lod = mesh.lods[batch.lod];
+	materials.at(batch.type)->use(commandBuffer, pipelineLayouts[PipelineTypes::STANDARD]);
+	if (vertexFormat == VertexFormat::COMPACT) {
+		commandBuffer.pushConstants(pipelineLayouts[PipelineTypes::STANDARD], vk::ShaderStageFlagBits::eVertex, 0, sizeof(vkMesh::MeshBounds), &mesh.bounds);
+	}
+	commandBuffer.drawIndexed(lod.indexCount, batch.instanceCount, mesh.firstIndex + lod.firstIndex, mesh.vertexOffset, batch.firstInstance);
+}
+
+void Engine::begin_render_pass(vk::CommandBuffer commandBuffer, vk::RenderPass renderPass, uint32_t imageIndex)
+{
 	vk::RenderPassBeginInfo renderPassInfo = {};
-	renderPassInfo.renderPass = renderPasses[PipelineTypes::STANDARD];
+	renderPassInfo.renderPass = renderPass;
 	renderPassInfo.framebuffer = swapchainFrames[imageIndex].framebuffer;
 	renderPassInfo.renderArea.offset.x = 0;
 	renderPassInfo.renderArea.offset.y = 0;
@@ -336,6 +891,7 @@ void Engine::record_draw_commands(vk::CommandBuffer commandBuffer, uint32_t imag
 	depthClear.depthStencil = vk::ClearDepthStencilValue({ 1.0f, 0 });
 	std::vector<vk::ClearValue> clearValues = { {colorClear, depthClear} };
 
+	// ignored by passes that load
 	renderPassInfo.clearValueCount = clearValues.size();
 	renderPassInfo.pClearValues = clearValues.data();
 
@@ -345,12 +901,50 @@ void Engine::record_draw_commands(vk::CommandBuffer commandBuffer, uint32_t imag
 	commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines[PipelineTypes::STANDARD]);
 
 	prepare_scene(commandBuffer);
+}
+
+void Engine::record_draw_commands(vk::CommandBuffer commandBuffer, uint32_t imageIndex, std::shared_ptr<Scene> scene)
+{
+	vk::CommandBufferBeginInfo beginInfo = {};
+
+	try { commandBuffer.begin(beginInfo); }
+	catch (vk::SystemError err) { if (debugMode) std::cout << "Failed to begin recording command buffer" << std::endl; }
 
-	uint32_t startInstance = 0;
-	for (const auto& pair : scene->positions)
-		render_objects(commandBuffer, pair.first, startInstance, static_cast<uint32_t>(pair.second.size()));
+	// take ownership of whatever finished uploading since the last frame
+	uploadWaitValue = transfer->acquire(commandBuffer);
+	// geometry that grew or was compacted moves before anything draws from it
+	meshes->record_relocations(commandBuffer, framesSubmitted + 1);
+	if (cullingMode == CullingMode::GPU) {
+		// what the last frame saw, then what this frame's depth can't hide
+		auto& frame = swapchainFrames[imageIndex];
+		record_culling(commandBuffer, frame, vkUtil::cullPhaseEarly);
+		begin_render_pass(commandBuffer, splitRenderpasses.first, imageIndex);
+		record_indirect_draws(commandBuffer, frame);
+		commandBuffer.endRenderPass();
+
+		record_depth_pyramid(commandBuffer, frame);
+		record_culling(commandBuffer, frame, vkUtil::cullPhaseLate);
+		begin_render_pass(commandBuffer, splitRenderpasses.second, imageIndex);
+		record_indirect_draws(commandBuffer, frame);
+		commandBuffer.endRenderPass();
+	}
+	else {
+		begin_render_pass(commandBuffer, renderPasses[PipelineTypes::STANDARD], imageIndex);
+
+		// meshes are sorted into a 16-bit and a 32-bit index buffer
+		std::optional<vk::IndexType> boundIndexType;
+		for (const auto& batch : drawBatches) {
+			vk::IndexType indexType = meshes->find(batch.type)->indexType;
+			if (boundIndexType != indexType) {
+				commandBuffer.bindIndexBuffer(meshes->index_buffer(indexType).buffer, 0, indexType);
+				boundIndexType = indexType;
+			}
+			render_objects(commandBuffer, batch);
+		}
+
+		commandBuffer.endRenderPass();
+	}
 
-	commandBuffer.endRenderPass();
 	try {
 		commandBuffer.end();
 	}
@@ -365,6 +959,8 @@ void Engine::cleanup_swapchain()
 
 	device.destroySwapchainKHR(swapchain);
 	device.destroyDescriptorPool(frameDescriptorPool);
+	device.destroyDescriptorPool(cullDescriptorPool);
+	device.destroyDescriptorPool(pyramidDescriptorPool);
 
 }
 
@@ -381,19 +977,35 @@ Engine::~Engine()
 	
 	// delete textures
 	for (auto& [key, texture] : materials) texture = nullptr;
+
+	stagingRing = nullptr;
+	transfer = nullptr;
 	
 	device.destroyCommandPool(commandPool);
 
 	device.destroyRenderPass(renderPasses[PipelineTypes::STANDARD]);
 	device.destroyPipeline(pipelines[PipelineTypes::STANDARD]);
 	device.destroyPipelineLayout(pipelineLayouts[PipelineTypes::STANDARD]);
+	device.destroyPipeline(cullPipeline);
+	device.destroyPipeline(drawCommandsPipeline);
+	device.destroyPipeline(scatterPipeline);
+	device.destroyPipelineLayout(cullPipelineLayout);
+	device.destroyPipeline(pyramidPipeline);
+	device.destroyPipelineLayout(pyramidPipelineLayout);
+	device.destroyRenderPass(splitRenderpasses.first);
+	device.destroyRenderPass(splitRenderpasses.second);
+	device.destroySampler(depthSampler);
 	
 	cleanup_swapchain();
 	
 	device.destroyDescriptorSetLayout(frameSetLayout[PipelineTypes::STANDARD]);
 	device.destroyDescriptorSetLayout(meshSetLayout[PipelineTypes::STANDARD]);
+	device.destroyDescriptorSetLayout(cullSetLayout);
+	device.destroyDescriptorSetLayout(pyramidSetLayout);
+	vkUtil::destroyBuffer(device, objectVisibilityBuffer);
 	
 	device.destroyDescriptorPool(meshDescriptorPool);
+	allocator = nullptr;
 	device.destroy();
 	instance.destroySurfaceKHR(surface);
 	if (debugMode) instance.destroyDebugUtilsMessengerEXT(debugMessager, nullptr, dldi);
@@ -403,6 +1015,8 @@ Engine::~Engine()
 void Engine::render(std::shared_ptr<Scene> scene)
 {
 	device.waitForFences(1, &swapchainFrames[frameNumber].inFlight, VK_TRUE, UINT64_MAX);
+	// the fence covers every submission before it too
+	meshes->collect(frameSerials[frameNumber]);
 
 	try {
 		auto acquiredImage = device.acquireNextImageKHR(swapchain, UINT64_MAX, swapchainFrames[frameNumber].imageAvailable, nullptr);
@@ -414,6 +1028,15 @@ void Engine::render(std::shared_ptr<Scene> scene)
 		return;
 	}
 
+	// the image's frame resources are rewritten below, possibly reallocated;
+	// the last submission that used them may belong to another frame slot
+	if (imagesInFlight[imageIndex] && imagesInFlight[imageIndex] != swapchainFrames[frameNumber].inFlight) {
+		device.waitForFences(1, &imagesInFlight[imageIndex], VK_TRUE, UINT64_MAX);
+	}
+	imagesInFlight[imageIndex] = swapchainFrames[frameNumber].inFlight;
+
+
+	transfer->collect();
 
 	auto commandBuffer = swapchainFrames[frameNumber].commandBuffer;
 	commandBuffer.reset();
@@ -423,9 +1046,15 @@ void Engine::render(std::shared_ptr<Scene> scene)
 	record_draw_commands(commandBuffer, imageIndex, scene);
 
 	vk::SubmitInfo submitInfo = {};
-	vk::Semaphore waitSemaphore[] = { swapchainFrames[frameNumber].imageAvailable };
-	vk::PipelineStageFlags waitStages[] = { vk::PipelineStageFlagBits::eColorAttachmentOutput };
-	submitInfo.waitSemaphoreCount = 1;
+	vk::Semaphore waitSemaphore[] = { swapchainFrames[frameNumber].imageAvailable, transfer->timeline };
+	vk::PipelineStageFlags waitStages[] = { vk::PipelineStageFlagBits::eColorAttachmentOutput, vkUtil::uploadConsumerStages };
+	// the binary semaphore ignores its value
+	uint64_t waitValues[] = { 0, uploadWaitValue };
+	vk::TimelineSemaphoreSubmitInfo timelineInfo;
+	timelineInfo.waitSemaphoreValueCount = uploadWaitValue ? 2 : 1;
+	timelineInfo.pWaitSemaphoreValues = waitValues;
+	submitInfo.pNext = &timelineInfo;
+	submitInfo.waitSemaphoreCount = uploadWaitValue ? 2 : 1;
 	submitInfo.pWaitSemaphores = waitSemaphore;
 	submitInfo.pWaitDstStageMask = waitStages;
 	submitInfo.commandBufferCount = 1;
@@ -436,6 +1065,7 @@ void Engine::render(std::shared_ptr<Scene> scene)
 	device.resetFences(1, &swapchainFrames[frameNumber].inFlight);
 	try {
 		graphicsQueue.submit(submitInfo, swapchainFrames[frameNumber].inFlight);
+		frameSerials[frameNumber] = ++framesSubmitted;
 	}
 	catch (vk::SystemError err) { if (debugMode) std::cerr << "Failed to submit draw command buffer" << std::endl; }
 }
@@ -7,6 +7,15 @@
 #include "scene.h"
 #include "vertex_managerie.h"
 #include "image.h"
+#include "worker_pool.h"
+#include "transfer_queue.h"
+#include "staging_ring.h"
+#include "allocator.h"
+#include "render_structs.h"
+#include "frustum_culling.h"
+#include "occlusion_rasterizer.h"
+#include "device.h"
+#include "pipeline.h"
 
 
 
@@ -14,14 +23,37 @@
 class Engine
 {
 public:
-	Engine(const int& width, const int& height, std::shared_ptr<GLFWwindow> window, const bool& debugMode);
+	Engine(const int& width, const int& height, std::shared_ptr<GLFWwindow> window, const bool& debugMode, VertexFormat vertexFormat = VertexFormat::FULL,
+		CullingMode cullingMode = CullingMode::GPU);
 	~Engine();
 
 	void render(std::shared_ptr<Scene> scene);
 	void present();
+
+	// Runtime geometry. A loaded mesh is drawn from the next frame on, which
+	// waits for its upload on the GPU; an unloaded one stops being drawn at
+	// once and its buffer ranges are reused after the frames in flight. A type
+	// loaded for the first time gets its material from textureFilepath, plain
+	// white by default; a reloaded one keeps the material it has.
+	void load_mesh(meshTypes type, const char* objFilepath, const char* mtlFilepath, const char* textureFilepath = "Textures/none.png");
+	void unload_mesh(meshTypes type);
+	// Defragments the geometry buffers with copies recorded into the next frame.
+	void compact_geometry();
+	// Instances drawn and objects left out by frustum culling in the last
+	// frame; with CullingMode::GPU, in the last frame that finished. GPU and
+	// CPU_OCCLUSION also count the objects occlusion culling hid.
+	vkUtil::CullStats cull_stats() const { return cullStats; }
+	// With CullingMode::CPU_OCCLUSION, what the software occlusion test drew,
+	// rejected and took in the last frame; zero otherwise.
+	vkUtil::OcclusionStats occlusion_stats() const { return occlusion ? occlusion->stats() : vkUtil::OcclusionStats{}; }
 private:
 
 	bool debugMode;
+	VertexFormat vertexFormat;
+	// GPU falls back to CPU_OCCLUSION when the device can't draw indirect
+	// with a firstInstance
+	CullingMode cullingMode;
+	vkInit::IndirectDrawSupport indirectSupport;
 
 	int width{ 1280};
 	int height{ 760 };
@@ -38,6 +70,10 @@ private:
 	vk::Device device;
 	vk::Queue graphicsQueue;
 	vk::Queue presentQueue;
+	// the dedicated transfer queue, or graphicsQueue when the device has none
+	vk::Queue transferQueue;
+	// every buffer and image draws its memory from here
+	std::unique_ptr<vkUtil::DeviceAllocator> allocator;
 
 	vk::SwapchainKHR swapchain;
 	std::vector<vkUtil::SwapChainFrame> swapchainFrames;
@@ -52,11 +88,21 @@ private:
 	vk::CommandPool commandPool;
 	vk::CommandBuffer mainCommandBuffer;
 
+	std::unique_ptr<vkUtil::TransferQueue> transfer;
+	std::unique_ptr<vkUtil::StagingRing> stagingRing;
+	// transfer timeline value the frame being recorded has to wait for
+	uint64_t uploadWaitValue = 0;
+
 	vk::Fence inFlightFence;
 	vk::Semaphore imageAvailable, renderFinished;
 
 	uint32_t maxFramesInFlight, frameNumber;
 	uint32_t imageIndex;
+	// serials of submitted frames, and the last one each frame slot submitted
+	uint64_t framesSubmitted = 0;
+	std::vector<uint64_t> frameSerials;
+	// fence of the frame slot that last rendered to each swapchain image
+	std::vector<vk::Fence> imagesInFlight;
 
 	std::unordered_map<PipelineTypes, vk::DescriptorSetLayout> frameSetLayout;
 	vk::DescriptorPool frameDescriptorPool;
@@ -64,10 +110,42 @@ private:
 	std::unordered_map<PipelineTypes, vk::DescriptorSetLayout> meshSetLayout;
 	vk::DescriptorPool meshDescriptorPool;
 
+	// CullingMode::GPU: cull, draw command and scatter passes
+	vk::DescriptorSetLayout cullSetLayout;
+	vk::DescriptorPool cullDescriptorPool;
+	vk::PipelineLayout cullPipelineLayout;
+	vk::Pipeline cullPipeline, drawCommandsPipeline, scatterPipeline;
+	vkUtil::CullConstants cullConstants;
+	// the frame is drawn in two passes, the depth pyramid built in between
+	vkInit::SplitRenderpasses splitRenderpasses;
+	vk::DescriptorSetLayout pyramidSetLayout;
+	vk::DescriptorPool pyramidDescriptorPool;
+	vk::PipelineLayout pyramidPipelineLayout;
+	vk::Pipeline pyramidPipeline;
+	vk::Sampler depthSampler;
+	// per scene object, whether the last late cull found it visible; one for
+	// all frames, since each frame's early cull draws what the one before saw
+	vkUtil::Buffer objectVisibilityBuffer;
+	size_t visibilityCapacity = 0;
+	// zeroed by the next cull, after growth
+	bool visibilityStale = true;
+
+
+	std::unique_ptr<vkUtil::WorkerPool> workers;
 
 	std::unique_ptr<VertexManagerie> meshes;
 	std::unordered_map<meshTypes, std::unique_ptr<vkImage::Texture>> materials;
 
+	// rebuilt by prepare_frame, consumed by record_draw_commands
+	std::vector<vkUtil::DrawBatch> drawBatches;
+	// the scene the frames' transform buffers were written from
+	const Scene* transformSource = nullptr;
+	// per object, whether it passed frustum culling this frame
+	std::vector<uint8_t> visibility;
+	// CullingMode::CPU_OCCLUSION only
+	std::unique_ptr<vkUtil::OcclusionRasterizer> occlusion;
+	vkUtil::CullStats cullStats{};
+
 	
 	
 	void create_instance();
@@ -76,15 +154,33 @@ private:
 	void recreate_swapchain();
 	void create_descriptor_set_layouts();
 	void create_pipeline();
+	void create_culling_pipelines();
 	void finalize_setup();
 	void create_framebuffers();
 	void create_frame_resources();
 	void create_assets();
+	// queues the mesh on meshes, the next finalize uploads it
+	void import_mesh(meshTypes type, const char* objFilepath, const char* mtlFilepath);
+	// queues the texture on uploads; the descriptor pool holds one per mesh type
+	void create_material(meshTypes type, const char* filename, vkUtil::UploadBatch& uploads);
+	void bind_material_palette(vkUtil::SwapChainFrame& frame);
 	void prepare_scene(vk::CommandBuffer commandBuffer);
 	void prepare_frame(uint32_t imageIndex, std::shared_ptr<Scene> scene);
-
-
-	void render_objects(vk::CommandBuffer commandBuffer, meshTypes objectType, uint32_t& startInstance, uint32_t instanceCount);
+	// writes the frame's CullMesh table and cullConstants for record_culling
+	void prepare_culling(vkUtil::SwapChainFrame& frame, glm::vec3 eye, float pixelsPerUnit, size_t objectCount);
+	// Makes room for count objects in objectVisibilityBuffer, waiting for
+	// the device when it has to grow.
+	void reserve_visibility(size_t count);
+	// one phase, cullPhaseEarly or cullPhaseLate, of the GPU cull
+	void record_culling(vk::CommandBuffer commandBuffer, vkUtil::SwapChainFrame& frame, uint32_t phase);
+	// between the two render passes: the early depth becomes the frame's
+	// depth pyramid, and the attachments are handed back to the late pass
+	void record_depth_pyramid(vk::CommandBuffer commandBuffer, vkUtil::SwapChainFrame& frame);
+	void record_indirect_draws(vk::CommandBuffer commandBuffer, vkUtil::SwapChainFrame& frame);
+
+
+	void render_objects(vk::CommandBuffer commandBuffer, const vkUtil::DrawBatch& batch);
+	void begin_render_pass(vk::CommandBuffer commandBuffer, vk::RenderPass renderPass, uint32_t imageIndex);
 	void record_draw_commands(vk::CommandBuffer commandBUffer, uint32_t imageIndex, std::shared_ptr<Scene> scene);
 	void cleanup_swapchain();
 };
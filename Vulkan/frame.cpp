@@ -1,5 +1,8 @@
 #include "frame.h"
 #include "image.h"
+#include "render_structs.h"
+#include <algorithm>
+#include <cstring>
 
 void vkUtil::SwapChainFrame::create_descriptor_resources()
 {
@@ -9,30 +12,133 @@ void vkUtil::SwapChainFrame::create_descriptor_resources()
 	input.memoryProperties = vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent;
 	input.size = sizeof(UBO);
 	input.usage = vk::BufferUsageFlagBits::eUniformBuffer;
+	input.allocator = allocator;
 	cameraDataBuffer = createBuffer(input);
 
-	cameraDataWriteLocation = device.mapMemory(cameraDataBuffer.bufferMemory, 0, sizeof(UBO));
+	cameraDataWriteLocation = cameraDataBuffer.allocation.mapped;
 
-	input.size = 1024 * sizeof(glm::mat4);
+	cameraDataBufferDescriptor.buffer = cameraDataBuffer.buffer;
+	cameraDataBufferDescriptor.offset = 0;
+	cameraDataBufferDescriptor.range = sizeof(UBO);
+
+	create_instance_buffers(initialInstanceCapacity);
+	if (gpuCulling) create_cull_buffers();
+}
+
+void vkUtil::SwapChainFrame::create_cull_buffers()
+{
+	BufferInput input;
+	input.device = device;
+	input.physicalDevice = physicalDevice;
+	input.memoryProperties = vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent;
+	input.size = meshTypeCount * sizeof(CullMesh);
+	input.usage = vk::BufferUsageFlagBits::eStorageBuffer;
+	input.allocator = allocator;
+	cullMeshesBuffer = createBuffer(input);
+
+	cullMeshesWriteLocation = cullMeshesBuffer.allocation.mapped;
+
+	input.size = 4 * sizeof(uint32_t);
+	input.usage = vk::BufferUsageFlagBits::eTransferDst;
+	cullReadbackBuffer = createBuffer(input);
+
+	cullReadbackLocation = cullReadbackBuffer.allocation.mapped;
+	std::memset(cullReadbackLocation, 0, 4 * sizeof(uint32_t));
+
+	// only the GPU touches these
+	input.memoryProperties = vk::MemoryPropertyFlagBits::eDeviceLocal;
+	input.size = sizeof(CullCounters);
+	input.usage = vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndirectBuffer
+		| vk::BufferUsageFlagBits::eTransferSrc | vk::BufferUsageFlagBits::eTransferDst;
+	cullCountersBuffer = createBuffer(input);
+
+	input.size = meshTypeCount * maxDrawLods * sizeof(vk::DrawIndexedIndirectCommand);
+	input.usage = vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndirectBuffer;
+	drawCommandsBuffer = createBuffer(input);
+}
+
+void vkUtil::SwapChainFrame::create_instance_buffers(size_t capacity)
+{
+	BufferInput input;
+	input.device = device;
+	input.physicalDevice = physicalDevice;
+	input.memoryProperties = vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent;
+	input.size = capacity * sizeof(glm::mat4);
 	input.usage = vk::BufferUsageFlagBits::eStorageBuffer;
+	input.allocator = allocator;
 	modelTransformsBuffer = createBuffer(input);
 
-	modelTransformsWriteLocation = device.mapMemory(modelTransformsBuffer.bufferMemory, 0, 1024 * sizeof(glm::mat4));
+	modelTransformsWriteLocation = modelTransformsBuffer.allocation.mapped;
 
-	modelTransforms.reserve(1024);
+	input.size = capacity * sizeof(uint32_t);
+	if (gpuCulling) {
+		objectTypesBuffer = createBuffer(input);
+		objectTypesWriteLocation = objectTypesBuffer.allocation.mapped;
 
-	for (int i = 0; i < 1024; ++i) {
-		modelTransforms.push_back(glm::mat4(1.0f));
+		// written and read by the GPU alone
+		input.memoryProperties = vk::MemoryPropertyFlagBits::eDeviceLocal;
+		input.size = capacity * 2 * sizeof(uint32_t);
+		objectSlotsBuffer = createBuffer(input);
+		input.size = capacity * sizeof(uint32_t);
 	}
+	objectIndicesBuffer = createBuffer(input);
 
+	objectIndicesWriteLocation = objectIndicesBuffer.allocation.mapped;
 
-	cameraDataBufferDescriptor.buffer = cameraDataBuffer.buffer;
-	cameraDataBufferDescriptor.offset = 0;
-	cameraDataBufferDescriptor.range = sizeof(UBO);
+	instanceCapacity = capacity;
 
 	modelTransformsBufferDescriptor.buffer = modelTransformsBuffer.buffer;
 	modelTransformsBufferDescriptor.offset = 0;
-	modelTransformsBufferDescriptor.range = 1024 * sizeof(glm::mat4);
+	modelTransformsBufferDescriptor.range = capacity * sizeof(glm::mat4);
+
+	objectIndicesBufferDescriptor.buffer = objectIndicesBuffer.buffer;
+	objectIndicesBufferDescriptor.offset = 0;
+	objectIndicesBufferDescriptor.range = capacity * sizeof(uint32_t);
+}
+
+bool vkUtil::SwapChainFrame::reserve_instances(size_t count)
+{
+	peakInstances = std::max(peakInstances, count);
+	if (count <= instanceCapacity) return false;
+
+	// the engine has waited for every submission that used this frame
+	destroyBuffer(device, modelTransformsBuffer);
+	destroyBuffer(device, objectIndicesBuffer);
+	destroyBuffer(device, objectTypesBuffer);
+	destroyBuffer(device, objectSlotsBuffer);
+	create_instance_buffers(std::max(count, 2 * instanceCapacity));
+
+	// the new buffer starts empty
+	allTransformsStale = true;
+	staleTransforms.clear();
+	return true;
+}
+
+void vkUtil::SwapChainFrame::write_transforms(const TransformStreams& objects, std::span<const meshTypes> types, WorkerPool* workers)
+{
+	static_assert(sizeof(meshTypes) == sizeof(uint32_t), "the culling shaders read mesh types as uint");
+	size_t objectCount = types.size();
+	auto destination = static_cast<glm::mat4*>(modelTransformsWriteLocation);
+	auto typeDestination = static_cast<meshTypes*>(objectTypesWriteLocation);
+	if (allTransformsStale) {
+		build_transforms(objects, objectCount, destination, workers);
+		if (gpuCulling) std::memcpy(typeDestination, types.data(), types.size_bytes());
+		allTransformsStale = false;
+		staleTransforms.clear();
+		return;
+	}
+
+	// in address order, each once
+	std::sort(staleTransforms.begin(), staleTransforms.end());
+	staleTransforms.erase(std::unique(staleTransforms.begin(), staleTransforms.end()), staleTransforms.end());
+	// objects removed since they changed are past the end
+	while (!staleTransforms.empty() && staleTransforms.back() >= objectCount) staleTransforms.pop_back();
+
+	build_transforms(objects, staleTransforms, destination, workers);
+	if (gpuCulling) {
+		for (uint32_t object : staleTransforms) typeDestination[object] = types[object];
+	}
+	staleTransforms.clear();
 }
 
 void vkUtil::SwapChainFrame::create_depth_resources()
@@ -42,6 +148,7 @@ void vkUtil::SwapChainFrame::create_depth_resources()
 		{ vk::Format::eD32Sfloat, vk::Format::eD24UnormS8Uint },
 		vk::ImageTiling::eOptimal, 
 		vk::FormatFeatureFlagBits::eDepthStencilAttachment
+		| (gpuCulling ? vk::FormatFeatureFlagBits::eSampledImage : vk::FormatFeatureFlags())
 	);
 
 	vkImage::ImageCreateInput imageInfo;
@@ -49,10 +156,13 @@ void vkUtil::SwapChainFrame::create_depth_resources()
 	imageInfo.physicalDevice = physicalDevice;
 	imageInfo.tiling = vk::ImageTiling::eOptimal;
 	imageInfo.usage = vk::ImageUsageFlagBits::eDepthStencilAttachment;
+	// the depth pyramid reads it
+	if (gpuCulling) imageInfo.usage |= vk::ImageUsageFlagBits::eSampled;
 	imageInfo.memoryProperties = vk::MemoryPropertyFlagBits::eDeviceLocal;
 	imageInfo.width = width;
 	imageInfo.height = height;
 	imageInfo.format = depthFormat;
+	imageInfo.allocator = allocator;
 	depthBuffer = vkImage::create_image(imageInfo);
 	depthBufferMemory = vkImage::create_image_memory(imageInfo, depthBuffer);
 	depthBufferView = vkImage::create_image_view(device, depthBuffer, depthFormat, vk::ImageAspectFlagBits::eDepth);
@@ -84,13 +194,98 @@ void vkUtil::SwapChainFrame::write_descriptor_set()
 	device.updateDescriptorSets(writeInfoModelTransforms, nullptr);
 
 
+	vk::WriteDescriptorSet writeInfoObjectIndices;
+
+	writeInfoObjectIndices.dstSet = descriptorSet;
+	writeInfoObjectIndices.dstBinding = 3;
+	writeInfoObjectIndices.dstArrayElement = 0;
+	writeInfoObjectIndices.descriptorCount = 1;
+	writeInfoObjectIndices.descriptorType = vk::DescriptorType::eStorageBuffer;
+	writeInfoObjectIndices.pBufferInfo = &objectIndicesBufferDescriptor;
+
+	device.updateDescriptorSets(writeInfoObjectIndices, nullptr);
+
+	if (materialPaletteBufferDescriptor.buffer) {
+		vk::WriteDescriptorSet writeInfoMaterialPalette;
+
+		writeInfoMaterialPalette.dstSet = descriptorSet;
+		writeInfoMaterialPalette.dstBinding = 2;
+		writeInfoMaterialPalette.dstArrayElement = 0;
+		writeInfoMaterialPalette.descriptorCount = 1;
+		writeInfoMaterialPalette.descriptorType = vk::DescriptorType::eStorageBuffer;
+		writeInfoMaterialPalette.pBufferInfo = &materialPaletteBufferDescriptor;
+
+		device.updateDescriptorSets(writeInfoMaterialPalette, nullptr);
+	}
+
 }
 
-void vkUtil::SwapChainFrame::destroy() const
+void vkUtil::SwapChainFrame::write_cull_descriptor_set(const vk::DescriptorBufferInfo& visibility)
+{
+	// bindings of Shaders/culling.glsl
+	vk::DescriptorBufferInfo bufferInfos[] = {
+		modelTransformsBufferDescriptor,
+		{ objectTypesBuffer.buffer, 0, instanceCapacity * sizeof(uint32_t) },
+		{ cullMeshesBuffer.buffer, 0, meshTypeCount * sizeof(CullMesh) },
+		{ cullCountersBuffer.buffer, 0, sizeof(CullCounters) },
+		{ objectSlotsBuffer.buffer, 0, instanceCapacity * 2 * sizeof(uint32_t) },
+		{ drawCommandsBuffer.buffer, 0, meshTypeCount * maxDrawLods * sizeof(vk::DrawIndexedIndirectCommand) },
+		objectIndicesBufferDescriptor
+	};
+
+	std::vector<vk::WriteDescriptorSet> writes;
+	for (uint32_t binding = 0; binding < std::size(bufferInfos); ++binding) {
+		vk::WriteDescriptorSet writeInfo;
+		writeInfo.dstSet = cullDescriptorSet;
+		writeInfo.dstBinding = binding;
+		writeInfo.dstArrayElement = 0;
+		writeInfo.descriptorCount = 1;
+		writeInfo.descriptorType = vk::DescriptorType::eStorageBuffer;
+		writeInfo.pBufferInfo = &bufferInfos[binding];
+		writes.push_back(writeInfo);
+	}
+
+	vk::DescriptorImageInfo pyramidInfo;
+	pyramidInfo.sampler = depthPyramid.sampler;
+	pyramidInfo.imageView = depthPyramid.view;
+	pyramidInfo.imageLayout = vk::ImageLayout::eGeneral;
+
+	vk::WriteDescriptorSet writeInfoPyramid;
+	writeInfoPyramid.dstSet = cullDescriptorSet;
+	writeInfoPyramid.dstBinding = 7;
+	writeInfoPyramid.dstArrayElement = 0;
+	writeInfoPyramid.descriptorCount = 1;
+	writeInfoPyramid.descriptorType = vk::DescriptorType::eCombinedImageSampler;
+	writeInfoPyramid.pImageInfo = &pyramidInfo;
+	writes.push_back(writeInfoPyramid);
+
+	vk::WriteDescriptorSet writeInfoVisibility;
+	writeInfoVisibility.dstSet = cullDescriptorSet;
+	writeInfoVisibility.dstBinding = 8;
+	writeInfoVisibility.dstArrayElement = 0;
+	writeInfoVisibility.descriptorCount = 1;
+	writeInfoVisibility.descriptorType = vk::DescriptorType::eStorageBuffer;
+	writeInfoVisibility.pBufferInfo = &visibility;
+	writes.push_back(writeInfoVisibility);
+
+	vk::WriteDescriptorSet writeInfoCameraData;
+	writeInfoCameraData.dstSet = cullDescriptorSet;
+	writeInfoCameraData.dstBinding = 9;
+	writeInfoCameraData.dstArrayElement = 0;
+	writeInfoCameraData.descriptorCount = 1;
+	writeInfoCameraData.descriptorType = vk::DescriptorType::eUniformBuffer;
+	writeInfoCameraData.pBufferInfo = &cameraDataBufferDescriptor;
+	writes.push_back(writeInfoCameraData);
+
+	device.updateDescriptorSets(writes, nullptr);
+}
+
+void vkUtil::SwapChainFrame::destroy()
 {
 	device.destroyImage(depthBuffer);
-	device.freeMemory(depthBufferMemory);
+	freeMemory(device, depthBufferMemory);
 	device.destroyImageView(depthBufferView);
+	depthPyramid.destroy();
 
 
 	device.waitIdle(); 
@@ -100,11 +295,13 @@ void vkUtil::SwapChainFrame::destroy() const
 	device.destroyImageView(imageView);
 	device.destroyFramebuffer(framebuffer);
 
-	device.unmapMemory(cameraDataBuffer.bufferMemory);
-	device.freeMemory(cameraDataBuffer.bufferMemory);
-	device.destroyBuffer(cameraDataBuffer.buffer);
-
-	device.unmapMemory(modelTransformsBuffer.bufferMemory);
-	device.freeMemory(modelTransformsBuffer.bufferMemory);
-	device.destroyBuffer(modelTransformsBuffer.buffer);
+	destroyBuffer(device, cameraDataBuffer);
+	destroyBuffer(device, modelTransformsBuffer);
+	destroyBuffer(device, objectIndicesBuffer);
+	destroyBuffer(device, objectTypesBuffer);
+	destroyBuffer(device, objectSlotsBuffer);
+	destroyBuffer(device, cullMeshesBuffer);
+	destroyBuffer(device, cullCountersBuffer);
+	destroyBuffer(device, drawCommandsBuffer);
+	destroyBuffer(device, cullReadbackBuffer);
 }
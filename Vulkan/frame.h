@@ -2,6 +2,8 @@
 #include "config.h"
 
 #include "memory.h"
+#include "transform_kernel.h"
+#include "depth_pyramid.h"
 
 namespace vkUtil {
 	struct UBO {
@@ -14,12 +16,13 @@ namespace vkUtil {
 	public:
 		vk::Device device;
 		vk::PhysicalDevice physicalDevice;
+		DeviceAllocator* allocator;
 		// swapchain
 		vk::Image image;
 		vk::ImageView imageView;
 		vk::Framebuffer framebuffer;
 		vk::Image depthBuffer;
-		vk::DeviceMemory depthBufferMemory;
+		Allocation depthBufferMemory;
 		vk::ImageView depthBufferView;
 		vk::Format depthFormat;
 		int width, height;
@@ -35,23 +38,74 @@ namespace vkUtil {
 		Buffer cameraDataBuffer;
 		void* cameraDataWriteLocation;
 
-		std::vector<glm::mat4> modelTransforms;
+		// indexed by scene object; only changed entries are rewritten
 		Buffer modelTransformsBuffer;
 		void* modelTransformsWriteLocation;
+		// objects changed since this frame's transforms were last written
+		std::vector<uint32_t> staleTransforms;
+		bool allTransformsStale = true;
 
+		// the scene object each instance draws, in draw batch order; written
+		// by the culling passes and not mapped when gpuCulling is set
+		std::vector<uint32_t> objectIndices;
+		Buffer objectIndicesBuffer;
+		void* objectIndicesWriteLocation;
+
+		// CullingMode::GPU; the buffers below exist only then
+		bool gpuCulling = false;
+		// mesh type of each scene object, rewritten with its transform
+		Buffer objectTypesBuffer;
+		void* objectTypesWriteLocation;
+		// each object's slot and place in it, between the culling passes
+		Buffer objectSlotsBuffer;
+		// a CullMesh per mesh type, rewritten every frame
+		Buffer cullMeshesBuffer;
+		void* cullMeshesWriteLocation;
+		// CullCounters, and the draw commands they lay out
+		Buffer cullCountersBuffer;
+		Buffer drawCommandsBuffer;
+		// visible early, then visible, culled and occluded late, of the last
+		// cull recorded on this frame
+		Buffer cullReadbackBuffer;
+		void* cullReadbackLocation;
+		// of this frame's early depth, read by its late cull; created by the
+		// engine, which owns the pipeline and the sets' pool
+		DepthPyramid depthPyramid;
 
 		vk::DescriptorBufferInfo cameraDataBufferDescriptor;
 		vk::DescriptorBufferInfo modelTransformsBufferDescriptor;
+		vk::DescriptorBufferInfo objectIndicesBufferDescriptor;
+		// set by the engine when meshes use VertexFormat::COMPACT
+		vk::DescriptorBufferInfo materialPaletteBufferDescriptor;
 
 		vk::DescriptorSet descriptorSet;
-		
+		vk::DescriptorSet cullDescriptorSet;
+
 
 		void create_descriptor_resources();
 
+		// Makes room for count objects and instances; the buffers grow
+		// geometrically and are replaced, so no submission may still use
+		// them. Returns whether they were. write_descriptor_set rebinds them.
+		bool reserve_instances(size_t count);
+		size_t instanceCapacity = 0, peakInstances = 0;
+
+		// Builds the matrices of the stale objects straight into the mapped
+		// buffer, all types.size() of them after a full invalidation, and
+		// forgets them. With gpuCulling their mesh types are written too.
+		void write_transforms(const TransformStreams& objects, std::span<const meshTypes> types, WorkerPool* workers);
+
 		void create_depth_resources();
 
 		void write_descriptor_set();
+		// visibility is the engine's per-object visibility buffer, shared by
+		// every frame since each frame's late cull feeds the next frame
+		void write_cull_descriptor_set(const vk::DescriptorBufferInfo& visibility);
+
+		void destroy();
 
-		void destroy() const;
+	private:
+		void create_instance_buffers(size_t capacity);
+		void create_cull_buffers();
 	};
 }
\ No newline at end of file
@@ -0,0 +1,133 @@
+#include "frustum_culling.h"
+#include "simd_lanes.h"
+#include <cmath>
+
+namespace {
+	using namespace vkUtil::lanes;
+
+	bool visible_one(const vkUtil::Frustum& frustum, const vkUtil::TransformStreams& objects, size_t object, const vkMesh::MeshVolume& volume)
+	{
+		float sx = objects.scale[0][object], sy = objects.scale[1][object], sz = objects.scale[2][object];
+		auto basis = rotation_scale(
+			objects.rotation[0][object], objects.rotation[1][object], objects.rotation[2][object], objects.rotation[3][object],
+			sx, sy, sz);
+
+		glm::vec3 center;
+		for (int row = 0; row < 3; ++row) {
+			center[row] = objects.position[row][object]
+				+ basis.m[0][row] * volume.center.x + basis.m[1][row] * volume.center.y + basis.m[2][row] * volume.center.z;
+		}
+		float sphereRadius = volume.radius * std::max({ std::abs(sx), std::abs(sy), std::abs(sz) });
+
+		for (const auto& plane : frustum.planes) {
+			float distance = plane.x * center.x + plane.y * center.y + plane.z * center.z + plane.w;
+			// the box's extent along the plane normal
+			float boxRadius = 0.0f;
+			for (int axis = 0; axis < 3; ++axis) {
+				float along = plane.x * basis.m[axis][0] + plane.y * basis.m[axis][1] + plane.z * basis.m[axis][2];
+				boxRadius += std::abs(along) * volume.extent[axis];
+			}
+			if (distance < -std::min(boxRadius, sphereRadius)) return false;
+		}
+		return true;
+	}
+
+	size_t cull_range(const vkUtil::Frustum& frustum, const vkUtil::TransformStreams& objects, const meshTypes* types,
+		const vkMesh::MeshVolume* volumes, size_t first, size_t count, uint8_t* visible)
+	{
+		size_t end = first + count;
+		size_t object = first;
+		size_t visibleCount = 0;
+#ifdef SIMD_LANES_X64
+		const __m128 signBits = _mm_set1_ps(-0.0f);
+		auto abs = [&](__m128 value) { return _mm_andnot_ps(signBits, value); };
+		for (; object + 4 <= end; object += 4) {
+			auto load = [&](const float* stream) { return _mm_loadu_ps(stream + object); };
+			__m128 sx = load(objects.scale[0]), sy = load(objects.scale[1]), sz = load(objects.scale[2]);
+			auto basis = rotation_scale(load(objects.rotation[0]), load(objects.rotation[1]), load(objects.rotation[2]), load(objects.rotation[3]), sx, sy, sz);
+
+			const vkMesh::MeshVolume* lanes[4];
+			for (int lane = 0; lane < 4; ++lane) lanes[lane] = &volumes[static_cast<size_t>(types[object + lane])];
+			auto gather = [&](auto member) {
+				return _mm_setr_ps(member(*lanes[0]), member(*lanes[1]), member(*lanes[2]), member(*lanes[3]));
+			};
+			__m128 center[3], extent[3];
+			for (int axis = 0; axis < 3; ++axis) {
+				center[axis] = gather([axis](const vkMesh::MeshVolume& volume) { return volume.center[axis]; });
+				extent[axis] = gather([axis](const vkMesh::MeshVolume& volume) { return volume.extent[axis]; });
+			}
+			__m128 radius = gather([](const vkMesh::MeshVolume& volume) { return volume.radius; });
+
+			__m128 world[3];
+			for (int row = 0; row < 3; ++row) {
+				world[row] = add(load(objects.position[row]), add(mul(basis.m[0][row], center[0]),
+					add(mul(basis.m[1][row], center[1]), mul(basis.m[2][row], center[2]))));
+			}
+			__m128 sphereRadius = mul(radius, _mm_max_ps(abs(sx), _mm_max_ps(abs(sy), abs(sz))));
+
+			__m128 outside = _mm_setzero_ps();
+			for (const auto& plane : frustum.planes) {
+				__m128 nx = _mm_set1_ps(plane.x), ny = _mm_set1_ps(plane.y), nz = _mm_set1_ps(plane.z);
+				__m128 distance = add(add(mul(nx, world[0]), mul(ny, world[1])), add(mul(nz, world[2]), _mm_set1_ps(plane.w)));
+				__m128 boxRadius = _mm_setzero_ps();
+				for (int axis = 0; axis < 3; ++axis) {
+					__m128 along = add(mul(nx, basis.m[axis][0]), add(mul(ny, basis.m[axis][1]), mul(nz, basis.m[axis][2])));
+					boxRadius = add(boxRadius, mul(abs(along), extent[axis]));
+				}
+				__m128 reach = _mm_min_ps(boxRadius, sphereRadius);
+				outside = _mm_or_ps(outside, _mm_cmplt_ps(distance, _mm_sub_ps(_mm_setzero_ps(), reach)));
+			}
+
+			int culled = _mm_movemask_ps(outside);
+			for (int lane = 0; lane < 4; ++lane) {
+				visible[object + lane] = (culled >> lane) & 1 ? 0 : 1;
+				visibleCount += visible[object + lane];
+			}
+		}
+#endif
+		for (; object < end; ++object) {
+			visible[object] = visible_one(frustum, objects, object, volumes[static_cast<size_t>(types[object])]) ? 1 : 0;
+			visibleCount += visible[object];
+		}
+		return visibleCount;
+	}
+}
+
+vkUtil::Frustum vkUtil::extract_frustum(const glm::mat4& viewProjection)
+{
+	// rows of the matrix; glm indexes [column][row]
+	glm::vec4 rows[4];
+	for (int row = 0; row < 4; ++row) {
+		rows[row] = glm::vec4(viewProjection[0][row], viewProjection[1][row], viewProjection[2][row], viewProjection[3][row]);
+	}
+
+	Frustum frustum;
+	frustum.planes[0] = rows[3] + rows[0];
+	frustum.planes[1] = rows[3] - rows[0];
+	frustum.planes[2] = rows[3] + rows[1];
+	frustum.planes[3] = rows[3] - rows[1];
+	frustum.planes[4] = rows[2];
+	frustum.planes[5] = rows[3] - rows[2];
+	for (auto& plane : frustum.planes) plane = plane / glm::length(glm::vec3(plane));
+	return frustum;
+}
+
+size_t vkUtil::cull_objects(const Frustum& frustum, const TransformStreams& objects, std::span<const meshTypes> types,
+	std::span<const vkMesh::MeshVolume, meshTypeCount> volumes, uint8_t* visible, WorkerPool* workers)
+{
+	size_t count = types.size();
+	if (!workers || count <= transformJobSize) {
+		return cull_range(frustum, objects, types.data(), volumes.data(), 0, count, visible);
+	}
+
+	size_t jobCount = (count + transformJobSize - 1) / transformJobSize;
+	std::vector<size_t> visibleCounts(jobCount);
+	workers->parallel_for(jobCount, [&](size_t job) {
+		size_t first = job * transformJobSize;
+		visibleCounts[job] = cull_range(frustum, objects, types.data(), volumes.data(), first, std::min(transformJobSize, count - first), visible);
+	});
+
+	size_t visibleCount = 0;
+	for (size_t jobVisible : visibleCounts) visibleCount += jobVisible;
+	return visibleCount;
+}
@@ -0,0 +1,34 @@
+#pragma once
+#include "config.h"
+#include "transform_kernel.h"
+#include "meshlet.h"
+#include <span>
+
+namespace vkUtil {
+	// Points p with dot(plane.xyz, p) + plane.w >= 0 are inside every plane;
+	// the normals are unit length, so that is a distance.
+	struct Frustum {
+		glm::vec4 planes[6];
+	};
+
+	// Left, right, bottom, top, near and far of a view-projection matrix,
+	// for Vulkan's 0..1 clip depth.
+	Frustum extract_frustum(const glm::mat4& viewProjection);
+
+	struct CullStats {
+		size_t visible, culled;
+		// in the frustum but hidden by occlusion culling: behind the depth
+		// pyramid with GPU culling, behind the CPU depth buffer with
+		// CPU_OCCLUSION; 0 with plain CPU culling
+		size_t occluded = 0;
+	};
+
+	// Sets visible[i] to whether object i can be in view: its mesh's volume,
+	// volumes[types[i]], placed by the object's transform, is not entirely
+	// behind one of the planes. Both the box and the sphere of the volume are
+	// tested and the tighter one decides, 4 objects at a time with SSE, split
+	// into jobs of transformJobSize objects across workers. Returns how many
+	// are visible.
+	size_t cull_objects(const Frustum& frustum, const TransformStreams& objects, std::span<const meshTypes> types,
+		std::span<const vkMesh::MeshVolume, meshTypeCount> volumes, uint8_t* visible, WorkerPool* workers);
+}
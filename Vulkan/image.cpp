@@ -4,11 +4,10 @@
 #include <stb_image.h>
 #include "memory.h"
 #include "descriptor.h"
-#include "single_time_commands.h"
 
 vkImage::Texture::Texture(TextureInput input)
 	: device(input.device), physicalDevice(input.physicalDevice), filename(input.filename),
-	commandBuffer(input.commandBuffer), queue(input.queue), layout(input.layout), descriptorPool(input.descriptorPool)
+	uploads(input.uploads), allocator(input.allocator), layout(input.layout), descriptorPool(input.descriptorPool)
 {
 	load();
 
@@ -21,6 +20,7 @@ vkImage::Texture::Texture(TextureInput input)
 	imageInput.usage = vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled;
 	imageInput.memoryProperties = vk::MemoryPropertyFlagBits::eDeviceLocal;
 	imageInput.format = vk::Format::eR8G8B8A8Unorm;
+	imageInput.allocator = allocator;
 
 	image = create_image(imageInput);
 	imageMemory = create_image_memory(imageInput, image);
@@ -45,8 +45,8 @@ void vkImage::Texture::use(vk::CommandBuffer commandBuffer, vk::PipelineLayout p
 
 vkImage::Texture::~Texture()
 {
-	device.freeMemory(imageMemory);
 	device.destroyImage(image);
+	vkUtil::freeMemory(device, imageMemory);
 	device.destroyImageView(imageView);
 	device.destroySampler(sampler);
 	
@@ -64,44 +64,19 @@ void vkImage::Texture::load()
 
 void vkImage::Texture::populate()
 {
-	vkUtil::BufferInput input;
-	input.device = device;
-	input.physicalDevice = physicalDevice;
-	input.memoryProperties = vk::MemoryPropertyFlagBits::eHostCoherent | vk::MemoryPropertyFlagBits::eHostVisible;
-	input.usage = vk::BufferUsageFlagBits::eTransferSrc;
-	input.size = width * height * 4;
-
-	auto stagingBuffer = vkUtil::createBuffer(input);
-
-	auto writeLocation = device.mapMemory(stagingBuffer.bufferMemory, 0, input.size);
-	memcpy(writeLocation, pixels, input.size);
-	device.unmapMemory(stagingBuffer.bufferMemory);
-
 	ImageLayoutTransitionInput transitionInput;
-	transitionInput.commandBuffer = commandBuffer;
-	transitionInput.queue = queue;
+	transitionInput.uploads = uploads;
 	transitionInput.image = image;
 	transitionInput.oldlayout = vk::ImageLayout::eUndefined;
 	transitionInput.newlayout = vk::ImageLayout::eTransferDstOptimal;
 	transition_image_layout(transitionInput);
 
-	BufferImageCopyInput copyInput;
-	copyInput.commandBuffer = commandBuffer;
-	copyInput.queue = queue;
-	copyInput.srcBuffer = stagingBuffer.buffer;
-	copyInput.dstImage = image;
-	copyInput.width = width;
-	copyInput.height = height;
-	copy_buffer_to_image(copyInput);
+	// staged in the shared ring, pixels can be freed right after
+	uploads->write_image(pixels, width, height, 4, image);
 
 	transitionInput.oldlayout = vk::ImageLayout::eTransferDstOptimal;
 	transitionInput.newlayout = vk::ImageLayout::eShaderReadOnlyOptimal;
 	transition_image_layout(transitionInput);
-
-
-	device.freeMemory(stagingBuffer.bufferMemory);
-	device.destroyBuffer(stagingBuffer.buffer);
-	
 }
 
 void vkImage::Texture::create_view()
@@ -165,7 +140,7 @@ vk::Image vkImage::create_image(ImageCreateInput input)
 	imageInfo.flags = vk::ImageCreateFlagBits();
 	imageInfo.imageType = vk::ImageType::e2D;
 	imageInfo.extent = vk::Extent3D(input.width, input.height, 1);
-	imageInfo.mipLevels = 1;
+	imageInfo.mipLevels = input.mipLevels;
 	imageInfo.arrayLayers = 1;
 	imageInfo.format = input.format;
 	imageInfo.tiling = input.tiling;
@@ -184,17 +159,24 @@ vk::Image vkImage::create_image(ImageCreateInput input)
 	}
 }
 
-vk::DeviceMemory vkImage::create_image_memory(ImageCreateInput input, vk::Image image)
+vkUtil::Allocation vkImage::create_image_memory(ImageCreateInput input, vk::Image image)
 {
 	auto requirements = input.device.getImageMemoryRequirements(image);
-
-	vk::MemoryAllocateInfo allocation;
-	allocation.allocationSize = requirements.size;
-	allocation.memoryTypeIndex = vkUtil::findMemoryTypeIndex(input.physicalDevice, requirements.memoryTypeBits, input.memoryProperties);
+	bool linear = input.tiling == vk::ImageTiling::eLinear;
 
 	try {
-		vk::DeviceMemory imageMemory = input.device.allocateMemory(allocation);
-		input.device.bindImageMemory(image, imageMemory, 0);
+		vkUtil::Allocation imageMemory;
+		if (input.allocator) {
+			imageMemory = input.allocator->allocate(requirements, input.memoryProperties, linear);
+		}
+		else {
+			vk::MemoryAllocateInfo allocation;
+			allocation.allocationSize = requirements.size;
+			allocation.memoryTypeIndex = vkUtil::findMemoryTypeIndex(input.physicalDevice, requirements.memoryTypeBits, input.memoryProperties);
+			imageMemory.memory = input.device.allocateMemory(allocation);
+			imageMemory.size = requirements.size;
+		}
+		input.device.bindImageMemory(image, imageMemory.memory, imageMemory.offset);
 		return imageMemory;
 	}
 	catch (vk::SystemError err) {
@@ -203,56 +185,16 @@ vk::DeviceMemory vkImage::create_image_memory(ImageCreateInput input, vk::Image
 #endif
 	}
 
-	
+	return vkUtil::Allocation();
 }
 
 void vkImage::transition_image_layout(ImageLayoutTransitionInput input)
 {
-	vkUtil::start_job(input.commandBuffer);
-	vk::ImageSubresourceRange access;
-	access.aspectMask = vk::ImageAspectFlagBits::eColor;
-	access.baseMipLevel = 0;
-	access.levelCount = 1;
-	access.baseArrayLayer = 0;
-	access.layerCount = 1;
-
-	vk::ImageMemoryBarrier barrier;
-	barrier.oldLayout = input.oldlayout;
-	barrier.newLayout = input.newlayout;
-	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-	barrier.image = input.image;
-	barrier.subresourceRange = access;
-
-	vk::PipelineStageFlags srcStage, dstStage;
-
-	if (input.oldlayout == vk::ImageLayout::eUndefined
-		&& input.newlayout == vk::ImageLayout::eTransferDstOptimal) {
-
-		barrier.srcAccessMask = vk::AccessFlagBits::eNoneKHR;
-		barrier.dstAccessMask = vk::AccessFlagBits::eTransferWrite;
-
-		srcStage = vk::PipelineStageFlagBits::eTopOfPipe;
-		dstStage = vk::PipelineStageFlagBits::eTransfer;
-	}
-	else {
-
-		barrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
-		barrier.dstAccessMask = vk::AccessFlagBits::eShaderRead;
-
-		srcStage = vk::PipelineStageFlagBits::eTransfer;
-		dstStage = vk::PipelineStageFlagBits::eFragmentShader;
-	}
-
-	input.commandBuffer.pipelineBarrier(srcStage, dstStage, vk::DependencyFlags(), nullptr, nullptr, barrier);
-
-	vkUtil::end_job(input.commandBuffer, input.queue);
+	input.uploads->transition_image(input.image, input.oldlayout, input.newlayout);
 }
 
 void vkImage::copy_buffer_to_image(BufferImageCopyInput input)
 {
-	vkUtil::start_job(input.commandBuffer);
-
 	vk::BufferImageCopy copy;
 	copy.bufferOffset = 0;
 	copy.bufferRowLength = 0;
@@ -268,13 +210,11 @@ void vkImage::copy_buffer_to_image(BufferImageCopyInput input)
 	copy.imageOffset = vk::Offset3D(0, 0, 0);
 	copy.imageExtent = vk::Extent3D(input.width, input.height, 1.0f);
 
-	input.commandBuffer.copyBufferToImage(input.srcBuffer, input.dstImage, vk::ImageLayout::eTransferDstOptimal, copy);
-
-	vkUtil::end_job(input.commandBuffer, input.queue);
-
+	input.uploads->copy_buffer_to_image(input.srcBuffer, input.dstImage, copy);
 }
 
-vk::ImageView vkImage::create_image_view(vk::Device device, vk::Image image, vk::Format format, vk::ImageAspectFlags aspect)
+vk::ImageView vkImage::create_image_view(vk::Device device, vk::Image image, vk::Format format, vk::ImageAspectFlags aspect,
+	uint32_t baseMip, uint32_t mipCount)
 {
 	vk::ImageViewCreateInfo createInfo{};
 	createInfo.image = image;
@@ -285,8 +225,8 @@ vk::ImageView vkImage::create_image_view(vk::Device device, vk::Image image, vk:
 	createInfo.components.b = vk::ComponentSwizzle::eIdentity;
 	createInfo.components.a = vk::ComponentSwizzle::eIdentity;
 	createInfo.subresourceRange.aspectMask = aspect;
-	createInfo.subresourceRange.baseMipLevel = 0;
-	createInfo.subresourceRange.levelCount = 1;
+	createInfo.subresourceRange.baseMipLevel = baseMip;
+	createInfo.subresourceRange.levelCount = mipCount;
 	createInfo.subresourceRange.baseArrayLayer = 0;
 	createInfo.subresourceRange.layerCount = 1;
 	
@@ -1,5 +1,7 @@
 #pragma once
 #include "config.h"
+#include "upload_batch.h"
+#include "allocator.h"
 #include <stb_image.h>
 
 namespace vkImage {
@@ -7,8 +9,9 @@ namespace vkImage {
 		vk::Device device;
 		vk::PhysicalDevice physicalDevice;
 		std::string filename;
-		vk::CommandBuffer commandBuffer;
-		vk::Queue queue;
+		// the pixel upload is added here, the texture is usable once it is submitted
+		vkUtil::UploadBatch* uploads;
+		vkUtil::DeviceAllocator* allocator;
 
 		vk::DescriptorSetLayout layout;
 		vk::DescriptorPool descriptorPool;
@@ -23,18 +26,19 @@ namespace vkImage {
 		vk::MemoryPropertyFlags memoryProperties;
 		vk::ImageTiling tiling;
 		vk::Format format;
+		// sub-allocates when set, otherwise the image gets memory of its own
+		vkUtil::DeviceAllocator* allocator = nullptr;
+		uint32_t mipLevels = 1;
 	};
 
 	struct ImageLayoutTransitionInput {
-		vk::CommandBuffer commandBuffer;
-		vk::Queue queue;
+		vkUtil::UploadBatch* uploads;
 		vk::Image image;
 		vk::ImageLayout oldlayout, newlayout;
 	};
 
 	struct BufferImageCopyInput {
-		vk::CommandBuffer commandBuffer;
-		vk::Queue queue;
+		vkUtil::UploadBatch* uploads;
 		vk::Buffer srcBuffer;
 		vk::Image dstImage;
 		int width, height;
@@ -57,7 +61,7 @@ namespace vkImage {
 
 	public:
 		vk::Image image;
-		vk::DeviceMemory imageMemory;
+		vkUtil::Allocation imageMemory;
 		vk::ImageView imageView;
 		vk::Sampler sampler;
 
@@ -65,8 +69,8 @@ namespace vkImage {
 		vk::DescriptorSet descriptorSet;
 		vk::DescriptorPool descriptorPool;
 
-		vk::CommandBuffer commandBuffer;
-		vk::Queue queue;
+		vkUtil::UploadBatch* uploads;
+		vkUtil::DeviceAllocator* allocator;
 
 		void load();
 		void populate();
@@ -76,9 +80,11 @@ namespace vkImage {
 	};
 
 	vk::Image create_image(ImageCreateInput input);
-	vk::DeviceMemory create_image_memory(ImageCreateInput input, vk::Image image);
+	vkUtil::Allocation create_image_memory(ImageCreateInput input, vk::Image image);
 	void transition_image_layout(ImageLayoutTransitionInput input);
 	void copy_buffer_to_image(BufferImageCopyInput input);
-	vk::ImageView create_image_view(vk::Device device, vk::Image image, vk::Format format, vk::ImageAspectFlags aspect);
+	// mips baseMip to baseMip + mipCount - 1
+	vk::ImageView create_image_view(vk::Device device, vk::Image image, vk::Format format, vk::ImageAspectFlags aspect,
+		uint32_t baseMip = 0, uint32_t mipCount = 1);
 	vk::Format find_supported_format(vk::PhysicalDevice physicalDevice, const std::vector<vk::Format>& candidates, vk::ImageTiling tiling, vk::FormatFeatureFlags features);
 }
\ No newline at end of file
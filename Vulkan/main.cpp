@@ -1,2 +1,18 @@
 #include "app.h"
-int main() { auto app = std::make_unique<App>(640 * 2, 480 * 2, true);  app->run(); }
+#include "benchmark.h"
+
+int main(int argc, char** argv) {
+	if (argc > 1 && std::string_view(argv[1]) == "--benchmark") { vkBench::run_all(); return 0; }
+	auto vertexFormat = VertexFormat::FULL;
+	auto cullingMode = CullingMode::GPU;
+	bool geometryChurn = false;
+	size_t objectCount = 0;
+	for (int i = 1; i < argc; ++i) {
+		if (std::string_view(argv[i]) == "--compact-vertices") vertexFormat = VertexFormat::COMPACT;
+		if (std::string_view(argv[i]) == "--cpu-culling") cullingMode = CullingMode::CPU;
+		if (std::string_view(argv[i]) == "--cpu-occlusion") cullingMode = CullingMode::CPU_OCCLUSION;
+		if (std::string_view(argv[i]) == "--geometry-churn") geometryChurn = true;
+		if (std::string_view(argv[i]) == "--objects" && i + 1 < argc) objectCount = std::strtoull(argv[++i], nullptr, 10);
+	}
+	auto app = std::make_unique<App>(640 * 2, 480 * 2, true, vertexFormat, cullingMode, geometryChurn, objectCount);  app->run();
+}
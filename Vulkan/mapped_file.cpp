@@ -0,0 +1,72 @@
+#include "mapped_file.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+vkUtil::MappedFile::MappedFile(const char* filepath)
+{
+#ifdef _WIN32
+	HANDLE file = CreateFileA(filepath, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file == INVALID_HANDLE_VALUE) {
+#ifndef NDEBUG
+		std::cerr << "Failed to open \"" << filepath << "\"" << std::endl;
+#endif
+		return;
+	}
+	fileHandle = file;
+	opened = true;
+
+	LARGE_INTEGER fileSize;
+	GetFileSizeEx(file, &fileSize);
+	size = static_cast<size_t>(fileSize.QuadPart);
+	if (size == 0) return;
+
+	HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (!mapping) {
+		size = 0;
+		return;
+	}
+	mappingHandle = mapping;
+	data = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+	if (!data) size = 0;
+#else
+	int file = open(filepath, O_RDONLY);
+	if (file < 0) {
+#ifndef NDEBUG
+		std::cerr << "Failed to open \"" << filepath << "\"" << std::endl;
+#endif
+		return;
+	}
+	opened = true;
+
+	struct stat status;
+	if (fstat(file, &status) == 0 && status.st_size > 0) {
+		void* mapping = mmap(nullptr, static_cast<size_t>(status.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+		if (mapping != MAP_FAILED) {
+			data = static_cast<const char*>(mapping);
+			size = static_cast<size_t>(status.st_size);
+			madvise(mapping, size, MADV_SEQUENTIAL);
+		}
+	}
+	close(file);
+#endif
+}
+
+vkUtil::MappedFile::~MappedFile()
+{
+#ifdef _WIN32
+	if (data) UnmapViewOfFile(data);
+	if (mappingHandle) CloseHandle(mappingHandle);
+	if (fileHandle) CloseHandle(fileHandle);
+#else
+	if (data) munmap(const_cast<char*>(data), size);
+#endif
+}
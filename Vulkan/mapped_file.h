@@ -0,0 +1,28 @@
+#pragma once
+#include "config.h"
+#include <string_view>
+
+namespace vkUtil {
+	// Read-only view of a whole file mapped into the address space.
+	// The view stays valid for the lifetime of the object.
+	class MappedFile {
+	public:
+		MappedFile(const char* filepath);
+		~MappedFile();
+
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+
+		bool is_open() const { return opened; }
+		std::string_view view() const { return { data, size }; }
+
+	private:
+		const char* data = nullptr;
+		size_t size = 0;
+		bool opened = false;
+#ifdef _WIN32
+		void* fileHandle = nullptr;
+		void* mappingHandle = nullptr;
+#endif
+	};
+}
@@ -1,6 +1,7 @@
 
 #include "memory.h"
-#include "single_time_commands.h"
+#include "upload_batch.h"
+#include <algorithm>
 
 namespace vkUtil {
 
@@ -17,16 +18,42 @@ namespace vkUtil {
 		throw("couldn't find as suitable memory type index");
 	}
 
+	bool supportsDirectUpload(vk::PhysicalDevice physicalDevice) {
+		auto memoryProperties = physicalDevice.getMemoryProperties();
+		vk::MemoryPropertyFlags direct = vk::MemoryPropertyFlagBits::eDeviceLocal
+			| vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent;
+
+		vk::DeviceSize largestDeviceHeap = 0, largestDirectHeap = 0;
+		for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++) {
+			const auto& type = memoryProperties.memoryTypes[i];
+			vk::DeviceSize heapSize = memoryProperties.memoryHeaps[type.heapIndex].size;
+			if (type.propertyFlags & vk::MemoryPropertyFlagBits::eDeviceLocal) largestDeviceHeap = std::max(largestDeviceHeap, heapSize);
+			if ((type.propertyFlags & direct) == direct) largestDirectHeap = std::max(largestDirectHeap, heapSize);
+		}
+
+		return largestDirectHeap && largestDirectHeap >= largestDeviceHeap;
+	}
+
 	void allocateBufferMemory(Buffer& buffer, const BufferInput& input) {
 		auto memoryRequirements = input.device.getBufferMemoryRequirements(buffer.buffer);
-		vk::MemoryAllocateInfo allocInfo;
-		allocInfo.allocationSize = memoryRequirements.size;
-		allocInfo.memoryTypeIndex = findMemoryTypeIndex(
-			input.physicalDevice, memoryRequirements.memoryTypeBits, input.memoryProperties
-		);
-
-		buffer.bufferMemory = input.device.allocateMemory(allocInfo);
-		input.device.bindBufferMemory(buffer.buffer, buffer.bufferMemory, 0);
+
+		if (input.allocator) {
+			buffer.allocation = input.allocator->allocate(memoryRequirements, input.memoryProperties, true);
+		}
+		else {
+			vk::MemoryAllocateInfo allocInfo;
+			allocInfo.allocationSize = memoryRequirements.size;
+			allocInfo.memoryTypeIndex = findMemoryTypeIndex(
+				input.physicalDevice, memoryRequirements.memoryTypeBits, input.memoryProperties
+			);
+
+			buffer.allocation.memory = input.device.allocateMemory(allocInfo);
+			buffer.allocation.size = memoryRequirements.size;
+			if (input.memoryProperties & vk::MemoryPropertyFlagBits::eHostVisible) {
+				buffer.allocation.mapped = input.device.mapMemory(buffer.allocation.memory, 0, memoryRequirements.size);
+			}
+		}
+		input.device.bindBufferMemory(buffer.buffer, buffer.allocation.memory, buffer.allocation.offset);
 	}
 
 	Buffer createBuffer(BufferInput& input) {
@@ -44,17 +71,25 @@ namespace vkUtil {
 
 	}
 
-	void copyBuffer(Buffer& srcBuffer, Buffer& dstBuffer, vk::DeviceSize size, vk::Queue queue, vk::CommandBuffer commandBuffer)
-	{
-		start_job(commandBuffer);
+	void freeMemory(vk::Device device, Allocation& allocation) {
+		if (allocation.allocator) allocation.allocator->free(allocation);
+		else if (allocation.memory) device.freeMemory(allocation.memory);
+		allocation = Allocation();
+	}
 
+	void destroyBuffer(vk::Device device, Buffer& buffer) {
+		device.destroyBuffer(buffer.buffer);
+		freeMemory(device, buffer.allocation);
+		buffer.buffer = nullptr;
+	}
+
+	void copyBuffer(Buffer& srcBuffer, Buffer& dstBuffer, vk::DeviceSize size, UploadBatch& uploads)
+	{
 		vk::BufferCopy copyRegion;
 		copyRegion.srcOffset = 0;
 		copyRegion.dstOffset = 0;
 		copyRegion.size = size;
-		commandBuffer.copyBuffer(srcBuffer.buffer, dstBuffer.buffer, 1, &copyRegion);
-
-		end_job(commandBuffer, queue);
+		uploads.copy_buffer(srcBuffer.buffer, dstBuffer.buffer, copyRegion);
 	}
 
 
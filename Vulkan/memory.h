@@ -1,5 +1,6 @@
 #pragma once
 #include "config.h"
+#include "allocator.h"
 
 namespace vkUtil {
 	struct BufferInput {
@@ -8,18 +9,32 @@ namespace vkUtil {
 		vk::Device device;
 		vk::PhysicalDevice physicalDevice;
 		vk::MemoryPropertyFlags memoryProperties;
+		// sub-allocates when set, otherwise the buffer gets memory of its own
+		DeviceAllocator* allocator = nullptr;
 	};
 	struct Buffer {
 		vk::Buffer buffer;
-		vk::DeviceMemory bufferMemory;
+		// allocation.mapped points at the buffer's first byte when its memory is host-visible
+		Allocation allocation;
 	};
 
 	uint32_t findMemoryTypeIndex(vk::PhysicalDevice physicalDevice, uint32_t supportedMemoryIndices, vk::MemoryPropertyFlags requestedProperties);
 
+	// Device-local memory the host can write through a coherent mapping, in a
+	// heap as large as any other device-local one: true on integrated GPUs and
+	// with resizable BAR, false when only the 256 MiB BAR window is mappable.
+	bool supportsDirectUpload(vk::PhysicalDevice physicalDevice);
+
 	void allocateBufferMemory(Buffer& buffer, const BufferInput& input);
 
 	Buffer createBuffer(BufferInput& input);
 
-	void copyBuffer(Buffer& srcBuffer, Buffer& dstBuffer, vk::DeviceSize size, vk::Queue queue, vk::CommandBuffer commandBuffer);
+	// Returns an allocation to its allocator, or frees its memory if it has none.
+	void freeMemory(vk::Device device, Allocation& allocation);
+
+	void destroyBuffer(vk::Device device, Buffer& buffer);
+
+	class UploadBatch;
+	void copyBuffer(Buffer& srcBuffer, Buffer& dstBuffer, vk::DeviceSize size, UploadBatch& uploads);
 
 }
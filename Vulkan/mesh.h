@@ -4,4 +4,9 @@
 namespace vkMesh {
 	std::vector<vk::VertexInputBindingDescription> getPosColorBindingDescriptions();
 	std::vector<vk::VertexInputAttributeDescription> getPosColorAttributeDescriptions();
+
+	// Both pairs are generated from the vertex structs by vkMesh::VertexLayout.
+	// vkMesh::CompactVertex, read by Shaders/shader_compact.vert
+	std::vector<vk::VertexInputBindingDescription> getCompactBindingDescriptions();
+	std::vector<vk::VertexInputAttributeDescription> getCompactAttributeDescriptions();
 };
\ No newline at end of file
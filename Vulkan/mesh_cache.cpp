@@ -0,0 +1,192 @@
+#include "mesh_cache.h"
+#include "mesh.h"
+#include <filesystem>
+#include <cstring>
+
+namespace {
+	constexpr char magic[4] = { 'V', 'K', 'M', 'C' };
+
+	std::string cache_path(const char* objFilepath) {
+		return std::string(objFilepath) + ".meshcache";
+	}
+
+	uint64_t fnv1a(uint64_t hash, const void* data, size_t size) {
+		auto bytes = static_cast<const unsigned char*>(data);
+		for (size_t i = 0; i < size; ++i) {
+			hash ^= bytes[i];
+			hash *= 0x100000001B3ull;
+		}
+		return hash;
+	}
+
+	uint64_t stamp_file(uint64_t hash, const char* filepath) {
+		std::error_code error;
+		uint64_t size = std::filesystem::file_size(filepath, error);
+		if (error) size = UINT64_MAX;
+		int64_t modified = std::filesystem::last_write_time(filepath, error).time_since_epoch().count();
+		if (error) modified = 0;
+		hash = fnv1a(hash, &size, sizeof(size));
+		return fnv1a(hash, &modified, sizeof(modified));
+	}
+
+	template<typename T>
+	uint64_t stamp_value(uint64_t hash, const T& value) {
+		return fnv1a(hash, &value, sizeof(value));
+	}
+
+	// Everything the cached data depends on, folded into one value.
+	uint64_t source_stamp(const char* objFilepath, const char* mtlFilepath, const glm::mat4& preTransform, const vkMesh::MeshImportOptions& options) {
+		uint64_t hash = 0xCBF29CE484222325ull;
+		hash = stamp_file(hash, objFilepath);
+		hash = stamp_file(hash, mtlFilepath);
+		hash = stamp_value(hash, preTransform);
+		hash = stamp_value(hash, options.optimize.vertexCache);
+		hash = stamp_value(hash, options.optimize.cacheSize);
+		hash = stamp_value(hash, options.optimize.overdraw);
+		hash = stamp_value(hash, options.optimize.overdrawThreshold);
+		hash = stamp_value(hash, options.optimize.vertexFetch);
+		hash = stamp_value(hash, options.lods.levelCount);
+		hash = stamp_value(hash, options.lods.reduction);
+		hash = stamp_value(hash, options.lods.maxRelativeError);
+		return stamp_value(hash, options.lods.attributeWeight);
+	}
+
+	std::vector<vkMesh::MeshCacheAttribute> current_layout() {
+		std::vector<vkMesh::MeshCacheAttribute> layout;
+		for (const auto& attribute : vkMesh::getPosColorAttributeDescriptions()) {
+			layout.push_back({ attribute.location, static_cast<uint32_t>(attribute.format), attribute.offset });
+		}
+		return layout;
+	}
+
+	uint32_t current_stride() {
+		return vkMesh::getPosColorBindingDescriptions()[0].stride;
+	}
+
+	uint64_t align16(uint64_t offset) {
+		return (offset + 15) & ~uint64_t(15);
+	}
+}
+
+vkMesh::MeshCache::MeshCache(const char* objFilepath, const char* mtlFilepath, const glm::mat4& preTransform, const MeshImportOptions& options)
+{
+	std::string path = cache_path(objFilepath);
+	if (!std::filesystem::exists(path)) return;
+
+	file = std::make_unique<vkUtil::MappedFile>(path.c_str());
+	valid = validate(source_stamp(objFilepath, mtlFilepath, preTransform, options));
+
+	// drop a stale mapping right away so write() can replace the file
+	if (!valid) {
+		file.reset();
+		header = nullptr;
+	}
+}
+
+bool vkMesh::MeshCache::validate(uint64_t sourceStamp)
+{
+	std::string_view data = file->view();
+	if (data.size() < sizeof(MeshCacheHeader)) return false;
+
+	header = reinterpret_cast<const MeshCacheHeader*>(data.data());
+	if (memcmp(header->magic, magic, sizeof(magic)) || header->version != meshCacheVersion) return false;
+	if (header->sourceStamp != sourceStamp) return false;
+
+	auto layout = current_layout();
+	if (header->vertexStride != current_stride() || header->attributeCount != layout.size()) return false;
+
+	// every section has to end before the next one starts
+	if (header->attributeOffset < sizeof(MeshCacheHeader)
+		|| header->attributeOffset + layout.size() * sizeof(MeshCacheAttribute) > header->vertexOffset
+		|| header->vertexOffset + header->vertexCount * header->vertexStride > header->indexOffset
+		|| header->indexOffset + header->indexCount * sizeof(uint32_t) > header->submeshOffset
+		|| header->submeshOffset + header->submeshCount * sizeof(Submesh) > header->lodOffset
+		|| header->lodOffset + header->lodCount * sizeof(MeshLod) > data.size()) return false;
+
+	auto attributes = reinterpret_cast<const MeshCacheAttribute*>(data.data() + header->attributeOffset);
+	for (size_t i = 0; i < layout.size(); ++i) {
+		if (attributes[i].location != layout[i].location
+			|| attributes[i].format != layout[i].format
+			|| attributes[i].offset != layout[i].offset) return false;
+	}
+
+	return true;
+}
+
+std::span<const float> vkMesh::MeshCache::vertices() const
+{
+	auto data = file->view().data() + header->vertexOffset;
+	return { reinterpret_cast<const float*>(data), header->vertexCount * header->vertexStride / sizeof(float) };
+}
+
+std::span<const uint32_t> vkMesh::MeshCache::indices() const
+{
+	auto data = file->view().data() + header->indexOffset;
+	return { reinterpret_cast<const uint32_t*>(data), header->indexCount };
+}
+
+std::span<const vkMesh::Submesh> vkMesh::MeshCache::submeshes() const
+{
+	auto data = file->view().data() + header->submeshOffset;
+	return { reinterpret_cast<const Submesh*>(data), header->submeshCount };
+}
+
+std::span<const vkMesh::MeshLod> vkMesh::MeshCache::lods() const
+{
+	auto data = file->view().data() + header->lodOffset;
+	return { reinterpret_cast<const MeshLod*>(data), header->lodCount };
+}
+
+bool vkMesh::MeshCache::write(const char* objFilepath, const char* mtlFilepath, const glm::mat4& preTransform, const MeshImportOptions& options, const ObjMesh& mesh)
+{
+	auto layout = current_layout();
+
+	MeshCacheHeader header = {};
+	memcpy(header.magic, magic, sizeof(magic));
+	header.version = meshCacheVersion;
+	header.sourceStamp = source_stamp(objFilepath, mtlFilepath, preTransform, options);
+	header.vertexStride = current_stride();
+	header.attributeCount = static_cast<uint32_t>(layout.size());
+	header.vertexCount = mesh.vertices.size() * sizeof(float) / header.vertexStride;
+	header.indexCount = mesh.indices.size();
+	header.submeshCount = mesh.submeshes.size();
+	header.lodCount = mesh.lods.size();
+	header.attributeOffset = align16(sizeof(MeshCacheHeader));
+	header.vertexOffset = align16(header.attributeOffset + layout.size() * sizeof(MeshCacheAttribute));
+	header.indexOffset = align16(header.vertexOffset + mesh.vertices.size() * sizeof(float));
+	header.submeshOffset = align16(header.indexOffset + mesh.indices.size() * sizeof(uint32_t));
+	header.lodOffset = align16(header.submeshOffset + mesh.submeshes.size() * sizeof(Submesh));
+
+	// write next to the target and rename, so an interrupted write never
+	// leaves a half-written cache behind
+	std::string path = cache_path(objFilepath);
+	std::string temporaryPath = path + ".tmp";
+	{
+		std::ofstream out(temporaryPath, std::ios::binary | std::ios::trunc);
+		if (!out) return false;
+
+		auto write_at = [&](uint64_t offset, const void* data, size_t size) {
+			static const char padding[16] = {};
+			out.write(padding, static_cast<std::streamsize>(offset - static_cast<uint64_t>(out.tellp())));
+			out.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+		};
+		write_at(0, &header, sizeof(header));
+		write_at(header.attributeOffset, layout.data(), layout.size() * sizeof(MeshCacheAttribute));
+		write_at(header.vertexOffset, mesh.vertices.data(), mesh.vertices.size() * sizeof(float));
+		write_at(header.indexOffset, mesh.indices.data(), mesh.indices.size() * sizeof(uint32_t));
+		write_at(header.submeshOffset, mesh.submeshes.data(), mesh.submeshes.size() * sizeof(Submesh));
+		write_at(header.lodOffset, mesh.lods.data(), mesh.lods.size() * sizeof(MeshLod));
+		if (!out) return false;
+	}
+
+	std::error_code error;
+	std::filesystem::rename(temporaryPath, path, error);
+	if (error) {
+#ifndef NDEBUG
+		std::cerr << "Failed to write mesh cache \"" << path << "\"" << std::endl;
+#endif
+		std::filesystem::remove(temporaryPath, error);
+		return false;
+	}
+	return true;
+}
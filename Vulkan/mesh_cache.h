@@ -0,0 +1,70 @@
+#pragma once
+#include "config.h"
+#include "mapped_file.h"
+#include "obj_mesh.h"
+#include "mesh_optimizer.h"
+#include "mesh_simplifier.h"
+#include <span>
+
+namespace vkMesh {
+	constexpr uint32_t meshCacheVersion = 4;
+
+	// On-disk layout, all offsets from the start of the file and 16-byte
+	// aligned so the mapped blobs can be read in place:
+	//   MeshCacheHeader
+	//   MeshCacheAttribute[attributeCount]
+	//   vertex blob (vertexCount * vertexStride bytes)
+	//   index blob (indexCount * uint32_t), every LOD level back to back
+	//   Submesh[submeshCount]
+	//   MeshLod[lodCount]
+	struct MeshCacheHeader {
+		char magic[4];
+		uint32_t version;
+		uint64_t sourceStamp;
+		uint32_t vertexStride;
+		uint32_t attributeCount;
+		uint64_t vertexCount;
+		uint64_t indexCount;
+		uint64_t submeshCount;
+		uint64_t lodCount;
+		uint64_t attributeOffset, vertexOffset, indexOffset, submeshOffset, lodOffset;
+	};
+
+	// Everything done to a mesh between parsing and caching it.
+	struct MeshImportOptions {
+		MeshOptimizeOptions optimize;
+		LodOptions lods;
+	};
+
+	struct MeshCacheAttribute {
+		uint32_t location;
+		uint32_t format;
+		uint32_t offset;
+	};
+
+	// Precompiled copy of an imported .obj, stored next to it as
+	// "<file>.obj.meshcache". The cache is only used while the .obj/.mtl
+	// size and modification time, the pre-transform, the import options and
+	// the vertex layout all match what it was built from.
+	class MeshCache {
+	public:
+		MeshCache(const char* objFilepath, const char* mtlFilepath, const glm::mat4& preTransform, const MeshImportOptions& options);
+
+		bool is_valid() const { return valid; }
+
+		std::span<const float> vertices() const;
+		std::span<const uint32_t> indices() const;
+		std::span<const Submesh> submeshes() const;
+		std::span<const MeshLod> lods() const;
+
+		// Writes the cache for an imported mesh, replacing any stale one.
+		static bool write(const char* objFilepath, const char* mtlFilepath, const glm::mat4& preTransform, const MeshImportOptions& options, const ObjMesh& mesh);
+
+	private:
+		std::unique_ptr<vkUtil::MappedFile> file;
+		const MeshCacheHeader* header = nullptr;
+		bool valid = false;
+
+		bool validate(uint64_t sourceStamp);
+	};
+}
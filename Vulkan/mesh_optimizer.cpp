@@ -0,0 +1,389 @@
+#include "mesh_optimizer.h"
+#include <algorithm>
+#include <limits>
+
+namespace {
+	constexpr size_t objFloatsPerVertex = vkMesh::fullVertexFloats;
+	constexpr size_t cacheLineSize = 64;
+	constexpr size_t fetchCacheLines = 128;
+	constexpr int overdrawResolution = 256;
+
+	// Triangles touching each vertex, as offsets into one flat list.
+	struct TriangleAdjacency {
+		std::vector<uint32_t> offsets, counts, triangles;
+
+		TriangleAdjacency(std::span<const uint32_t> indices, size_t vertexCount)
+			: offsets(vertexCount + 1, 0), counts(vertexCount, 0), triangles(indices.size())
+		{
+			for (uint32_t index : indices) counts[index]++;
+			for (size_t i = 0; i < vertexCount; ++i) offsets[i + 1] = offsets[i] + counts[i];
+
+			std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+			for (size_t i = 0; i < indices.size(); ++i) {
+				triangles[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+			}
+		}
+	};
+
+	glm::vec3 position(std::span<const float> vertices, size_t floatsPerVertex, uint32_t index) {
+		const float* p = vertices.data() + size_t(index) * floatsPerVertex;
+		return glm::vec3(p[0], p[1], p[2]);
+	}
+
+	// Cache misses of every triangle under the same FIFO model as
+	// analyze_vertex_cache, restarting the cache at each reset point.
+	class FifoCache {
+	public:
+		FifoCache(size_t vertexCount, uint32_t cacheSize) : loadedAt(vertexCount, 0), cacheSize(cacheSize) {}
+
+		void reset() { misses += cacheSize; }
+
+		int triangle_misses(const uint32_t* triangle) {
+			int count = 0;
+			for (int corner = 0; corner < 3; ++corner) {
+				uint64_t& loaded = loadedAt[triangle[corner]];
+				if (loaded == 0 || misses - loaded >= cacheSize) {
+					loaded = ++misses;
+					count++;
+				}
+			}
+			return count;
+		}
+
+	private:
+		std::vector<uint64_t> loadedAt;
+		uint64_t misses = 0;
+		uint32_t cacheSize;
+	};
+
+	// Depth-tested rasterization of one axis-aligned view; z points at the camera.
+	struct OverdrawView {
+		int axis;
+		float sign;
+	};
+
+	void rasterize_overdraw(const glm::vec3 corners[3], float* depth, uint64_t& shaded) {
+		float minX = std::max(0.0f, std::floor(std::min({ corners[0].x, corners[1].x, corners[2].x })));
+		float maxX = std::min(float(overdrawResolution - 1), std::ceil(std::max({ corners[0].x, corners[1].x, corners[2].x })));
+		float minY = std::max(0.0f, std::floor(std::min({ corners[0].y, corners[1].y, corners[2].y })));
+		float maxY = std::min(float(overdrawResolution - 1), std::ceil(std::max({ corners[0].y, corners[1].y, corners[2].y })));
+
+		float area = (corners[1].x - corners[0].x) * (corners[2].y - corners[0].y) - (corners[1].y - corners[0].y) * (corners[2].x - corners[0].x);
+		if (area <= 0.0f) return;
+
+		for (int y = int(minY); y <= int(maxY); ++y) {
+			for (int x = int(minX); x <= int(maxX); ++x) {
+				float px = x + 0.5f, py = y + 0.5f;
+				float w0 = (corners[2].x - corners[1].x) * (py - corners[1].y) - (corners[2].y - corners[1].y) * (px - corners[1].x);
+				float w1 = (corners[0].x - corners[2].x) * (py - corners[2].y) - (corners[0].y - corners[2].y) * (px - corners[2].x);
+				float w2 = area - w0 - w1;
+				if (w0 < 0.0f || w1 < 0.0f || w2 < 0.0f) continue;
+
+				float z = (w0 * corners[0].z + w1 * corners[1].z + w2 * corners[2].z) / area;
+				float& stored = depth[y * overdrawResolution + x];
+				if (z < stored) {
+					stored = z;
+					shaded++;
+				}
+			}
+		}
+	}
+}
+
+vkMesh::VertexCacheStats vkMesh::analyze_vertex_cache(std::span<const uint32_t> indices, size_t vertexCount, uint32_t cacheSize)
+{
+	// a vertex is in the FIFO while fewer than cacheSize misses happened since it was loaded
+	std::vector<uint64_t> loadedAt(vertexCount, 0);
+	std::vector<bool> used(vertexCount, false);
+	uint64_t misses = 0;
+	size_t uniqueVertices = 0;
+
+	for (uint32_t index : indices) {
+		if (!used[index]) {
+			used[index] = true;
+			uniqueVertices++;
+		}
+		if (loadedAt[index] == 0 || misses - loadedAt[index] >= cacheSize) {
+			misses++;
+			loadedAt[index] = misses;
+		}
+	}
+
+	size_t triangleCount = indices.size() / 3;
+	VertexCacheStats stats;
+	stats.acmr = triangleCount ? static_cast<float>(misses) / triangleCount : 0.0f;
+	stats.atvr = uniqueVertices ? static_cast<float>(misses) / uniqueVertices : 0.0f;
+	return stats;
+}
+
+vkMesh::VertexFetchStats vkMesh::analyze_vertex_fetch(std::span<const uint32_t> indices, size_t vertexCount, size_t vertexStride)
+{
+	size_t lineCount = (vertexCount * vertexStride + cacheLineSize - 1) / cacheLineSize;
+	std::vector<uint64_t> loadedAt(lineCount, 0);
+	std::vector<bool> used(vertexCount, false);
+	uint64_t misses = 0;
+	size_t uniqueVertices = 0;
+
+	for (uint32_t index : indices) {
+		if (!used[index]) {
+			used[index] = true;
+			uniqueVertices++;
+		}
+
+		size_t first = index * vertexStride / cacheLineSize;
+		size_t last = (index * vertexStride + vertexStride - 1) / cacheLineSize;
+		for (size_t line = first; line <= last; ++line) {
+			if (loadedAt[line] == 0 || misses - loadedAt[line] >= fetchCacheLines) {
+				loadedAt[line] = ++misses;
+			}
+		}
+	}
+
+	VertexFetchStats stats;
+	stats.overfetch = uniqueVertices ? static_cast<float>(misses * cacheLineSize) / (uniqueVertices * vertexStride) : 0.0f;
+	return stats;
+}
+
+vkMesh::OverdrawStats vkMesh::analyze_overdraw(std::span<const uint32_t> indices, std::span<const float> vertices, size_t floatsPerVertex)
+{
+	size_t vertexCount = vertices.size() / floatsPerVertex;
+	if (vertexCount == 0 || indices.empty()) return { 0.0f };
+
+	glm::vec3 low = position(vertices, floatsPerVertex, 0), high = low;
+	for (size_t i = 1; i < vertexCount; ++i) {
+		glm::vec3 p = position(vertices, floatsPerVertex, static_cast<uint32_t>(i));
+		low = glm::min(low, p);
+		high = glm::max(high, p);
+	}
+	glm::vec3 extent = high - low;
+	float scale = float(overdrawResolution - 1) / std::max({ extent.x, extent.y, extent.z, 1e-6f });
+
+	const OverdrawView views[] = { { 0, 1.0f }, { 0, -1.0f }, { 1, 1.0f }, { 1, -1.0f }, { 2, 1.0f }, { 2, -1.0f } };
+	std::vector<float> depth(overdrawResolution * overdrawResolution);
+	uint64_t shaded = 0, covered = 0;
+
+	for (const auto& view : views) {
+		std::fill(depth.begin(), depth.end(), std::numeric_limits<float>::max());
+		int u = (view.axis + 1) % 3, w = (view.axis + 2) % 3;
+
+		for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+			glm::vec3 corners[3];
+			for (int corner = 0; corner < 3; ++corner) {
+				glm::vec3 p = (position(vertices, floatsPerVertex, indices[i + corner]) - low) * scale;
+				// looking down -axis from the positive side (or mirrored), keeping screen space right-handed
+				corners[corner] = glm::vec3(view.sign > 0.0f ? p[u] : p[w], view.sign > 0.0f ? p[w] : p[u], -view.sign * p[view.axis]);
+			}
+			rasterize_overdraw(corners, depth.data(), shaded);
+		}
+
+		for (float stored : depth) {
+			if (stored != std::numeric_limits<float>::max()) covered++;
+		}
+	}
+
+	return { covered ? static_cast<float>(shaded) / covered : 0.0f };
+}
+
+void vkMesh::optimize_vertex_cache(std::span<uint32_t> indices, size_t vertexCount, uint32_t cacheSize)
+{
+	size_t triangleCount = indices.size() / 3;
+	if (triangleCount < 2) return;
+
+	TriangleAdjacency adjacency(indices, vertexCount);
+	std::vector<uint32_t> live(adjacency.counts);
+	std::vector<uint64_t> cacheTime(vertexCount, 0);
+	std::vector<bool> emitted(triangleCount, false);
+	std::vector<uint32_t> deadEnd, candidates;
+	std::vector<uint32_t> output;
+	output.reserve(indices.size());
+
+	uint64_t time = cacheSize + 1;
+	size_t cursor = 0;
+
+	// start from the first vertex that is actually referenced
+	int64_t fanning = indices[0];
+
+	while (fanning >= 0) {
+		candidates.clear();
+
+		uint32_t begin = adjacency.offsets[fanning], end = begin + adjacency.counts[fanning];
+		for (uint32_t i = begin; i < end; ++i) {
+			uint32_t triangle = adjacency.triangles[i];
+			if (emitted[triangle]) continue;
+			emitted[triangle] = true;
+
+			for (int corner = 0; corner < 3; ++corner) {
+				uint32_t vertex = indices[triangle * 3 + corner];
+				output.push_back(vertex);
+				deadEnd.push_back(vertex);
+				candidates.push_back(vertex);
+				live[vertex]--;
+				if (time - cacheTime[vertex] > cacheSize) {
+					cacheTime[vertex] = time++;
+				}
+			}
+		}
+
+		// prefer the candidate that stays in the cache longest while it
+		// still has triangles to emit
+		fanning = -1;
+		int64_t bestPriority = -1;
+		for (uint32_t vertex : candidates) {
+			if (live[vertex] == 0) continue;
+			int64_t priority = 0;
+			if (time - cacheTime[vertex] + 2 * live[vertex] <= cacheSize) {
+				priority = static_cast<int64_t>(time - cacheTime[vertex]);
+			}
+			if (priority > bestPriority) {
+				bestPriority = priority;
+				fanning = vertex;
+			}
+		}
+
+		// dead end: walk back through recently emitted vertices, then scan
+		while (fanning < 0 && !deadEnd.empty()) {
+			uint32_t vertex = deadEnd.back();
+			deadEnd.pop_back();
+			if (live[vertex] > 0) fanning = vertex;
+		}
+		while (fanning < 0 && cursor < vertexCount) {
+			if (live[cursor] > 0) fanning = static_cast<int64_t>(cursor);
+			cursor++;
+		}
+	}
+
+	std::copy(output.begin(), output.end(), indices.begin());
+}
+
+void vkMesh::optimize_overdraw(std::span<uint32_t> indices, std::span<const float> vertices, size_t floatsPerVertex, uint32_t cacheSize, float threshold)
+{
+	size_t triangleCount = indices.size() / 3;
+	size_t vertexCount = vertices.size() / floatsPerVertex;
+	if (triangleCount < 2) return;
+
+	// hard boundaries: triangles where every corner missed the cache, which
+	// is where the cache optimizer had to jump
+	std::vector<size_t> hardBoundaries;
+	FifoCache cache(vertexCount, cacheSize);
+	for (size_t t = 0; t < triangleCount; ++t) {
+		if (cache.triangle_misses(&indices[t * 3]) == 3) hardBoundaries.push_back(t);
+	}
+	if (hardBoundaries.empty() || hardBoundaries[0] != 0) hardBoundaries.insert(hardBoundaries.begin(), 0);
+	hardBoundaries.push_back(triangleCount);
+
+	// soft boundaries: cut a hard cluster whenever the part seen so far is no
+	// worse than threshold times the cluster's own ACMR
+	std::vector<size_t> clusters;
+	FifoCache softCache(vertexCount, cacheSize);
+	for (size_t c = 0; c + 1 < hardBoundaries.size(); ++c) {
+		size_t begin = hardBoundaries[c], end = hardBoundaries[c + 1];
+
+		softCache.reset();
+		size_t clusterMisses = 0;
+		for (size_t t = begin; t < end; ++t) clusterMisses += softCache.triangle_misses(&indices[t * 3]);
+		float clusterAcmr = static_cast<float>(clusterMisses) / (end - begin);
+
+		softCache.reset();
+		clusters.push_back(begin);
+		size_t start = begin, misses = 0;
+		for (size_t t = begin; t < end; ++t) {
+			misses += softCache.triangle_misses(&indices[t * 3]);
+			if (t + 1 < end && static_cast<float>(misses) / (t + 1 - start) <= clusterAcmr * threshold) {
+				clusters.push_back(t + 1);
+				start = t + 1;
+				misses = 0;
+				softCache.reset();
+			}
+		}
+	}
+	clusters.push_back(triangleCount);
+
+	// area-weighted centroid of the whole range, then a sort key per cluster
+	glm::vec3 meshCentroid(0.0f);
+	float meshArea = 0.0f;
+	for (size_t t = 0; t < triangleCount; ++t) {
+		glm::vec3 a = position(vertices, floatsPerVertex, indices[t * 3]);
+		glm::vec3 b = position(vertices, floatsPerVertex, indices[t * 3 + 1]);
+		glm::vec3 c = position(vertices, floatsPerVertex, indices[t * 3 + 2]);
+		float area = glm::length(glm::cross(b - a, c - a));
+		meshCentroid += (a + b + c) * (area / 3.0f);
+		meshArea += area;
+	}
+	meshCentroid = meshArea > 0.0f ? meshCentroid / meshArea : meshCentroid;
+
+	std::vector<std::pair<float, size_t>> order;
+	for (size_t c = 0; c + 1 < clusters.size(); ++c) {
+		glm::vec3 centroid(0.0f), normal(0.0f);
+		float clusterArea = 0.0f;
+		for (size_t t = clusters[c]; t < clusters[c + 1]; ++t) {
+			glm::vec3 a = position(vertices, floatsPerVertex, indices[t * 3]);
+			glm::vec3 b = position(vertices, floatsPerVertex, indices[t * 3 + 1]);
+			glm::vec3 c3 = position(vertices, floatsPerVertex, indices[t * 3 + 2]);
+			glm::vec3 areaNormal = glm::cross(b - a, c3 - a);
+			float area = glm::length(areaNormal);
+			centroid += (a + b + c3) * (area / 3.0f);
+			normal += areaNormal;
+			clusterArea += area;
+		}
+		centroid = clusterArea > 0.0f ? centroid / clusterArea : centroid;
+		float normalLength = glm::length(normal);
+		float key = normalLength > 0.0f ? glm::dot(centroid - meshCentroid, normal / normalLength) : 0.0f;
+		order.push_back({ key, c });
+	}
+
+	// most outward-facing clusters first, so they occlude what comes after
+	std::stable_sort(order.begin(), order.end(), [](const auto& a, const auto& b) { return a.first > b.first; });
+
+	std::vector<uint32_t> output;
+	output.reserve(indices.size());
+	for (const auto& [key, c] : order) {
+		output.insert(output.end(), indices.begin() + clusters[c] * 3, indices.begin() + clusters[c + 1] * 3);
+	}
+	std::copy(output.begin(), output.end(), indices.begin());
+}
+
+size_t vkMesh::optimize_vertex_fetch(std::vector<float>& vertices, std::span<uint32_t> indices, size_t floatsPerVertex)
+{
+	size_t vertexCount = vertices.size() / floatsPerVertex;
+	std::vector<uint32_t> remap(vertexCount, UINT32_MAX);
+	std::vector<float> reordered;
+	reordered.reserve(vertices.size());
+
+	uint32_t next = 0;
+	for (uint32_t& index : indices) {
+		if (remap[index] == UINT32_MAX) {
+			remap[index] = next++;
+			auto source = vertices.begin() + size_t(index) * floatsPerVertex;
+			reordered.insert(reordered.end(), source, source + floatsPerVertex);
+		}
+		index = remap[index];
+	}
+
+	vertices.swap(reordered);
+	return next;
+}
+
+vkMesh::MeshOptimizeStats vkMesh::optimize_mesh(ObjMesh& mesh, const MeshOptimizeOptions& options)
+{
+	size_t vertexCount = mesh.vertices.size() / objFloatsPerVertex;
+	size_t vertexStride = objFloatsPerVertex * sizeof(float);
+
+	MeshOptimizeStats stats = {};
+	stats.before = analyze_vertex_cache(mesh.indices, vertexCount, options.cacheSize);
+	stats.fetchBefore = analyze_vertex_fetch(mesh.indices, vertexCount, vertexStride);
+	if (options.overdraw) stats.overdrawBefore = analyze_overdraw(mesh.indices, mesh.vertices, objFloatsPerVertex);
+
+	for (const auto& submesh : mesh.submeshes) {
+		std::span<uint32_t> range(mesh.indices.data() + submesh.firstIndex, submesh.indexCount);
+		if (options.vertexCache) optimize_vertex_cache(range, vertexCount, options.cacheSize);
+		if (options.overdraw) optimize_overdraw(range, mesh.vertices, objFloatsPerVertex, options.cacheSize, options.overdrawThreshold);
+	}
+
+	// renumbering last, the earlier passes only move triangles
+	if (options.vertexFetch) vertexCount = optimize_vertex_fetch(mesh.vertices, mesh.indices, objFloatsPerVertex);
+
+	stats.after = analyze_vertex_cache(mesh.indices, vertexCount, options.cacheSize);
+	stats.fetchAfter = analyze_vertex_fetch(mesh.indices, vertexCount, vertexStride);
+	if (options.overdraw) stats.overdrawAfter = analyze_overdraw(mesh.indices, mesh.vertices, objFloatsPerVertex);
+	return stats;
+}
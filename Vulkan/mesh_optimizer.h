@@ -0,0 +1,67 @@
+#pragma once
+#include "config.h"
+#include "obj_mesh.h"
+#include <span>
+
+namespace vkMesh {
+	struct VertexCacheStats {
+		float acmr;	// average cache miss ratio: transformed vertices per triangle
+		float atvr;	// average transformed vertex ratio: transformed vertices per unique vertex
+	};
+
+	struct VertexFetchStats {
+		float overfetch;	// bytes pulled through a 64-byte-line cache / bytes of unique vertices
+	};
+
+	struct OverdrawStats {
+		float overdraw;	// shaded pixels / covered pixels, averaged over six axis views
+	};
+
+	struct MeshOptimizeOptions {
+		bool vertexCache = true;
+		uint32_t cacheSize = 16;
+
+		// Sorts cache-friendly triangle clusters outward-facing first. The
+		// threshold bounds how much ACMR may grow for smaller clusters.
+		bool overdraw = false;
+		float overdrawThreshold = 1.05f;
+
+		// Renumbers vertices in first-use order so fetches walk the vertex buffer.
+		bool vertexFetch = true;
+	};
+
+	struct MeshOptimizeStats {
+		VertexCacheStats before, after;
+		VertexFetchStats fetchBefore, fetchAfter;
+		// only measured when the overdraw pass runs
+		OverdrawStats overdrawBefore, overdrawAfter;
+	};
+
+	// Simulates a FIFO post-transform cache of cacheSize entries over a triangle list.
+	VertexCacheStats analyze_vertex_cache(std::span<const uint32_t> indices, size_t vertexCount, uint32_t cacheSize = 16);
+
+	// Simulates fetching vertexStride-byte vertices through a small cache of 64-byte lines.
+	VertexFetchStats analyze_vertex_fetch(std::span<const uint32_t> indices, size_t vertexCount, size_t vertexStride);
+
+	// Rasterizes the front faces in draw order from six axis-aligned views at low
+	// resolution and reports how often a covered pixel was shaded.
+	// Positions are the first three floats of every floatsPerVertex.
+	OverdrawStats analyze_overdraw(std::span<const uint32_t> indices, std::span<const float> vertices, size_t floatsPerVertex);
+
+	// Reorders triangles for post-transform cache reuse (Tipsify, Sander et al. 2007).
+	// Vertex indices are left untouched; only the triangle order changes.
+	void optimize_vertex_cache(std::span<uint32_t> indices, size_t vertexCount, uint32_t cacheSize = 16);
+
+	// Splits a cache-optimized triangle list into clusters at cache flushes (and
+	// where the cluster ACMR stays within threshold of the whole range) and sorts
+	// the clusters by how far they face away from the mesh centre (Sander et al.).
+	void optimize_overdraw(std::span<uint32_t> indices, std::span<const float> vertices, size_t floatsPerVertex, uint32_t cacheSize = 16, float threshold = 1.05f);
+
+	// Renumbers vertices in the order the index buffer first uses them and
+	// rewrites both arrays; returns the number of vertices kept.
+	size_t optimize_vertex_fetch(std::vector<float>& vertices, std::span<uint32_t> indices, size_t floatsPerVertex);
+
+	// Import-time passes run on a freshly parsed mesh before it is cached or
+	// handed to VertexManagerie. Triangles never move between submeshes.
+	MeshOptimizeStats optimize_mesh(ObjMesh& mesh, const MeshOptimizeOptions& options = {});
+}
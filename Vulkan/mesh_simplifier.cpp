@@ -0,0 +1,295 @@
+#include "mesh_simplifier.h"
+#include "mesh_optimizer.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace {
+	constexpr size_t objFloatsPerVertex = vkMesh::fullVertexFloats;
+
+	// Symmetric 4x4 error quadric of a set of planes, upper triangle only.
+	struct Quadric {
+		double a00 = 0, a01 = 0, a02 = 0, a03 = 0;
+		double a11 = 0, a12 = 0, a13 = 0;
+		double a22 = 0, a23 = 0;
+		double a33 = 0;
+
+		void add_plane(const glm::vec3& normal, float distance, double weight) {
+			double a = normal.x, b = normal.y, c = normal.z, d = distance;
+			a00 += weight * a * a; a01 += weight * a * b; a02 += weight * a * c; a03 += weight * a * d;
+			a11 += weight * b * b; a12 += weight * b * c; a13 += weight * b * d;
+			a22 += weight * c * c; a23 += weight * c * d;
+			a33 += weight * d * d;
+		}
+
+		void add(const Quadric& other) {
+			a00 += other.a00; a01 += other.a01; a02 += other.a02; a03 += other.a03;
+			a11 += other.a11; a12 += other.a12; a13 += other.a13;
+			a22 += other.a22; a23 += other.a23;
+			a33 += other.a33;
+		}
+
+		// sum of squared distances to the planes, weighted by area
+		double error(const glm::vec3& p) const {
+			double x = p.x, y = p.y, z = p.z;
+			double result = a00 * x * x + 2 * a01 * x * y + 2 * a02 * x * z + 2 * a03 * x
+				+ a11 * y * y + 2 * a12 * y * z + 2 * a13 * y
+				+ a22 * z * z + 2 * a23 * z
+				+ a33;
+			return std::max(result, 0.0);
+		}
+	};
+
+	struct Collapse {
+		uint32_t from, to;
+		double cost;
+	};
+
+	glm::vec3 position(std::span<const float> vertices, size_t floatsPerVertex, uint32_t index) {
+		const float* p = vertices.data() + size_t(index) * floatsPerVertex;
+		return glm::vec3(p[0], p[1], p[2]);
+	}
+
+	struct PositionHash {
+		std::span<const float> vertices;
+		size_t floatsPerVertex;
+
+		size_t operator()(uint32_t index) const {
+			uint32_t bits[3];
+			std::memcpy(bits, vertices.data() + size_t(index) * floatsPerVertex, sizeof(bits));
+			return (bits[0] * 73856093u) ^ (bits[1] * 19349663u) ^ (bits[2] * 83492791u);
+		}
+	};
+
+	struct PositionEqual {
+		std::span<const float> vertices;
+		size_t floatsPerVertex;
+
+		bool operator()(uint32_t a, uint32_t b) const {
+			return std::memcmp(vertices.data() + size_t(a) * floatsPerVertex, vertices.data() + size_t(b) * floatsPerVertex, 3 * sizeof(float)) == 0;
+		}
+	};
+
+	// Maps every vertex to the first vertex with the same position.
+	std::vector<uint32_t> position_remap(std::span<const float> vertices, size_t floatsPerVertex, size_t vertexCount) {
+		std::unordered_map<uint32_t, uint32_t, PositionHash, PositionEqual> firstAt(
+			vertexCount, PositionHash{ vertices, floatsPerVertex }, PositionEqual{ vertices, floatsPerVertex });
+
+		std::vector<uint32_t> remap(vertexCount);
+		for (uint32_t i = 0; i < vertexCount; ++i) {
+			remap[i] = firstAt.try_emplace(i, i).first->second;
+		}
+		return remap;
+	}
+
+	// Triangles around each vertex, rebuilt after every pass.
+	void build_adjacency(const std::vector<uint32_t>& indices, size_t vertexCount, std::vector<uint32_t>& offsets, std::vector<uint32_t>& triangles) {
+		offsets.assign(vertexCount + 1, 0);
+		for (uint32_t index : indices) offsets[index + 1]++;
+		for (size_t i = 0; i < vertexCount; ++i) offsets[i + 1] += offsets[i];
+
+		triangles.resize(indices.size());
+		std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+		for (size_t i = 0; i < indices.size(); ++i) {
+			triangles[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+		}
+	}
+
+	float attribute_distance_squared(std::span<const float> vertices, size_t floatsPerVertex, uint32_t a, uint32_t b) {
+		const float* pa = vertices.data() + size_t(a) * floatsPerVertex;
+		const float* pb = vertices.data() + size_t(b) * floatsPerVertex;
+		float sum = 0.0f;
+		for (size_t i = 3; i < floatsPerVertex; ++i) sum += (pa[i] - pb[i]) * (pa[i] - pb[i]);
+		return sum;
+	}
+}
+
+std::vector<uint32_t> vkMesh::simplify(std::span<const uint32_t> indices, std::span<const float> vertices, size_t floatsPerVertex,
+	size_t targetIndexCount, const SimplifyOptions& options, float* resultError)
+{
+	std::vector<uint32_t> result(indices.begin(), indices.end());
+	size_t vertexCount = vertices.size() / floatsPerVertex;
+	double worst = 0.0;
+
+	std::vector<uint32_t> remap = position_remap(vertices, floatsPerVertex, vertexCount);
+
+	// seams: more than one vertex at a position
+	std::vector<uint32_t> wedges(vertexCount, 0);
+	for (uint32_t i = 0; i < vertexCount; ++i) wedges[remap[i]]++;
+
+	// open borders: position edges used by a single triangle
+	std::vector<uint8_t> locked(vertexCount, 0);
+	{
+		std::unordered_map<uint64_t, uint32_t> edgeUses;
+		edgeUses.reserve(result.size());
+		for (size_t i = 0; i < result.size(); i += 3) {
+			for (int corner = 0; corner < 3; ++corner) {
+				uint32_t a = remap[result[i + corner]], b = remap[result[i + (corner + 1) % 3]];
+				if (a > b) std::swap(a, b);
+				edgeUses[(uint64_t(a) << 32) | b]++;
+			}
+		}
+		for (const auto& [edge, uses] : edgeUses) {
+			if (uses != 1) continue;
+			locked[edge >> 32] = 1;
+			locked[edge & 0xFFFFFFFFu] = 1;
+		}
+	}
+	for (uint32_t i = 0; i < vertexCount; ++i) {
+		if (wedges[remap[i]] > 1 || locked[remap[i]]) locked[i] = 1;
+	}
+
+	// plane quadrics gathered per position
+	std::vector<Quadric> quadrics(vertexCount);
+	for (size_t i = 0; i < result.size(); i += 3) {
+		glm::vec3 a = position(vertices, floatsPerVertex, result[i]);
+		glm::vec3 b = position(vertices, floatsPerVertex, result[i + 1]);
+		glm::vec3 c = position(vertices, floatsPerVertex, result[i + 2]);
+		glm::vec3 normal = glm::cross(b - a, c - a);
+		float area = glm::length(normal);
+		if (area == 0.0f) continue;
+		normal /= area;
+		for (int corner = 0; corner < 3; ++corner) {
+			quadrics[remap[result[i + corner]]].add_plane(normal, -glm::dot(normal, a), area);
+		}
+	}
+
+	double maxCost = double(options.maxError) * options.maxError;
+	double attributeWeight = double(options.attributeWeight) * options.attributeWeight;
+
+	std::vector<uint32_t> offsets, adjacency;
+	std::vector<Collapse> candidates;
+	std::vector<uint32_t> collapseTo(vertexCount);
+	std::vector<uint8_t> touched(vertexCount);
+
+	while (result.size() > targetIndexCount) {
+		build_adjacency(result, vertexCount, offsets, adjacency);
+
+		candidates.clear();
+		for (size_t i = 0; i < result.size(); i += 3) {
+			for (int corner = 0; corner < 3; ++corner) {
+				uint32_t a = result[i + corner], b = result[i + (corner + 1) % 3];
+				for (int direction = 0; direction < 2; ++direction, std::swap(a, b)) {
+					if (locked[a] || remap[a] == remap[b]) continue;
+					Quadric quadric = quadrics[remap[a]];
+					quadric.add(quadrics[remap[b]]);
+					double cost = quadric.error(position(vertices, floatsPerVertex, b))
+						+ attributeWeight * attribute_distance_squared(vertices, floatsPerVertex, a, b);
+					candidates.push_back({ a, b, cost });
+				}
+			}
+		}
+		std::sort(candidates.begin(), candidates.end(), [](const Collapse& x, const Collapse& y) { return x.cost < y.cost; });
+
+		for (uint32_t i = 0; i < vertexCount; ++i) collapseTo[i] = i;
+		std::fill(touched.begin(), touched.end(), 0);
+
+		size_t triangleCount = result.size() / 3;
+		size_t targetTriangles = targetIndexCount / 3;
+		size_t collapses = 0;
+
+		for (const auto& collapse : candidates) {
+			if (collapse.cost > maxCost || triangleCount <= targetTriangles) break;
+			if (touched[remap[collapse.from]] || touched[remap[collapse.to]]) continue;
+
+			// reject collapses that would flip a surviving triangle
+			glm::vec3 target = position(vertices, floatsPerVertex, collapse.to);
+			bool flips = false;
+			size_t removed = 0;
+			for (uint32_t k = offsets[collapse.from]; k < offsets[collapse.from + 1] && !flips; ++k) {
+				const uint32_t* triangle = &result[size_t(adjacency[k]) * 3];
+				bool hasTarget = false;
+				glm::vec3 before[3], after[3];
+				for (int corner = 0; corner < 3; ++corner) {
+					hasTarget |= remap[triangle[corner]] == remap[collapse.to];
+					before[corner] = position(vertices, floatsPerVertex, triangle[corner]);
+					after[corner] = triangle[corner] == collapse.from ? target : before[corner];
+				}
+				if (hasTarget) {
+					removed++;
+					continue;
+				}
+				glm::vec3 oldNormal = glm::cross(before[1] - before[0], before[2] - before[0]);
+				glm::vec3 newNormal = glm::cross(after[1] - after[0], after[2] - after[0]);
+				flips = glm::dot(oldNormal, newNormal) <= 0.0f;
+			}
+			if (flips) continue;
+
+			collapseTo[collapse.from] = collapse.to;
+			quadrics[remap[collapse.to]].add(quadrics[remap[collapse.from]]);
+			worst = std::max(worst, collapse.cost);
+			triangleCount -= removed;
+			collapses++;
+
+			// the adjacency around both ends is stale until the next pass
+			for (uint32_t k = offsets[collapse.from]; k < offsets[collapse.from + 1]; ++k) {
+				const uint32_t* triangle = &result[size_t(adjacency[k]) * 3];
+				for (int corner = 0; corner < 3; ++corner) touched[remap[triangle[corner]]] = 1;
+			}
+		}
+		if (collapses == 0) break;
+
+		size_t write = 0;
+		for (size_t i = 0; i < result.size(); i += 3) {
+			uint32_t a = collapseTo[result[i]], b = collapseTo[result[i + 1]], c = collapseTo[result[i + 2]];
+			if (remap[a] == remap[b] || remap[b] == remap[c] || remap[a] == remap[c]) continue;
+			result[write++] = a;
+			result[write++] = b;
+			result[write++] = c;
+		}
+		result.resize(write);
+	}
+
+	if (resultError) *resultError = static_cast<float>(std::sqrt(worst));
+	return result;
+}
+
+void vkMesh::build_lod_chain(ObjMesh& mesh, const LodOptions& options)
+{
+	uint32_t baseCount = static_cast<uint32_t>(mesh.indices.size());
+	mesh.lods.clear();
+	mesh.lods.push_back({ 0, baseCount, 0.0f });
+	if (baseCount == 0) return;
+
+	size_t vertexCount = mesh.vertices.size() / objFloatsPerVertex;
+	glm::vec3 low = position(mesh.vertices, objFloatsPerVertex, 0), high = low;
+	for (uint32_t i = 1; i < vertexCount; ++i) {
+		glm::vec3 p = position(mesh.vertices, objFloatsPerVertex, i);
+		low = glm::min(low, p);
+		high = glm::max(high, p);
+	}
+	float extent = glm::length(high - low);
+
+	SimplifyOptions simplifyOptions;
+	simplifyOptions.maxError = options.maxRelativeError * extent;
+	simplifyOptions.attributeWeight = options.attributeWeight * extent;
+
+	for (uint32_t level = 1; level < options.levelCount; ++level) {
+		const MeshLod previous = mesh.lods.back();
+		std::vector<uint32_t> source(mesh.indices.begin() + previous.firstIndex, mesh.indices.begin() + previous.firstIndex + previous.indexCount);
+		size_t target = size_t(previous.indexCount / 3 * options.reduction) * 3;
+
+		float error = 0.0f;
+		std::vector<uint32_t> simplified = simplify(source, mesh.vertices, objFloatsPerVertex, target, simplifyOptions, &error);
+		// a level that barely shrinks is not worth the memory
+		if (simplified.empty() || simplified.size() > previous.indexCount * 0.9) break;
+
+		optimize_vertex_cache(simplified, vertexCount);
+
+		uint32_t firstIndex = static_cast<uint32_t>(mesh.indices.size());
+		mesh.indices.insert(mesh.indices.end(), simplified.begin(), simplified.end());
+		// errors accumulate down the chain
+		mesh.lods.push_back({ firstIndex, static_cast<uint32_t>(simplified.size()), previous.error + error });
+	}
+}
+
+uint32_t vkMesh::select_lod(std::span<const MeshLod> lods, float distance, float pixelsPerUnit, float maxPixelError)
+{
+	uint32_t chosen = 0;
+	distance = std::max(distance, 1e-4f);
+	for (uint32_t level = 1; level < lods.size(); ++level) {
+		if (lods[level].error * pixelsPerUnit / distance > maxPixelError) break;
+		chosen = level;
+	}
+	return chosen;
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include "config.h"
+#include "obj_mesh.h"
+#include <limits>
+#include <span>
+
+namespace vkMesh {
+	struct SimplifyOptions {
+		// stop before any collapse costs more than this, in object-space units
+		float maxError = std::numeric_limits<float>::max();
+		// object-space error charged per unit of attribute (color, uv, normal)
+		// distance, so collapses across attribute gradients are saved for last
+		float attributeWeight = 0.01f;
+	};
+
+	struct LodOptions {
+		uint32_t levelCount = 4;
+		// triangle count of each level relative to the one before
+		float reduction = 0.5f;
+		// largest error any level may reach, relative to the mesh extent
+		float maxRelativeError = 0.05f;
+		float attributeWeight = 0.01f;
+	};
+
+	// Quadric error metric edge-collapse simplification (Garland & Heckbert)
+	// towards targetIndexCount. Vertices only ever collapse onto neighbouring
+	// vertices, so the result indexes the same vertex buffer. Open borders
+	// and attribute seams (several vertices sharing a position) are locked.
+	// resultError receives the largest accepted collapse error.
+	std::vector<uint32_t> simplify(std::span<const uint32_t> indices, std::span<const float> vertices, size_t floatsPerVertex,
+		size_t targetIndexCount, const SimplifyOptions& options, float* resultError = nullptr);
+
+	// Appends up to levelCount - 1 simplified levels after the LOD 0 indices
+	// and fills mesh.lods. The chain ends early once a level no longer
+	// shrinks. Run after optimize_mesh; each level is cache-optimized.
+	void build_lod_chain(ObjMesh& mesh, const LodOptions& options = {});
+
+	// Coarsest level whose error projects to at most maxPixelError pixels.
+	// pixelsPerUnit is the screen size of one unit at distance 1, i.e.
+	// viewportHeight / (2 * tan(fovY / 2)).
+	uint32_t select_lod(std::span<const MeshLod> lods, float distance, float pixelsPerUnit, float maxPixelError = 1.0f);
+}
@@ -0,0 +1,176 @@
+#include "meshlet.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+	glm::vec3 position(std::span<const float> vertices, size_t floatsPerVertex, uint32_t index) {
+		const float* p = vertices.data() + size_t(index) * floatsPerVertex;
+		return glm::vec3(p[0], p[1], p[2]);
+	}
+
+	// Ritter's approximate bounding sphere: start from two far-apart points,
+	// then grow the sphere over anything left outside.
+	void bounding_sphere(const std::vector<glm::vec3>& points, glm::vec3& center, float& radius) {
+		auto farthest = [&points](const glm::vec3& from) {
+			size_t best = 0;
+			float bestDistance = -1.0f;
+			for (size_t i = 0; i < points.size(); ++i) {
+				float distance = glm::length(points[i] - from);
+				if (distance > bestDistance) {
+					bestDistance = distance;
+					best = i;
+				}
+			}
+			return points[best];
+		};
+
+		glm::vec3 a = farthest(points[0]);
+		glm::vec3 b = farthest(a);
+		center = (a + b) * 0.5f;
+		radius = glm::length(b - a) * 0.5f;
+
+		for (const auto& point : points) {
+			float distance = glm::length(point - center);
+			if (distance <= radius) continue;
+			float grown = (radius + distance) * 0.5f;
+			center += (point - center) * ((grown - radius) / distance);
+			radius = grown;
+		}
+	}
+
+	vkMesh::Meshlet finish_meshlet(std::span<const uint32_t> indices, std::span<const float> vertices, size_t floatsPerVertex,
+		uint32_t firstIndex, uint32_t indexCount, const std::vector<uint32_t>& meshletVertices)
+	{
+		vkMesh::Meshlet meshlet;
+		meshlet.firstIndex = firstIndex;
+		meshlet.indexCount = indexCount;
+		meshlet.vertexCount = static_cast<uint32_t>(meshletVertices.size());
+
+		std::vector<glm::vec3> points;
+		points.reserve(meshletVertices.size());
+		for (uint32_t index : meshletVertices) points.push_back(position(vertices, floatsPerVertex, index));
+		bounding_sphere(points, meshlet.center, meshlet.radius);
+
+		// area-weighted average normal as the axis, widest deviation as the spread
+		std::vector<glm::vec3> normals;
+		glm::vec3 axis(0.0f);
+		for (uint32_t i = firstIndex; i < firstIndex + indexCount; i += 3) {
+			glm::vec3 a = position(vertices, floatsPerVertex, indices[i]);
+			glm::vec3 b = position(vertices, floatsPerVertex, indices[i + 1]);
+			glm::vec3 c = position(vertices, floatsPerVertex, indices[i + 2]);
+			glm::vec3 normal = glm::cross(b - a, c - a);
+			float area = glm::length(normal);
+			if (area == 0.0f) continue;
+			axis += normal;
+			normals.push_back(normal / area);
+		}
+
+		meshlet.coneAxis = glm::vec3(0.0f);
+		meshlet.coneCutoff = 1.0f;
+		float axisLength = glm::length(axis);
+		if (axisLength == 0.0f) return meshlet;
+		axis /= axisLength;
+
+		float minimumDot = 1.0f;
+		for (const auto& normal : normals) minimumDot = std::min(minimumDot, glm::dot(axis, normal));
+
+		meshlet.coneAxis = axis;
+		// a spread of 90 degrees or more faces every direction
+		if (minimumDot > 0.0f) meshlet.coneCutoff = std::sqrt(1.0f - minimumDot * minimumDot);
+		return meshlet;
+	}
+}
+
+std::vector<vkMesh::Meshlet> vkMesh::build_meshlets(std::span<const uint32_t> indices, std::span<const float> vertices, size_t floatsPerVertex, const MeshletLimits& limits)
+{
+	std::vector<Meshlet> meshlets;
+	size_t vertexCount = vertices.size() / floatsPerVertex;
+	if (indices.empty() || vertexCount == 0) return meshlets;
+
+	// marks which meshlet last referenced each vertex, so membership is O(1)
+	std::vector<uint32_t> stamp(vertexCount, UINT32_MAX);
+	std::vector<uint32_t> meshletVertices;
+	meshletVertices.reserve(limits.maxVertices);
+
+	uint32_t firstIndex = 0;
+	uint32_t triangleCount = 0;
+	uint32_t meshletId = 0;
+
+	for (uint32_t i = 0; i < indices.size(); i += 3) {
+		int newVertices = 0;
+		for (int corner = 0; corner < 3; ++corner) {
+			if (stamp[indices[i + corner]] != meshletId) newVertices++;
+		}
+
+		if (meshletVertices.size() + newVertices > limits.maxVertices || triangleCount + 1 > limits.maxTriangles) {
+			meshlets.push_back(finish_meshlet(indices, vertices, floatsPerVertex, firstIndex, triangleCount * 3, meshletVertices));
+			meshletVertices.clear();
+			firstIndex = i;
+			triangleCount = 0;
+			meshletId++;
+		}
+
+		for (int corner = 0; corner < 3; ++corner) {
+			uint32_t index = indices[i + corner];
+			if (stamp[index] == meshletId) continue;
+			stamp[index] = meshletId;
+			meshletVertices.push_back(index);
+		}
+		triangleCount++;
+	}
+	meshlets.push_back(finish_meshlet(indices, vertices, floatsPerVertex, firstIndex, triangleCount * 3, meshletVertices));
+
+	return meshlets;
+}
+
+vkMesh::MeshletStats vkMesh::analyze_meshlets(std::span<const Meshlet> meshlets)
+{
+	MeshletStats stats{ meshlets.size(), 0.0f, 0.0f };
+	if (meshlets.empty()) return stats;
+
+	size_t vertexCount = 0, triangleCount = 0;
+	for (const auto& meshlet : meshlets) {
+		vertexCount += meshlet.vertexCount;
+		triangleCount += meshlet.indexCount / 3;
+	}
+	stats.averageVertices = float(vertexCount) / meshlets.size();
+	stats.averageTriangles = float(triangleCount) / meshlets.size();
+	return stats;
+}
+
+bool vkMesh::cone_culled(const Meshlet& meshlet, const glm::vec3& cameraPosition)
+{
+	glm::vec3 toCenter = meshlet.center - cameraPosition;
+	return glm::dot(toCenter, meshlet.coneAxis) >= meshlet.coneCutoff * glm::length(toCenter) + meshlet.radius;
+}
+
+vkMesh::MeshVolume vkMesh::mesh_volume(std::span<const float> vertices, size_t floatsPerVertex)
+{
+	size_t vertexCount = vertices.size() / floatsPerVertex;
+	if (vertexCount == 0) return { glm::vec3(0.0f), 0.0f, glm::vec3(0.0f) };
+
+	glm::vec3 low = position(vertices, floatsPerVertex, 0), high = low;
+	for (uint32_t i = 1; i < vertexCount; ++i) {
+		glm::vec3 point = position(vertices, floatsPerVertex, i);
+		low = glm::min(low, point);
+		high = glm::max(high, point);
+	}
+
+	MeshVolume volume = mesh_volume(low, high);
+	// usually well inside the box's corners
+	float radius = 0.0f;
+	for (uint32_t i = 0; i < vertexCount; ++i) {
+		radius = std::max(radius, glm::length(position(vertices, floatsPerVertex, i) - volume.center));
+	}
+	volume.radius = radius;
+	return volume;
+}
+
+vkMesh::MeshVolume vkMesh::mesh_volume(glm::vec3 low, glm::vec3 high)
+{
+	MeshVolume volume;
+	volume.center = (low + high) * 0.5f;
+	volume.extent = (high - low) * 0.5f;
+	volume.radius = glm::length(volume.extent);
+	return volume;
+}
@@ -0,0 +1,57 @@
+#pragma once
+#include "config.h"
+#include <span>
+
+namespace vkMesh {
+	struct MeshletLimits {
+		uint32_t maxVertices = 64;
+		uint32_t maxTriangles = 124;
+	};
+
+	// A run of consecutive triangles in the index buffer plus the bounds a
+	// culling pass needs to reject it as a whole.
+	struct Meshlet {
+		glm::vec3 center;
+		float radius;
+
+		// Every triangle normal lies within the cone around coneAxis;
+		// coneCutoff is the sine of the spread and 1 disables cone culling.
+		glm::vec3 coneAxis;
+		float coneCutoff;
+
+		uint32_t firstIndex;
+		uint32_t indexCount;
+		uint32_t vertexCount;
+	};
+
+	struct MeshletStats {
+		size_t meshletCount;
+		float averageVertices;
+		float averageTriangles;
+	};
+
+	// Cuts the index buffer into meshlets in its current triangle order, so
+	// the ranges stay contiguous and the vertex cache order is kept. Runs
+	// after optimize_mesh, where that order already has good locality.
+	// Positions are the first three floats of every floatsPerVertex.
+	std::vector<Meshlet> build_meshlets(std::span<const uint32_t> indices, std::span<const float> vertices, size_t floatsPerVertex, const MeshletLimits& limits = {});
+
+	MeshletStats analyze_meshlets(std::span<const Meshlet> meshlets);
+
+	// True when the camera sees only back faces of the meshlet.
+	bool cone_culled(const Meshlet& meshlet, const glm::vec3& cameraPosition);
+
+	// Model-space bounds of a whole mesh, for culling its instances: a box,
+	// and a sphere around the box center that holds every vertex.
+	struct MeshVolume {
+		glm::vec3 center;
+		float radius;
+		// half the size of the box
+		glm::vec3 extent;
+	};
+
+	// Positions are the first three floats of every floatsPerVertex.
+	MeshVolume mesh_volume(std::span<const float> vertices, size_t floatsPerVertex);
+	// The box alone is known; the sphere encloses it.
+	MeshVolume mesh_volume(glm::vec3 low, glm::vec3 high);
+}
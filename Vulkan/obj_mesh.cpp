@@ -1,125 +1,262 @@
-
 #include "obj_mesh.h"
+#include "obj_parse.h"
+#include "mapped_file.h"
+#include "worker_pool.h"
 
-vkMesh::ObjMesh::ObjMesh(const char* objFilepath, const char* mtlFilepath, glm::mat4 preTransform)
-	:preTransform(preTransform)
-{
+using namespace vkMesh::obj;
+
+namespace {
+	// Below this size the split/merge overhead outweighs the parallel parse.
+	constexpr size_t minChunkSize = 1 << 20;
+
+	struct ChunkCorner {
+		vkMesh::CornerKey key;
+		uint8_t relative;
+	};
+
+	// Everything one worker pulls out of its slice of the .obj file.
+	// Faces are kept as triangulated, parsed corners so the merge only
+	// has to rebase relative indices and deduplicate in file order.
+	struct ObjChunk {
+		std::string_view text;
+		std::vector<glm::vec3> v, vn;
+		std::vector<glm::vec2> vt;
+		std::vector<ChunkCorner> corners;
+		// (corner position, material) for each usemtl in the chunk; corners
+		// before the first one inherit the previous chunk's material
+		std::vector<std::pair<size_t, uint32_t>> materialSwitches;
+		size_t vBase = 0, vtBase = 0, vnBase = 0;
+	};
 
-	std::ifstream file;
-	file.open(mtlFilepath);
-	std::string line;
-	std::string materialName;
-	std::vector<std::string> words;
+	void parse_chunk(ObjChunk& chunk, const vkMesh::ObjMesh& mesh) {
+		std::string_view text = chunk.text;
 
-	while (std::getline(file, line)) {
+		while (!text.empty()) {
+			std::string_view line = next_line(text);
+			std::string_view keyword = next_token(line);
 
-		words = split(line, " ");
+			if (keyword == "v") {
+				chunk.v.push_back(glm::vec3(mesh.preTransform * glm::vec4(parse_vec3(line), 1.0f)));
+			}
+			else if (keyword == "vt") {
+				float s = parse_float(next_token(line));
+				float t = parse_float(next_token(line));
+				chunk.vt.push_back(glm::vec2(s, t));
+			}
+			else if (keyword == "vn") {
+				chunk.vn.push_back(glm::vec3(mesh.preTransform * glm::vec4(parse_vec3(line), 0.0f)));
+			}
+			else if (keyword == "usemtl") {
+				chunk.materialSwitches.push_back({ chunk.corners.size(), mesh.find_material(next_token(line)) });
+			}
+			else if (keyword == "f") {
+				ChunkCorner corner[3];
+				auto read = [&](std::string_view description, ChunkCorner& out) {
+					out.key = parse_corner(description, chunk.v.size(), chunk.vt.size(), chunk.vn.size(), 0, out.relative);
+				};
 
-		if (!words[0].compare("newmtl")) {
-			materialName = words[1];
+				read(next_token(line), corner[0]);
+				read(next_token(line), corner[1]);
+				for (std::string_view current = next_token(line); !current.empty(); current = next_token(line)) {
+					read(current, corner[2]);
+					chunk.corners.push_back(corner[0]);
+					chunk.corners.push_back(corner[1]);
+					chunk.corners.push_back(corner[2]);
+					corner[1] = corner[2];
+				}
+			}
 		}
-		if (!words[0].compare("Kd")) {
-			brushColor = glm::vec3(std::stof(words[1]), std::stof(words[2]), std::stof(words[3]));
-			colors.insert({ materialName,brushColor });
+	}
+
+	// Rebases relative indices onto the merged arrays and stamps the
+	// material that was active for each corner.
+	void fix_up_chunk(ObjChunk& chunk, uint32_t startMaterial) {
+		uint32_t material = startMaterial;
+		auto materialSwitch = chunk.materialSwitches.begin();
+
+		for (size_t i = 0; i < chunk.corners.size(); ++i) {
+			for (; materialSwitch != chunk.materialSwitches.end() && materialSwitch->first == i; ++materialSwitch) {
+				material = materialSwitch->second;
+			}
+
+			auto& [key, relative] = chunk.corners[i];
+			if (relative & relativeV) key.v += static_cast<uint32_t>(chunk.vBase);
+			if (relative & relativeVt) key.vt += static_cast<uint32_t>(chunk.vtBase);
+			if (relative & relativeVn) key.vn += static_cast<uint32_t>(chunk.vnBase);
+			key.material = material;
 		}
 	}
+}
+
+vkMesh::ObjMesh::ObjMesh(const char* objFilepath, const char* mtlFilepath, glm::mat4 preTransform, vkUtil::WorkerPool* workers)
+	:preTransform(preTransform)
+{
+	vkUtil::MappedFile mtlFile(mtlFilepath);
+	read_material_data(mtlFile.view());
+
+	vkUtil::MappedFile objFile(objFilepath);
+	if (workers && workers->size() > 1 && objFile.view().size() >= 2 * minChunkSize) {
+		read_obj_data(objFile.view(), *workers);
+	}
+	else {
+		read_obj_data(objFile.view());
+	}
+}
 
-	file.close();
+void vkMesh::ObjMesh::read_material_data(std::string_view file) {
+	brushMaterial = read_material_library(file, materials, materialColors);
+}
 
-	file.open(objFilepath);
+uint32_t vkMesh::ObjMesh::find_material(std::string_view name) const {
+	auto material = materials.find(name);
+	return material != materials.end() ? material->second : 0;
+}
 
-	while (std::getline(file, line)) {
-		words = split(line, " ");
+void vkMesh::ObjMesh::read_obj_data(std::string_view file) {
+	while (!file.empty()) {
+		std::string_view line = next_line(file);
+		std::string_view keyword = next_token(line);
 
-		if (!words[0].compare("v")) {
-			read_vertex_data(words);
+		if (keyword == "v") {
+			read_vertex_data(line);
 		}
-		if (!words[0].compare("vt")) {
-			read_texcoord_data(words);
+		else if (keyword == "vt") {
+			read_texcoord_data(line);
 		}
-		if (!words[0].compare("vn")) {
-			read_normal_data(words);
+		else if (keyword == "vn") {
+			read_normal_data(line);
 		}
-		if (!words[0].compare("usemtl")) {
-			if (colors.contains(words[1])) {
-				brushColor = colors[words[1]];
-			}
-			else {
-				brushColor = glm::vec3(1.0f);
-			}
+		else if (keyword == "usemtl") {
+			brushMaterial = find_material(next_token(line));
+		}
+		else if (keyword == "f") {
+			read_face_data(line);
 		}
-		if (!words[0].compare("f")) {
-			read_face_data(words);
+	}
+}
+
+void vkMesh::ObjMesh::read_obj_data(std::string_view file, vkUtil::WorkerPool& workers) {
+	// split at line boundaries, a few chunks per worker to even out the load
+	size_t chunkCount = std::min(workers.size() * 4, std::max<size_t>(1, file.size() / minChunkSize));
+	std::vector<ObjChunk> chunks(chunkCount);
+
+	size_t start = 0;
+	for (size_t i = 0; i < chunkCount; ++i) {
+		size_t end = file.size();
+		if (i + 1 < chunkCount) {
+			end = std::max(start, file.size() * (i + 1) / chunkCount);
+			end = file.find('\n', end);
+			end = end == std::string_view::npos ? file.size() : end + 1;
 		}
+		chunks[i].text = file.substr(start, end - start);
+		start = end;
 	}
 
-	file.close();
+	workers.parallel_for(chunkCount, [&](size_t i) { parse_chunk(chunks[i], *this); });
+
+	// prefix sums give every chunk its offset in the merged arrays and the
+	// material that is active where it starts
+	size_t vCount = v.size(), vtCount = vt.size(), vnCount = vn.size(), cornerCount = 0;
+	std::vector<uint32_t> startMaterials(chunkCount);
+	uint32_t material = brushMaterial;
+	for (size_t i = 0; i < chunkCount; ++i) {
+		auto& chunk = chunks[i];
+		chunk.vBase = vCount;
+		chunk.vtBase = vtCount;
+		chunk.vnBase = vnCount;
+		vCount += chunk.v.size();
+		vtCount += chunk.vt.size();
+		vnCount += chunk.vn.size();
+		cornerCount += chunk.corners.size();
+
+		startMaterials[i] = material;
+		if (!chunk.materialSwitches.empty()) material = chunk.materialSwitches.back().second;
+	}
+	brushMaterial = material;
+
+	v.resize(vCount);
+	vt.resize(vtCount);
+	vn.resize(vnCount);
+	workers.parallel_for(chunkCount, [&](size_t i) {
+		auto& chunk = chunks[i];
+		std::copy(chunk.v.begin(), chunk.v.end(), v.begin() + chunk.vBase);
+		std::copy(chunk.vt.begin(), chunk.vt.end(), vt.begin() + chunk.vtBase);
+		std::copy(chunk.vn.begin(), chunk.vn.end(), vn.begin() + chunk.vnBase);
+		chunk.v = {};
+		chunk.vt = {};
+		chunk.vn = {};
+		fix_up_chunk(chunk, startMaterials[i]);
+	});
+
+	// deduplication hands out vertex indices in first-use order, so it
+	// stays serial to match read_corner
+	indices.reserve(indices.size() + cornerCount);
+	history.reserve(history.size() + v.size());
+	for (auto& chunk : chunks) {
+		for (const auto& corner : chunk.corners) add_corner(corner.key);
+		chunk.corners = {};
+	}
 }
 
-void vkMesh::ObjMesh::read_vertex_data(const std::vector<std::string>& words) {
-	glm::vec4 new_vertex = glm::vec4(std::stof(words[1]), std::stof(words[2]), std::stof(words[3]), 1.0f);
-	glm::vec3 transformed_vertex = glm::vec3(preTransform * new_vertex);
+void vkMesh::ObjMesh::read_vertex_data(std::string_view line) {
+	glm::vec3 transformed_vertex = glm::vec3(preTransform * glm::vec4(parse_vec3(line), 1.0f));
 	v.push_back(transformed_vertex);
 }
 
-void vkMesh::ObjMesh::read_texcoord_data(const std::vector<std::string>& words) {
-	glm::vec2 new_texcoord = glm::vec2(std::stof(words[1]), std::stof(words[2]));
-	vt.push_back(new_texcoord);
+void vkMesh::ObjMesh::read_texcoord_data(std::string_view line) {
+	float s = parse_float(next_token(line));
+	float t = parse_float(next_token(line));
+	vt.push_back(glm::vec2(s, t));
 }
 
-void vkMesh::ObjMesh::read_normal_data(const std::vector<std::string>& words) {
-	glm::vec4 new_normal = glm::vec4(std::stof(words[1]), std::stof(words[2]), std::stof(words[3]), 0.0f);
-	glm::vec3 transformed_normal = glm::vec3(preTransform * new_normal);
+void vkMesh::ObjMesh::read_normal_data(std::string_view line) {
+	glm::vec3 transformed_normal = glm::vec3(preTransform * glm::vec4(parse_vec3(line), 0.0f));
 	vn.push_back(transformed_normal);
 }
 
-void vkMesh::ObjMesh::read_face_data(const std::vector<std::string>& words) {
-
-	size_t triangleCount = words.size() - 3;
+void vkMesh::ObjMesh::read_face_data(std::string_view line) {
+	// triangle fan around the first corner
+	std::string_view first = next_token(line);
+	std::string_view previous = next_token(line);
 
-	for (int i = 0; i < triangleCount; ++i) {
-		read_corner(words[1]);
-		read_corner(words[2 + i]);
-		read_corner(words[3 + i]);
+	for (std::string_view current = next_token(line); !current.empty(); current = next_token(line)) {
+		read_corner(first);
+		read_corner(previous);
+		read_corner(current);
+		previous = current;
 	}
 }
 
-void vkMesh::ObjMesh::read_corner(const std::string& vertex_description) {
+void vkMesh::ObjMesh::read_corner(std::string_view vertex_description) {
+	uint8_t relative;
+	add_corner(parse_corner(vertex_description, v.size(), vt.size(), vn.size(), brushMaterial, relative));
+}
 
-	if (history.contains(vertex_description)) {
-		indices.push_back(history[vertex_description]);
-		return;
+void vkMesh::ObjMesh::add_corner(const CornerKey& corner) {
+
+	if (submeshes.empty() || submeshes.back().material != corner.material) {
+		submeshes.push_back({ static_cast<uint32_t>(indices.size()), 0, corner.material });
 	}
+	submeshes.back().indexCount++;
 
-	uint32_t index = static_cast<uint32_t>(history.size());
-	history.insert({ vertex_description, index });
+	uint32_t index;
+	bool known = history.find_or_insert(corner, index);
 	indices.push_back(index);
+	if (known) return;
 
+	FullVertex vertex;
+	vertex.position = v[corner.v];
+	vertex.color = materialColors[corner.material];
 
-	std::vector<std::string> v_vt_vn = split(vertex_description, "/");
-
-	//position
-	glm::vec3 pos = v[std::stol(v_vt_vn[0]) - 1];
-	vertices.push_back(pos[0]);
-	vertices.push_back(pos[1]);
-	vertices.push_back(pos[2]);
-
-	//color
-	vertices.push_back(brushColor.r);
-	vertices.push_back(brushColor.g);
-	vertices.push_back(brushColor.b);
+	vertex.texcoord = glm::vec2(0.0f, 0.0f);
+	if (corner.vt != CornerKey::noAttribute) {
+		vertex.texcoord = vt[corner.vt];
+	}
 
-	//texcoord
-	glm::vec2 texcoord = glm::vec2(0.0f, 0.0f);
-	if (v_vt_vn.size() == 3 && v_vt_vn[1].size() > 0) {
-		texcoord = vt[std::stol(v_vt_vn[1]) - 1];
+	vertex.normal = glm::vec3(0.0f);
+	if (corner.vn != CornerKey::noAttribute) {
+		vertex.normal = vn[corner.vn];
 	}
-	vertices.push_back(texcoord[0]);
-	vertices.push_back(texcoord[1]);
-
-	// normal
-	glm::vec3 normal = v[std::stol(v_vt_vn[2]) - 1];
-	vertices.push_back(normal[0]);
-	vertices.push_back(normal[1]);
-	vertices.push_back(normal[2]);
+
+	VertexWriter<FullVertex>(vertices).append(vertex);
 }
@@ -1,5 +1,12 @@
 #pragma once
 #include "config.h"
+#include "corner_dedup.h"
+#include "vertex_layout.h"
+#include <string_view>
+
+namespace vkUtil {
+	class WorkerPool;
+}
 
 namespace vkMesh {
 	enum class ColorID {
@@ -13,24 +20,62 @@ namespace vkMesh {
 		Z
 	};
 
+	// Lets the material map be probed with a std::string_view
+	// without building a temporary std::string.
+	struct StringViewHash {
+		using is_transparent = void;
+		size_t operator()(std::string_view text) const { return std::hash<std::string_view>{}(text); }
+	};
+
+	// material name -> index into the material color list; index 0 is the
+	// white fallback for unknown materials
+	using MaterialMap = std::unordered_map<std::string, uint32_t, StringViewHash, std::equal_to<>>;
+
+	// Run of indices drawn with one material, in index buffer order.
+	struct Submesh {
+		uint32_t firstIndex;
+		uint32_t indexCount;
+		uint32_t material;
+	};
+
+	// One level of detail: a run of indices over the shared vertices and the
+	// object-space error the simplifier accepted to get there.
+	struct MeshLod {
+		uint32_t firstIndex;
+		uint32_t indexCount;
+		float error;
+	};
+
 	class ObjMesh {
 	public:
 
 		std::vector<float> vertices;
 		std::vector<uint32_t> indices;
-		std::unordered_map<std::string, uint32_t> history;
-		std::unordered_map<std::string, glm::vec3> colors;
-		glm::vec3 brushColor;
+		std::vector<Submesh> submeshes;
+		// empty until build_lod_chain; LOD 0 is the submesh range
+		std::vector<MeshLod> lods;
+		CornerDedupTable history;
+
+		MaterialMap materials;
+		std::vector<glm::vec3> materialColors;
+		uint32_t brushMaterial;
 
 		std::vector<glm::vec3> v, vn;
 		std::vector<glm::vec2> vt;
 		glm::mat4 preTransform;
 
-		ObjMesh(const char* objFilePatth, const char* mtlFilePath, glm::mat4 preTransform);
-		void read_vertex_data(const std::vector<std::string>& words);
-		void read_texcoord_data(const std::vector<std::string>& words);
-		void read_normal_data(const std::vector<std::string>& words);
-		void read_face_data(const std::vector<std::string>& words);
-		void read_corner(const std::string& vertexDescription);
+		// With a worker pool, large .obj files are split at line boundaries and
+		// parsed in parallel; the result is identical to the serial path.
+		ObjMesh(const char* objFilePatth, const char* mtlFilePath, glm::mat4 preTransform, vkUtil::WorkerPool* workers = nullptr);
+		void read_material_data(std::string_view file);
+		void read_obj_data(std::string_view file);
+		void read_obj_data(std::string_view file, vkUtil::WorkerPool& workers);
+		void read_vertex_data(std::string_view line);
+		void read_texcoord_data(std::string_view line);
+		void read_normal_data(std::string_view line);
+		void read_face_data(std::string_view line);
+		void read_corner(std::string_view vertexDescription);
+		void add_corner(const CornerKey& corner);
+		uint32_t find_material(std::string_view name) const;
 	};
-}
\ No newline at end of file
+}
@@ -0,0 +1,115 @@
+#pragma once
+#include "config.h"
+#include "obj_mesh.h"
+#include <charconv>
+
+// Tokenizing and index resolution shared by the .obj readers
+// (vkMesh::ObjMesh and vkMesh::ObjStream).
+namespace vkMesh::obj {
+	inline bool is_blank(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+	inline std::string_view next_line(std::string_view& text) {
+		size_t end = text.find('\n');
+		if (end == std::string_view::npos) {
+			std::string_view line = text;
+			text = {};
+			return line;
+		}
+		std::string_view line = text.substr(0, end);
+		text.remove_prefix(end + 1);
+		return line;
+	}
+
+	inline std::string_view next_token(std::string_view& line) {
+		size_t start = 0;
+		while (start < line.size() && is_blank(line[start])) ++start;
+		size_t end = start;
+		while (end < line.size() && !is_blank(line[end])) ++end;
+		std::string_view token = line.substr(start, end - start);
+		line.remove_prefix(end);
+		return token;
+	}
+
+	inline float parse_float(std::string_view token) {
+		if (!token.empty() && token.front() == '+') token.remove_prefix(1);
+		float value = 0.0f;
+		std::from_chars(token.data(), token.data() + token.size(), value);
+		return value;
+	}
+
+	inline long parse_index(std::string_view token) {
+		if (!token.empty() && token.front() == '+') token.remove_prefix(1);
+		long value = 0;
+		std::from_chars(token.data(), token.data() + token.size(), value);
+		return value;
+	}
+
+	inline glm::vec3 parse_vec3(std::string_view line) {
+		float x = parse_float(next_token(line));
+		float y = parse_float(next_token(line));
+		float z = parse_float(next_token(line));
+		return glm::vec3(x, y, z);
+	}
+
+	// Bits of parse_corner's relative mask, one per attribute.
+	enum RelativeBits : uint8_t {
+		relativeV = 1,
+		relativeVt = 2,
+		relativeVn = 4
+	};
+
+	// Turns one 1-based (or negative, counted back from the attributes read
+	// so far) index into a 0-based one. Negative indices are flagged in
+	// relative so a chunk can later rebase them onto the merged arrays.
+	inline uint32_t resolve_index(std::string_view token, size_t count, uint8_t bit, uint8_t& relative) {
+		if (token.empty()) return vkMesh::CornerKey::noAttribute;
+		long index = parse_index(token);
+		if (index < 0) {
+			relative |= bit;
+			return static_cast<uint32_t>(static_cast<long>(count) + index);
+		}
+		return static_cast<uint32_t>(index - 1);
+	}
+
+	inline vkMesh::CornerKey parse_corner(std::string_view description, size_t vCount, size_t vtCount, size_t vnCount, uint32_t material, uint8_t& relative) {
+		std::string_view v_vt_vn[3];
+		size_t fieldCount = 0;
+		for (std::string_view rest = description; fieldCount < 3; ) {
+			size_t slash = rest.find('/');
+			v_vt_vn[fieldCount++] = rest.substr(0, slash);
+			if (slash == std::string_view::npos) break;
+			rest.remove_prefix(slash + 1);
+		}
+
+		relative = 0;
+		vkMesh::CornerKey corner;
+		corner.v = resolve_index(v_vt_vn[0], vCount, relativeV, relative);
+		corner.vt = resolve_index(v_vt_vn[1], vtCount, relativeVt, relative);
+		corner.vn = resolve_index(v_vt_vn[2], vnCount, relativeVn, relative);
+		corner.material = material;
+		return corner;
+	}
+
+	// Reads the Kd colors of a .mtl into materials/colors (colors[0] is the
+	// white fallback) and returns the material faces use before the first
+	// usemtl: the last color the .mtl declared.
+	inline uint32_t read_material_library(std::string_view file, MaterialMap& materials, std::vector<glm::vec3>& colors) {
+		std::string_view materialName;
+		colors = { glm::vec3(1.0f) };
+
+		while (!file.empty()) {
+			std::string_view line = next_line(file);
+			std::string_view keyword = next_token(line);
+
+			if (keyword == "newmtl") {
+				materialName = next_token(line);
+			}
+			else if (keyword == "Kd") {
+				colors.push_back(parse_vec3(line));
+				materials.emplace(materialName, static_cast<uint32_t>(colors.size() - 1));
+			}
+		}
+
+		return static_cast<uint32_t>(colors.size() - 1);
+	}
+}
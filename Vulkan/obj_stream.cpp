@@ -0,0 +1,253 @@
+#include "obj_stream.h"
+#include "obj_parse.h"
+#include "mapped_file.h"
+#include <atomic>
+#include <filesystem>
+#include <cstring>
+
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+using namespace vkMesh::obj;
+
+namespace {
+	enum SpillID {
+		spillV,
+		spillVt,
+		spillVn
+	};
+
+	constexpr size_t maxSpillBufferSize = 64 << 10;
+
+	// Buffered binary writer for one attribute array.
+	class SpillWriter {
+	public:
+		SpillWriter(const std::string& path, size_t bufferSize) : file(path, std::ios::binary), bufferSize(bufferSize) {
+			buffer.reserve(bufferSize);
+		}
+		~SpillWriter() { flush(); }
+
+		template<typename T>
+		void append(const T& value) {
+			if (buffer.size() + sizeof(T) > bufferSize) flush();
+			const char* bytes = reinterpret_cast<const char*>(&value);
+			buffer.insert(buffer.end(), bytes, bytes + sizeof(T));
+		}
+
+		void flush() {
+			file.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+			buffer.clear();
+		}
+
+	private:
+		std::ofstream file;
+		size_t bufferSize;
+		std::vector<char> buffer;
+	};
+
+	// Out of range indices (broken files) read as zero, like a missing attribute.
+	template<typename T>
+	T read_attribute(const vkUtil::MappedFile& file, uint32_t index) {
+		T value{};
+		std::string_view data = file.view();
+		size_t offset = static_cast<size_t>(index) * sizeof(T);
+		if (index != vkMesh::CornerKey::noAttribute && offset + sizeof(T) <= data.size()) {
+			std::memcpy(&value, data.data() + offset, sizeof(T));
+		}
+		return value;
+	}
+
+	unsigned long process_id() {
+#ifdef _WIN32
+		return static_cast<unsigned long>(_getpid());
+#else
+		return static_cast<unsigned long>(getpid());
+#endif
+	}
+
+	// <name>.<process>.<stream>, so streams of the same file, in this process
+	// or another, never share spill files in the temp directory
+	std::string spill_stem(const char* objFilepath) {
+		static std::atomic<uint32_t> streamCount{ 0 };
+		std::string name = std::filesystem::path(objFilepath).filename().string()
+			+ "." + std::to_string(process_id()) + "." + std::to_string(streamCount++);
+		std::error_code error;
+		std::filesystem::path directory = std::filesystem::temp_directory_path(error);
+		if (error) directory = std::filesystem::path(objFilepath).parent_path();
+		return (directory / name).string();
+	}
+}
+
+vkMesh::ObjStream::ObjStream(const char* objFilepath, const char* mtlFilepath, glm::mat4 preTransform, const StreamingOptions& options)
+	: low(0.0f), high(0.0f), options(options)
+{
+	vkUtil::MappedFile mtlFile(mtlFilepath);
+	startMaterial = read_material_library(mtlFile.view(), materials, materialColors);
+
+	objFile = std::make_unique<vkUtil::MappedFile>(objFilepath);
+	if (!objFile->is_open()) return;
+
+	std::string stem = spill_stem(objFilepath);
+	spillPaths[spillV] = stem + ".v.spill";
+	spillPaths[spillVt] = stem + ".vt.spill";
+	spillPaths[spillVn] = stem + ".vn.spill";
+	spill_attributes(preTransform);
+
+	opened = true;
+	for (int i = 0; i < 3; ++i) {
+		spills[i] = std::make_unique<vkUtil::MappedFile>(spillPaths[i].c_str());
+		opened = opened && spills[i]->is_open();
+	}
+}
+
+vkMesh::ObjStream::~ObjStream()
+{
+	for (int i = 0; i < 3; ++i) {
+		spills[i].reset();
+		if (spillPaths[i].empty()) continue;
+		std::error_code error;
+		std::filesystem::remove(spillPaths[i], error);
+	}
+}
+
+void vkMesh::ObjStream::spill_attributes(glm::mat4 preTransform)
+{
+	// the write buffers come out of the block budget, blocks only exist later
+	size_t bufferSize = std::clamp<size_t>(options.block_bytes() / 3, sizeof(glm::vec3), maxSpillBufferSize);
+	SpillWriter writers[3] = {
+		SpillWriter(spillPaths[spillV], bufferSize),
+		SpillWriter(spillPaths[spillVt], bufferSize),
+		SpillWriter(spillPaths[spillVn], bufferSize)
+	};
+	peakBytes = 3 * bufferSize;
+
+	bool first = true;
+	std::string_view file = objFile->view();
+	while (!file.empty()) {
+		std::string_view line = next_line(file);
+		std::string_view keyword = next_token(line);
+
+		if (keyword == "v") {
+			glm::vec3 position = glm::vec3(preTransform * glm::vec4(parse_vec3(line), 1.0f));
+			writers[spillV].append(position);
+			low = first ? position : glm::min(low, position);
+			high = first ? position : glm::max(high, position);
+			first = false;
+		}
+		else if (keyword == "vt") {
+			float s = parse_float(next_token(line));
+			float t = parse_float(next_token(line));
+			writers[spillVt].append(glm::vec2(s, t));
+		}
+		else if (keyword == "vn") {
+			writers[spillVn].append(glm::vec3(preTransform * glm::vec4(parse_vec3(line), 0.0f)));
+		}
+		else if (keyword == "f") {
+			// triangle fan, as in ObjMesh::read_face_data
+			size_t cornerCount = 0;
+			while (!next_token(line).empty()) ++cornerCount;
+			if (cornerCount >= 3) indexCount += (cornerCount - 2) * 3;
+		}
+	}
+}
+
+vkMesh::ObjStreamStats vkMesh::ObjStream::emit(const std::function<void(const MeshBlock&)>& sink)
+{
+	ObjStreamStats stats{};
+	if (!opened) return stats;
+
+	// indices handed out by the window are offset by the vertices emitted
+	// before its last restart
+	CornerDedupTable window;
+	size_t windowCapacity = CornerDedupTable::capacity_for(options.window_bytes());
+	window.reserve(windowCapacity);
+	size_t windowBase = 0;
+
+	// half of the block budget each, in whole vertices
+	size_t blockFloats = std::max<size_t>(1, options.block_bytes() / 2 / sizeof(FullVertex)) * fullVertexFloats;
+	size_t blockIndices = std::max<size_t>(3, options.block_bytes() / 2 / sizeof(uint32_t));
+	std::vector<float> vertices;
+	std::vector<uint32_t> indices;
+	vertices.reserve(blockFloats);
+	indices.reserve(blockIndices);
+	peakBytes = std::max(peakBytes, window.memory_bytes() + blockFloats * sizeof(float) + blockIndices * sizeof(uint32_t));
+
+	size_t vertexCount = 0, blockFirstVertex = 0, blockFirstIndex = 0;
+	auto flush = [&]() {
+		if (vertices.empty() && indices.empty()) return;
+		sink({ vertices, indices, blockFirstVertex, blockFirstIndex });
+		blockFirstVertex += VertexWriter<FullVertex>::vertex_count(vertices);
+		blockFirstIndex += indices.size();
+		vertices.clear();
+		indices.clear();
+		++stats.blockCount;
+	};
+
+	auto add_corner = [&](const CornerKey& corner) {
+		if (window.size() >= windowCapacity) {
+			window.clear();
+			windowBase = vertexCount;
+			++stats.windowResets;
+		}
+		if (indices.size() == blockIndices || vertices.size() + fullVertexFloats > blockFloats) flush();
+
+		uint32_t index;
+		bool known = window.find_or_insert(corner, index);
+		indices.push_back(static_cast<uint32_t>(windowBase + index));
+		if (known) return;
+
+		FullVertex vertex;
+		vertex.position = read_attribute<glm::vec3>(*spills[spillV], corner.v);
+		vertex.color = materialColors[corner.material];
+		vertex.texcoord = read_attribute<glm::vec2>(*spills[spillVt], corner.vt);
+		vertex.normal = read_attribute<glm::vec3>(*spills[spillVn], corner.vn);
+		VertexWriter<FullVertex>(vertices).append(vertex);
+		++vertexCount;
+	};
+
+	uint32_t material = startMaterial;
+	size_t vCount = 0, vtCount = 0, vnCount = 0;
+	std::string_view file = objFile->view();
+	while (!file.empty()) {
+		std::string_view line = next_line(file);
+		std::string_view keyword = next_token(line);
+
+		if (keyword == "v") {
+			++vCount;
+		}
+		else if (keyword == "vt") {
+			++vtCount;
+		}
+		else if (keyword == "vn") {
+			++vnCount;
+		}
+		else if (keyword == "usemtl") {
+			auto found = materials.find(next_token(line));
+			material = found != materials.end() ? found->second : 0;
+		}
+		else if (keyword == "f") {
+			uint8_t relative;
+			auto corner = [&](std::string_view description) {
+				return parse_corner(description, vCount, vtCount, vnCount, material, relative);
+			};
+
+			std::string_view first = next_token(line);
+			std::string_view previous = next_token(line);
+			for (std::string_view current = next_token(line); !current.empty(); current = next_token(line)) {
+				add_corner(corner(first));
+				add_corner(corner(previous));
+				add_corner(corner(current));
+				previous = current;
+			}
+		}
+	}
+	flush();
+
+	stats.vertexCount = vertexCount;
+	stats.indexCount = blockFirstIndex;
+	stats.peakBytes = peakBytes;
+	return stats;
+}
@@ -0,0 +1,87 @@
+#pragma once
+#include "config.h"
+#include "obj_mesh.h"
+#include <functional>
+#include <memory>
+#include <span>
+
+namespace vkUtil {
+	class MappedFile;
+}
+
+namespace vkMesh {
+	struct StreamingOptions {
+		// Host memory a streamed import may hold at once: half of it is the
+		// dedup window and half the blocks. Staging is not part of it, blocks
+		// go through the engine's shared ring of stagingRingSize bytes.
+		size_t memoryBudget = size_t(64) << 20;
+		// .obj files at least this large are streamed instead of imported whole
+		uintmax_t minFileSize = uintmax_t(256) << 20;
+
+		size_t window_bytes() const { return memoryBudget / 2; }
+		size_t block_bytes() const { return memoryBudget / 2; }
+	};
+
+	// Finished vertices (FullVertex floats) and indices, to be placed at
+	// firstVertex/firstIndex within the mesh. Indices are mesh-relative and
+	// may point at vertices handed out in earlier blocks.
+	struct MeshBlock {
+		std::span<const float> vertices;
+		std::span<const uint32_t> indices;
+		size_t firstVertex, firstIndex;
+	};
+
+	struct ObjStreamStats {
+		size_t vertexCount, indexCount;
+		size_t blockCount;
+		// times the dedup window filled up and started over; corners seen
+		// before a restart are emitted again as new vertices
+		size_t windowResets;
+		// most bytes held at once, not counting the mapped files
+		size_t peakBytes;
+	};
+
+	// Two-pass .obj import whose host memory does not grow with the model.
+	// The constructor reads the file once, spilling v/vt/vn to temporary files
+	// and counting indices; emit() reads it again, resolves corners through
+	// mappings of those files (which the OS can page out), deduplicates them
+	// in a window of fixed size and hands out blocks as they fill up.
+	// Nothing is reordered, optimized or simplified.
+	class ObjStream {
+	public:
+		ObjStream(const char* objFilepath, const char* mtlFilepath, glm::mat4 preTransform, const StreamingOptions& options = {});
+		~ObjStream();
+
+		ObjStream(const ObjStream&) = delete;
+		ObjStream& operator=(const ObjStream&) = delete;
+
+		bool is_open() const { return opened; }
+		// exact, known after the first pass
+		size_t index_count() const { return indexCount; }
+		// every index could start a new vertex
+		size_t max_vertex_count() const { return indexCount; }
+		// at least one, the fallback color; bounds the distinct vertex colors
+		size_t material_count() const { return materialColors.size(); }
+
+		ObjStreamStats emit(const std::function<void(const MeshBlock&)>& sink);
+
+		// bounds of every position in the file
+		glm::vec3 low, high;
+
+	private:
+		StreamingOptions options;
+		bool opened = false;
+		size_t indexCount = 0;
+		size_t peakBytes = 0;
+
+		MaterialMap materials;
+		std::vector<glm::vec3> materialColors;
+		uint32_t startMaterial = 0;
+
+		std::unique_ptr<vkUtil::MappedFile> objFile;
+		std::string spillPaths[3];
+		std::unique_ptr<vkUtil::MappedFile> spills[3];
+
+		void spill_attributes(glm::mat4 preTransform);
+	};
+}
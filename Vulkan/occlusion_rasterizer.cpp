@@ -0,0 +1,462 @@
+#include "occlusion_rasterizer.h"
+#include "simd_lanes.h"
+#include <algorithm>
+#include <chrono>
+#include <cfloat>
+#include <cmath>
+
+namespace {
+	using namespace vkUtil::lanes;
+	using Clock = std::chrono::steady_clock;
+
+	double milliseconds_since(Clock::time_point start)
+	{
+		return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	}
+
+	glm::mat4 object_transform(const vkUtil::TransformStreams& objects, size_t object)
+	{
+		auto basis = rotation_scale(
+			objects.rotation[0][object], objects.rotation[1][object], objects.rotation[2][object], objects.rotation[3][object],
+			objects.scale[0][object], objects.scale[1][object], objects.scale[2][object]);
+
+		glm::mat4 model(1.0f);
+		for (int column = 0; column < 3; ++column) {
+			for (int row = 0; row < 3; ++row) model[column][row] = basis.m[column][row];
+		}
+		model[3] = glm::vec4(objects.position[0][object], objects.position[1][object], objects.position[2][object], 1.0f);
+		return model;
+	}
+
+	// Leaves the part of a clip-space triangle with z >= 0 in out, 0, 3 or 4
+	// vertices in order, and returns how many.
+	int clip_near(const glm::vec4 in[3], glm::vec4 out[4])
+	{
+		int count = 0;
+		for (int i = 0; i < 3; ++i) {
+			const glm::vec4& a = in[i];
+			const glm::vec4& b = in[(i + 1) % 3];
+			if (a.z >= 0.0f) out[count++] = a;
+			if ((a.z >= 0.0f) != (b.z >= 0.0f)) out[count++] = a + (b - a) * (a.z / (a.z - b.z));
+		}
+		return count;
+	}
+
+	// value(p) = stepY * (p.y - y) + stepX * (p.x - x), differences first so
+	// far-off vertices don't cost precision
+	struct Edge {
+		float stepX, stepY, x, y;
+	};
+
+	// A triangle clipped to a tile: the pixels [ix0, ix1] x [iy0, iy1] whose
+	// centers may be inside. Depth is the edges weighting z, over the area.
+	struct TriangleSetup {
+		Edge edges[3];
+		float z[3];
+		float inverseArea;
+		int ix0, ix1, iy0, iy1;
+	};
+
+	void rasterize_scalar(const TriangleSetup& triangle, float* depth, uint32_t stride)
+	{
+		for (int iy = triangle.iy0; iy <= triangle.iy1; ++iy) {
+			float py = iy + 0.5f;
+			float* row = depth + size_t(iy) * stride;
+			for (int ix = triangle.ix0; ix <= triangle.ix1; ++ix) {
+				float px = ix + 0.5f;
+				float weights[3];
+				for (int i = 0; i < 3; ++i) {
+					const Edge& edge = triangle.edges[i];
+					weights[i] = edge.stepY * (py - edge.y) + edge.stepX * (px - edge.x);
+				}
+				if (std::min({ weights[0], weights[1], weights[2] }) < 0.0f) continue;
+				float z = (weights[0] * triangle.z[0] + weights[1] * triangle.z[1] + weights[2] * triangle.z[2]) * triangle.inverseArea;
+				row[ix] = std::min(row[ix], z);
+			}
+		}
+	}
+
+	bool rect_hidden_scalar(const float* depth, uint32_t stride, int ix0, int ix1, int iy0, int iy1, float nearest)
+	{
+		for (int iy = iy0; iy <= iy1; ++iy) {
+			const float* row = depth + size_t(iy) * stride;
+			for (int ix = ix0; ix <= ix1; ++ix) {
+				if (row[ix] >= nearest) return false;
+			}
+		}
+		return true;
+	}
+
+#ifdef SIMD_LANES_X64
+	// Spans of 8 pixels from an 8-aligned x, which stay inside the tile
+	// since tiles and rows are 8-aligned too. Every span evaluates the edges
+	// as rasterize_scalar does rather than stepping them, so both paths
+	// write the same depths.
+	AVX_FUNCTION void rasterize_avx(const TriangleSetup& triangle, float* depth, uint32_t stride)
+	{
+		const __m256 zero = _mm256_setzero_ps();
+		const __m256 centers = _mm256_setr_ps(0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f);
+		int xs = triangle.ix0 & ~7;
+		__m256 z[3], stepX[3], edgeX[3];
+		for (int i = 0; i < 3; ++i) {
+			z[i] = _mm256_set1_ps(triangle.z[i]);
+			stepX[i] = _mm256_set1_ps(triangle.edges[i].stepX);
+			edgeX[i] = _mm256_set1_ps(triangle.edges[i].x);
+		}
+		__m256 inverseArea = _mm256_set1_ps(triangle.inverseArea);
+
+		for (int iy = triangle.iy0; iy <= triangle.iy1; ++iy) {
+			float py = iy + 0.5f;
+			__m256 rowWeights[3];
+			for (int i = 0; i < 3; ++i) {
+				const Edge& edge = triangle.edges[i];
+				rowWeights[i] = _mm256_set1_ps(edge.stepY * (py - edge.y));
+			}
+
+			float* row = depth + size_t(iy) * stride;
+			for (int x = xs; x <= triangle.ix1; x += 8) {
+				__m256 px = _mm256_add_ps(_mm256_set1_ps(static_cast<float>(x)), centers);
+				__m256 weights[3];
+				for (int i = 0; i < 3; ++i) weights[i] = _mm256_add_ps(rowWeights[i], _mm256_mul_ps(stepX[i], _mm256_sub_ps(px, edgeX[i])));
+				__m256 inside = _mm256_cmp_ps(_mm256_min_ps(weights[0], _mm256_min_ps(weights[1], weights[2])), zero, _CMP_GE_OQ);
+				if (_mm256_movemask_ps(inside)) {
+					__m256 pixelDepth = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(weights[0], z[0]), _mm256_mul_ps(weights[1], z[1])),
+						_mm256_mul_ps(weights[2], z[2])), inverseArea);
+					__m256 stored = _mm256_loadu_ps(row + x);
+					_mm256_storeu_ps(row + x, _mm256_blendv_ps(stored, _mm256_min_ps(stored, pixelDepth), inside));
+				}
+			}
+		}
+	}
+
+	AVX_FUNCTION bool rect_hidden_avx(const float* depth, uint32_t stride, int ix0, int ix1, int iy0, int iy1, float nearest)
+	{
+		const __m256 lanes = _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f);
+		__m256 low = _mm256_set1_ps(static_cast<float>(ix0)), high = _mm256_set1_ps(static_cast<float>(ix1));
+		__m256 nearestDepth = _mm256_set1_ps(nearest);
+		int xs = ix0 & ~7;
+		for (int iy = iy0; iy <= iy1; ++iy) {
+			const float* row = depth + size_t(iy) * stride;
+			for (int x = xs; x <= ix1; x += 8) {
+				__m256 laneX = _mm256_add_ps(_mm256_set1_ps(static_cast<float>(x)), lanes);
+				__m256 inRect = _mm256_and_ps(_mm256_cmp_ps(laneX, low, _CMP_GE_OQ), _mm256_cmp_ps(laneX, high, _CMP_LE_OQ));
+				__m256 behind = _mm256_cmp_ps(_mm256_loadu_ps(row + x), nearestDepth, _CMP_GE_OQ);
+				if (_mm256_movemask_ps(_mm256_and_ps(inRect, behind))) return false;
+			}
+		}
+		return true;
+	}
+#endif
+}
+
+vkUtil::OccluderMesh vkUtil::make_occluder(std::span<const float> vertices, size_t floatsPerVertex, std::span<const uint32_t> indices,
+	std::span<const vkMesh::MeshLod> lods, uint32_t maxTriangles)
+{
+	size_t first = 0, count = indices.size();
+	if (!lods.empty()) {
+		const vkMesh::MeshLod* chosen = &lods.back();
+		for (const auto& lod : lods) {
+			if (lod.indexCount / 3 <= maxTriangles) {
+				chosen = &lod;
+				break;
+			}
+		}
+		first = chosen->firstIndex;
+		count = chosen->indexCount;
+	}
+
+	OccluderMesh occluder;
+	std::vector<uint32_t> remap(vertices.size() / floatsPerVertex, UINT32_MAX);
+	occluder.indices.reserve(count);
+	for (uint32_t index : indices.subspan(first, count)) {
+		if (remap[index] == UINT32_MAX) {
+			remap[index] = static_cast<uint32_t>(occluder.positions.size());
+			const float* position = &vertices[index * floatsPerVertex];
+			occluder.positions.emplace_back(position[0], position[1], position[2]);
+		}
+		occluder.indices.push_back(remap[index]);
+	}
+	return occluder;
+}
+
+vkUtil::OcclusionRasterizer::OcclusionRasterizer(uint32_t width, uint32_t height, SimdPath simdPath)
+	: path(simdPath)
+{
+	resize(width, height);
+}
+
+void vkUtil::OcclusionRasterizer::resize(uint32_t width, uint32_t height)
+{
+	// rows stay a multiple of 8 pixels for the AVX spans
+	bufferWidth = occlusionBufferWidth;
+	bufferHeight = std::max(1u, static_cast<uint32_t>(std::lround(double(bufferWidth) * height / std::max(width, 1u))));
+	tilesX = (bufferWidth + occlusionTileWidth - 1) / occlusionTileWidth;
+	tilesY = (bufferHeight + occlusionTileHeight - 1) / occlusionTileHeight;
+	depthBuffer.assign(size_t(bufferWidth) * bufferHeight, 1.0f);
+	tileFarthest.assign(size_t(tilesX) * tilesY, 1.0f);
+	jobs.clear();
+}
+
+void vkUtil::OcclusionRasterizer::set_occluder(meshTypes type, OccluderMesh mesh)
+{
+	occluders[static_cast<size_t>(type)] = std::move(mesh);
+}
+
+void vkUtil::OcclusionRasterizer::clear_occluder(meshTypes type)
+{
+	occluders[static_cast<size_t>(type)] = {};
+}
+
+void vkUtil::OcclusionRasterizer::render(const glm::mat4& viewProjection, glm::vec3 eye, const TransformStreams& objects,
+	std::span<const meshTypes> types, std::span<const vkMesh::MeshVolume, meshTypeCount> volumes, const uint8_t* visible, WorkerPool* workers)
+{
+	auto start = Clock::now();
+	this->viewProjection = viewProjection;
+
+	// bounding sphere radius over distance
+	candidates.clear();
+	for (size_t object = 0; object < types.size(); ++object) {
+		size_t type = static_cast<size_t>(types[object]);
+		if (!visible[object] || occluders[type].indices.empty()) continue;
+		float scale = std::max({ std::abs(objects.scale[0][object]), std::abs(objects.scale[1][object]), std::abs(objects.scale[2][object]) });
+		glm::vec3 position(objects.position[0][object], objects.position[1][object], objects.position[2][object]);
+		float apparentSize = volumes[type].radius * scale / std::max(glm::distance(eye, position), 1e-4f);
+		candidates.emplace_back(apparentSize, static_cast<uint32_t>(object));
+	}
+	if (candidates.size() > maxOccluders) {
+		std::nth_element(candidates.begin(), candidates.begin() + maxOccluders, candidates.end(), std::greater<>());
+		candidates.resize(maxOccluders);
+	}
+
+	jobs.resize(candidates.size());
+	for (size_t i = 0; i < candidates.size(); ++i) jobs[i].object = candidates[i].second;
+	auto setup = [&](size_t i) { setup_triangles(jobs[i], objects, types[jobs[i].object]); };
+	auto rasterize = [&](size_t tile) { rasterize_tile(static_cast<uint32_t>(tile)); };
+	size_t tileCount = size_t(tilesX) * tilesY;
+	if (workers) {
+		workers->parallel_for(jobs.size(), setup);
+		workers->parallel_for(tileCount, rasterize);
+	}
+	else {
+		for (size_t i = 0; i < jobs.size(); ++i) setup(i);
+		for (size_t tile = 0; tile < tileCount; ++tile) rasterize(tile);
+	}
+
+	lastStats = {};
+	lastStats.occluders = jobs.size();
+	for (const auto& job : jobs) lastStats.triangles += job.triangles.size();
+	lastStats.rasterMilliseconds = milliseconds_since(start);
+}
+
+void vkUtil::OcclusionRasterizer::setup_triangles(OccluderJob& job, const TransformStreams& objects, meshTypes type)
+{
+	const OccluderMesh& mesh = occluders[static_cast<size_t>(type)];
+	glm::mat4 transform = viewProjection * object_transform(objects, job.object);
+
+	job.triangles.clear();
+	job.bins.resize(size_t(tilesX) * tilesY);
+	for (auto& bin : job.bins) bin.clear();
+	job.clipPositions.resize(mesh.positions.size());
+	for (size_t i = 0; i < mesh.positions.size(); ++i) job.clipPositions[i] = transform * glm::vec4(mesh.positions[i], 1.0f);
+
+	for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3) {
+		glm::vec4 corners[3] = {
+			job.clipPositions[mesh.indices[i]], job.clipPositions[mesh.indices[i + 1]], job.clipPositions[mesh.indices[i + 2]]
+		};
+		// entirely beyond one side of the view
+		bool outside = false;
+		for (int axis = 0; axis < 2 && !outside; ++axis) {
+			outside = (corners[0][axis] > corners[0].w && corners[1][axis] > corners[1].w && corners[2][axis] > corners[2].w)
+				|| (corners[0][axis] < -corners[0].w && corners[1][axis] < -corners[1].w && corners[2][axis] < -corners[2].w);
+		}
+		if (outside || (corners[0].z > corners[0].w && corners[1].z > corners[1].w && corners[2].z > corners[2].w)) continue;
+
+		glm::vec4 polygon[4];
+		int count = clip_near(corners, polygon);
+		if (count < 3) continue;
+
+		ScreenTriangle projected[2];
+		float screen[4][3];
+		for (int v = 0; v < count; ++v) {
+			float inverseW = 1.0f / polygon[v].w;
+			screen[v][0] = (polygon[v].x * inverseW * 0.5f + 0.5f) * bufferWidth;
+			screen[v][1] = (polygon[v].y * inverseW * 0.5f + 0.5f) * bufferHeight;
+			screen[v][2] = polygon[v].z * inverseW;
+		}
+		// a fan over the clipped polygon
+		for (int fan = 0; fan + 2 < count; ++fan) {
+			int order[3] = { 0, fan + 1, fan + 2 };
+			for (int v = 0; v < 3; ++v) {
+				projected[fan].x[v] = screen[order[v]][0];
+				projected[fan].y[v] = screen[order[v]][1];
+				projected[fan].z[v] = screen[order[v]][2];
+			}
+			bin_triangle(job, projected[fan]);
+		}
+	}
+}
+
+void vkUtil::OcclusionRasterizer::bin_triangle(OccluderJob& job, const ScreenTriangle& triangle)
+{
+	float area = (triangle.x[1] - triangle.x[0]) * (triangle.y[2] - triangle.y[0]) - (triangle.y[1] - triangle.y[0]) * (triangle.x[2] - triangle.x[0]);
+	if (!(std::abs(area) > 1e-6f)) return;
+
+	// pixels whose centers fall in the bounds
+	auto [lowX, highX] = std::minmax({ triangle.x[0], triangle.x[1], triangle.x[2] });
+	auto [lowY, highY] = std::minmax({ triangle.y[0], triangle.y[1], triangle.y[2] });
+	float ix0 = std::max(0.0f, std::ceil(lowX - 0.5f)), ix1 = std::min(float(bufferWidth - 1), std::floor(highX - 0.5f));
+	float iy0 = std::max(0.0f, std::ceil(lowY - 0.5f)), iy1 = std::min(float(bufferHeight - 1), std::floor(highY - 0.5f));
+	if (ix0 > ix1 || iy0 > iy1) return;
+
+	// counterclockwise, so the inside is where every edge is positive
+	uint32_t index = static_cast<uint32_t>(job.triangles.size());
+	job.triangles.push_back(triangle);
+	if (area < 0.0f) {
+		auto& stored = job.triangles.back();
+		std::swap(stored.x[1], stored.x[2]);
+		std::swap(stored.y[1], stored.y[2]);
+		std::swap(stored.z[1], stored.z[2]);
+	}
+
+	for (uint32_t ty = uint32_t(iy0) / occlusionTileHeight; ty <= uint32_t(iy1) / occlusionTileHeight; ++ty) {
+		for (uint32_t tx = uint32_t(ix0) / occlusionTileWidth; tx <= uint32_t(ix1) / occlusionTileWidth; ++tx) {
+			job.bins[ty * tilesX + tx].push_back(index);
+		}
+	}
+}
+
+void vkUtil::OcclusionRasterizer::rasterize_tile(uint32_t tile)
+{
+	int tileX0 = int(tile % tilesX * occlusionTileWidth), tileY0 = int(tile / tilesX * occlusionTileHeight);
+	int tileX1 = std::min(tileX0 + int(occlusionTileWidth), int(bufferWidth)) - 1;
+	int tileY1 = std::min(tileY0 + int(occlusionTileHeight), int(bufferHeight)) - 1;
+	for (int iy = tileY0; iy <= tileY1; ++iy) {
+		float* row = &depthBuffer[size_t(iy) * bufferWidth];
+		std::fill(row + tileX0, row + tileX1 + 1, 1.0f);
+	}
+
+	// in occluder order, so the result doesn't depend on the threads
+	for (const auto& job : jobs) {
+		for (uint32_t index : job.bins[tile]) {
+			const ScreenTriangle& triangle = job.triangles[index];
+			auto [lowX, highX] = std::minmax({ triangle.x[0], triangle.x[1], triangle.x[2] });
+			auto [lowY, highY] = std::minmax({ triangle.y[0], triangle.y[1], triangle.y[2] });
+
+			TriangleSetup setup;
+			setup.ix0 = std::max(tileX0, int(std::ceil(lowX - 0.5f)));
+			setup.ix1 = std::min(tileX1, int(std::floor(highX - 0.5f)));
+			setup.iy0 = std::max(tileY0, int(std::ceil(lowY - 0.5f)));
+			setup.iy1 = std::min(tileY1, int(std::floor(highY - 0.5f)));
+			if (setup.ix0 > setup.ix1 || setup.iy0 > setup.iy1) continue;
+
+			// edge i is opposite vertex i and weights its depth
+			for (int i = 0; i < 3; ++i) {
+				int a = (i + 1) % 3, b = (i + 2) % 3;
+				setup.edges[i] = { -(triangle.y[b] - triangle.y[a]), triangle.x[b] - triangle.x[a], triangle.x[a], triangle.y[a] };
+				setup.z[i] = triangle.z[i];
+			}
+			float area = (triangle.x[1] - triangle.x[0]) * (triangle.y[2] - triangle.y[0]) - (triangle.y[1] - triangle.y[0]) * (triangle.x[2] - triangle.x[0]);
+			setup.inverseArea = 1.0f / area;
+
+#ifdef SIMD_LANES_X64
+			if (path == SimdPath::AVX) {
+				rasterize_avx(setup, depthBuffer.data(), bufferWidth);
+				continue;
+			}
+#endif
+			rasterize_scalar(setup, depthBuffer.data(), bufferWidth);
+		}
+	}
+
+	float farthest = 0.0f;
+	for (int iy = tileY0; iy <= tileY1; ++iy) {
+		const float* row = &depthBuffer[size_t(iy) * bufferWidth];
+		farthest = std::max(farthest, *std::max_element(row + tileX0, row + tileX1 + 1));
+	}
+	tileFarthest[tile] = farthest;
+}
+
+bool vkUtil::OcclusionRasterizer::occluded(const glm::vec3 corners[8]) const
+{
+	float lowX = FLT_MAX, lowY = FLT_MAX, highX = -FLT_MAX, highY = -FLT_MAX;
+	float nearest = 1.0f;
+	for (int corner = 0; corner < 8; ++corner) {
+		glm::vec4 clip = viewProjection * glm::vec4(corners[corner], 1.0f);
+		// in front of the near plane, the box may cover anything
+		if (clip.w <= 0.0f || clip.z < 0.0f) return false;
+		float inverseW = 1.0f / clip.w;
+		float x = (clip.x * inverseW * 0.5f + 0.5f) * bufferWidth, y = (clip.y * inverseW * 0.5f + 0.5f) * bufferHeight;
+		lowX = std::min(lowX, x);
+		highX = std::max(highX, x);
+		lowY = std::min(lowY, y);
+		highY = std::max(highY, y);
+		nearest = std::min(nearest, clip.z * inverseW);
+	}
+
+	// every pixel the rectangle touches
+	int ix0 = std::max(0, int(std::floor(lowX))), ix1 = std::min(int(bufferWidth) - 1, int(std::ceil(highX)) - 1);
+	int iy0 = std::max(0, int(std::floor(lowY))), iy1 = std::min(int(bufferHeight) - 1, int(std::ceil(highY)) - 1);
+	if (ix0 > ix1 || iy0 > iy1) return false;
+
+	bool tilesHide = true;
+	for (int ty = iy0 / int(occlusionTileHeight); ty <= iy1 / int(occlusionTileHeight) && tilesHide; ++ty) {
+		for (int tx = ix0 / int(occlusionTileWidth); tx <= ix1 / int(occlusionTileWidth) && tilesHide; ++tx) {
+			tilesHide = tileFarthest[ty * tilesX + tx] < nearest;
+		}
+	}
+	if (tilesHide) return true;
+
+#ifdef SIMD_LANES_X64
+	if (path == SimdPath::AVX) return rect_hidden_avx(depthBuffer.data(), bufferWidth, ix0, ix1, iy0, iy1, nearest);
+#endif
+	return rect_hidden_scalar(depthBuffer.data(), bufferWidth, ix0, ix1, iy0, iy1, nearest);
+}
+
+size_t vkUtil::OcclusionRasterizer::cull_occluded(const TransformStreams& objects, std::span<const meshTypes> types,
+	std::span<const vkMesh::MeshVolume, meshTypeCount> volumes, uint8_t* visible, WorkerPool* workers)
+{
+	auto start = Clock::now();
+	size_t count = types.size();
+	// nothing drawn, nothing hidden
+	if (jobs.empty()) {
+		lastStats.testMilliseconds = 0.0;
+		return 0;
+	}
+
+	auto cull_range = [&](size_t first, size_t end) {
+		size_t rejected = 0;
+		for (size_t object = first; object < end; ++object) {
+			if (!visible[object]) continue;
+			const vkMesh::MeshVolume& volume = volumes[static_cast<size_t>(types[object])];
+			glm::mat4 model = object_transform(objects, object);
+			glm::vec3 corners[8];
+			for (int corner = 0; corner < 8; ++corner) {
+				glm::vec3 side = glm::vec3(corner & 1, (corner >> 1) & 1, (corner >> 2) & 1) * 2.0f - glm::vec3(1.0f);
+				corners[corner] = glm::vec3(model * glm::vec4(volume.center + side * volume.extent, 1.0f));
+			}
+			if (occluded(corners)) {
+				visible[object] = 0;
+				++rejected;
+			}
+		}
+		return rejected;
+	};
+
+	size_t rejected = 0;
+	if (!workers || count <= occlusionJobSize) {
+		rejected = cull_range(0, count);
+	}
+	else {
+		size_t jobCount = (count + occlusionJobSize - 1) / occlusionJobSize;
+		std::vector<size_t> rejectedCounts(jobCount);
+		workers->parallel_for(jobCount, [&](size_t job) {
+			size_t first = job * occlusionJobSize;
+			rejectedCounts[job] = cull_range(first, std::min(first + occlusionJobSize, count));
+		});
+		for (size_t jobRejected : rejectedCounts) rejected += jobRejected;
+	}
+
+	lastStats.rejected = rejected;
+	lastStats.testMilliseconds = milliseconds_since(start);
+	return rejected;
+}
@@ -0,0 +1,113 @@
+#pragma once
+#include "config.h"
+#include "transform_kernel.h"
+#include "meshlet.h"
+#include "obj_mesh.h"
+#include <array>
+#include <span>
+
+namespace vkUtil {
+	// Width of the occlusion depth buffer; the height follows the aspect.
+	constexpr uint32_t occlusionBufferWidth = 320;
+	// Screen tiles, one job each while rasterizing.
+	constexpr uint32_t occlusionTileWidth = 64;
+	constexpr uint32_t occlusionTileHeight = 32;
+	// The nearest, largest-looking objects are drawn as occluders, at most this many.
+	constexpr size_t maxOccluders = 64;
+	// Occluders use the finest level of detail with at most this many triangles.
+	constexpr uint32_t maxOccluderTriangles = 512;
+	// Objects tested per job.
+	constexpr size_t occlusionJobSize = 1024;
+
+	// What an object draws into the occlusion buffer: a coarse level of
+	// its mesh, with only the vertices that level uses.
+	struct OccluderMesh {
+		std::vector<glm::vec3> positions;
+		std::vector<uint32_t> indices;
+	};
+
+	// The finest level of lods with at most maxTriangles triangles, or the
+	// coarsest one when none is that small; without lods the whole index
+	// range. Positions are the first three floats of every floatsPerVertex.
+	OccluderMesh make_occluder(std::span<const float> vertices, size_t floatsPerVertex, std::span<const uint32_t> indices,
+		std::span<const vkMesh::MeshLod> lods, uint32_t maxTriangles = maxOccluderTriangles);
+
+	struct OcclusionStats {
+		size_t occluders, triangles;
+		// objects the frustum let through that the occluders hide
+		size_t rejected;
+		double rasterMilliseconds, testMilliseconds;
+	};
+
+	// A small depth buffer the CPU draws occluders into, for rejecting
+	// instances before any draw is recorded. Depth is z / w as the GPU
+	// stores it, nearest kept, cleared to 1. Triangles are set up and
+	// binned to screen tiles per occluder, then each tile is rasterized by
+	// a job of its own, 8 pixels at a time with AVX, and remembers its
+	// farthest depth so most tests stop at the tiles.
+	class OcclusionRasterizer {
+	public:
+		// for a width x height view, drawing and testing on simdPath, which
+		// this machine has to run
+		OcclusionRasterizer(uint32_t width, uint32_t height, SimdPath simdPath = best_simd_path());
+
+		void resize(uint32_t width, uint32_t height);
+
+		// Objects of type draw mesh as their occluder; without one they only
+		// get tested.
+		void set_occluder(meshTypes type, OccluderMesh mesh);
+		void clear_occluder(meshTypes type);
+
+		// Draws the occluders among the visible objects: those with an
+		// occluder mesh whose bounding spheres look largest from eye, at
+		// most maxOccluders of them.
+		void render(const glm::mat4& viewProjection, glm::vec3 eye, const TransformStreams& objects, std::span<const meshTypes> types,
+			std::span<const vkMesh::MeshVolume, meshTypeCount> volumes, const uint8_t* visible, WorkerPool* workers);
+
+		// Clears visible[i] of the visible objects whose boxes, volumes[types[i]]
+		// placed by their transforms, are behind what render drew over their
+		// whole screen rectangle; boxes reaching past the near plane stay
+		// visible. Returns how many were cleared.
+		size_t cull_occluded(const TransformStreams& objects, std::span<const meshTypes> types,
+			std::span<const vkMesh::MeshVolume, meshTypeCount> volumes, uint8_t* visible, WorkerPool* workers);
+
+		// of the last render and cull_occluded
+		OcclusionStats stats() const { return lastStats; }
+
+		uint32_t width() const { return bufferWidth; }
+		uint32_t height() const { return bufferHeight; }
+		// row-major, width() * height()
+		const float* depth() const { return depthBuffer.data(); }
+
+	private:
+		struct ScreenTriangle {
+			float x[3], y[3], z[3];
+		};
+
+		// set up by one occluder instance; bins[tile] indexes triangles
+		struct OccluderJob {
+			uint32_t object;
+			std::vector<glm::vec4> clipPositions;
+			std::vector<ScreenTriangle> triangles;
+			std::vector<std::vector<uint32_t>> bins;
+		};
+
+		uint32_t bufferWidth = 0, bufferHeight = 0;
+		uint32_t tilesX = 0, tilesY = 0;
+		std::vector<float> depthBuffer;
+		std::vector<float> tileFarthest;
+		std::array<OccluderMesh, meshTypeCount> occluders;
+		glm::mat4 viewProjection{ 1.0f };
+
+		std::vector<OccluderJob> jobs;
+		// apparent size, object
+		std::vector<std::pair<float, uint32_t>> candidates;
+		OcclusionStats lastStats{};
+		SimdPath path;
+
+		void setup_triangles(OccluderJob& job, const TransformStreams& objects, meshTypes type);
+		void bin_triangle(OccluderJob& job, const ScreenTriangle& triangle);
+		void rasterize_tile(uint32_t tile);
+		bool occluded(const glm::vec3 corners[8]) const;
+	};
+}
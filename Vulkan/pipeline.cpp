@@ -130,10 +130,8 @@ vk::PipelineLayout vkInit::PipelineBuilder::createPipelineLayout()
 	layoutInfo.flags = vk::PipelineLayoutCreateFlags();
 	layoutInfo.setLayoutCount = static_cast<uint32_t>(descriptorSetLayouts.size());
 	layoutInfo.pSetLayouts = descriptorSetLayouts.data();
-	layoutInfo.pushConstantRangeCount = 0;
-	
-	// vk::PushConstantRange pushConstantInfo = create_push_constant_info();
-	// layoutInfo.pPushConstantRanges = &pushConstantInfo;
+	layoutInfo.pushConstantRangeCount = static_cast<uint32_t>(pushConstantRanges.size());
+	layoutInfo.pPushConstantRanges = pushConstantRanges.data();
 
 	try {
 		return device.createPipelineLayout(layoutInfo);
@@ -221,6 +219,7 @@ void vkInit::PipelineBuilder::reset() {
 	resetShaderModules();
 	resetRenderpassAttachments();
 	resetDescriptorsetLayouts();
+	pushConstantRanges.clear();
 }
 
 void vkInit::PipelineBuilder::specify_vertex_format(std::vector<vk::VertexInputBindingDescription> bindingDescriptions, std::vector<vk::VertexInputAttributeDescription> attributeDescriptions)
@@ -346,14 +345,139 @@ void vkInit::PipelineBuilder::resetDescriptorsetLayouts()
 	descriptorSetLayouts.clear();
 }
 
+void vkInit::PipelineBuilder::specify_push_constants(vk::ShaderStageFlags stages, uint32_t size)
+{
+	vk::PushConstantRange pushConstantInfo;
+	pushConstantInfo.offset = 0;
+	pushConstantInfo.size = size;
+	pushConstantInfo.stageFlags = stages;
+
+	pushConstantRanges.clear();
+	pushConstantRanges.push_back(pushConstantInfo);
+}
+
+vkInit::ComputePipelineOutBundle vkInit::create_compute_pipelines(const ComputePipelineInBundle& specification)
+{
+	ComputePipelineOutBundle output;
+
+	vk::PushConstantRange pushConstantInfo;
+	pushConstantInfo.offset = 0;
+	pushConstantInfo.size = specification.pushConstantSize;
+	pushConstantInfo.stageFlags = vk::ShaderStageFlagBits::eCompute;
+
+	vk::PipelineLayoutCreateInfo layoutInfo;
+	layoutInfo.flags = vk::PipelineLayoutCreateFlags();
+	layoutInfo.setLayoutCount = static_cast<uint32_t>(specification.descriptorSetLayouts.size());
+	layoutInfo.pSetLayouts = specification.descriptorSetLayouts.data();
+	layoutInfo.pushConstantRangeCount = specification.pushConstantSize ? 1 : 0;
+	layoutInfo.pPushConstantRanges = &pushConstantInfo;
+
+	try {
+		output.layout = specification.device.createPipelineLayout(layoutInfo);
+	}
+	catch (vk::SystemError err) {
+#ifndef NDEBUG
+		std::cerr << "Failed to create compute pipeline layout!" << std::endl;
+#endif
+		return output;
+	}
+
+	for (const auto& filename : specification.shaderFilePaths) {
+#ifndef NDEBUG
+		std::cerr << "Create compute pipeline for \"" << filename << "\"\n";
+#endif // !NDEBUG
+		vk::ShaderModule shader = vkUtil::createModule(filename, specification.device);
+		// a missing or broken shader leaves a null pipeline
+		if (!shader) {
+			output.pipelines.push_back(nullptr);
+			continue;
+		}
+
+		vk::ComputePipelineCreateInfo pipelineInfo;
+		pipelineInfo.stage.stage = vk::ShaderStageFlagBits::eCompute;
+		pipelineInfo.stage.module = shader;
+		pipelineInfo.stage.pName = "main";
+		pipelineInfo.layout = output.layout;
+
+		vk::Pipeline pipeline;
+		try {
+			pipeline = specification.device.createComputePipeline(nullptr, pipelineInfo).value;
+		}
+		catch (vk::SystemError err) {
+#ifndef NDEBUG
+			std::cerr << "Failed to create compute pipeline\n";
+#endif // !NDEBUG
+		}
+		specification.device.destroyShaderModule(shader);
+		output.pipelines.push_back(pipeline);
+	}
+
+	return output;
+}
+
+vkInit::SplitRenderpasses vkInit::create_split_renderpasses(vk::Device device, vk::Format colorFormat, vk::Format depthFormat)
+{
+	SplitRenderpasses output;
+
+	vk::AttachmentDescription attachments[2];
+	attachments[0].format = colorFormat;
+	attachments[1].format = depthFormat;
+	for (auto& attachment : attachments) {
+		attachment.samples = vk::SampleCountFlagBits::e1;
+		attachment.storeOp = vk::AttachmentStoreOp::eStore;
+		attachment.stencilLoadOp = vk::AttachmentLoadOp::eDontCare;
+		attachment.stencilStoreOp = vk::AttachmentStoreOp::eDontCare;
+	}
 
+	vk::AttachmentReference references[2];
+	references[0].attachment = 0;
+	references[0].layout = vk::ImageLayout::eColorAttachmentOptimal;
+	references[1].attachment = 1;
+	references[1].layout = vk::ImageLayout::eDepthStencilAttachmentOptimal;
 
-// vk::PushConstantRange vkInit::PipelineBuilder::create_push_constant_info()
-// {
-//	 vk::PushConstantRange pushConstantInfo;
-//	 pushConstantInfo.offset = 0;
-//	 pushConstantInfo.size = sizeof(vkUtil::ObjectData);
-//	 pushConstantInfo.stageFlags = vk::ShaderStageFlagBits::eVertex;
-//	
-//	 return pushConstantInfo;
-// }
\ No newline at end of file
+	vk::SubpassDescription subpass = {};
+	subpass.pipelineBindPoint = vk::PipelineBindPoint::eGraphics;
+	subpass.colorAttachmentCount = 1;
+	subpass.pColorAttachments = &references[0];
+	subpass.pDepthStencilAttachment = &references[1];
+
+	vk::RenderPassCreateInfo renderpassInfo = {};
+	renderpassInfo.attachmentCount = 2;
+	renderpassInfo.pAttachments = attachments;
+	renderpassInfo.subpassCount = 1;
+	renderpassInfo.pSubpasses = &subpass;
+
+	for (auto& attachment : attachments) {
+		attachment.loadOp = vk::AttachmentLoadOp::eClear;
+		attachment.initialLayout = vk::ImageLayout::eUndefined;
+	}
+	attachments[0].finalLayout = vk::ImageLayout::eColorAttachmentOptimal;
+	attachments[1].finalLayout = vk::ImageLayout::eDepthStencilAttachmentOptimal;
+
+	try {
+		output.first = device.createRenderPass(renderpassInfo);
+	}
+	catch (vk::SystemError err) {
+#ifndef NDEBUG
+		std::cerr << "Failed to create renderpass!";
+#endif // !NDEBUG
+	}
+
+	for (auto& attachment : attachments) {
+		attachment.loadOp = vk::AttachmentLoadOp::eLoad;
+	}
+	attachments[0].initialLayout = vk::ImageLayout::eColorAttachmentOptimal;
+	attachments[0].finalLayout = vk::ImageLayout::ePresentSrcKHR;
+	attachments[1].initialLayout = vk::ImageLayout::eDepthStencilAttachmentOptimal;
+
+	try {
+		output.second = device.createRenderPass(renderpassInfo);
+	}
+	catch (vk::SystemError err) {
+#ifndef NDEBUG
+		std::cerr << "Failed to create renderpass!";
+#endif // !NDEBUG
+	}
+
+	return output;
+}
@@ -18,6 +18,32 @@ namespace vkInit {
 		vk::Pipeline pipeline;
 	};
 
+	struct ComputePipelineInBundle {
+		vk::Device device;
+		std::vector<std::string> shaderFilePaths;
+		std::vector<vk::DescriptorSetLayout> descriptorSetLayouts;
+		// visible to the compute stage, none when 0
+		uint32_t pushConstantSize = 0;
+	};
+
+	// One pipeline per shader, in the same order, all with the same layout.
+	struct ComputePipelineOutBundle {
+		vk::PipelineLayout layout;
+		std::vector<vk::Pipeline> pipelines;
+	};
+
+	ComputePipelineOutBundle create_compute_pipelines(const ComputePipelineInBundle& specification);
+
+	// A frame drawn in two halves with work in between: the first pass clears
+	// and keeps both attachments in their attachment layouts, the second
+	// loads them and leaves the color image ready to present. Both are
+	// compatible with the render pass PipelineBuilder makes for the formats.
+	struct SplitRenderpasses {
+		vk::RenderPass first, second;
+	};
+
+	SplitRenderpasses create_split_renderpasses(vk::Device device, vk::Format colorFormat, vk::Format depthFormat);
+
 	class PipelineBuilder {
 	public:
 		PipelineBuilder(vk::Device device);
@@ -31,6 +57,7 @@ namespace vkInit {
 		void specify_depth_attachment(const vk::Format& depthFormat, uint32_t attachment_index);
 		void clearDepthAttachment();
 		void addColorAttachment(const vk::Format& format, uint32_t attachment_index);
+		void specify_push_constants(vk::ShaderStageFlags stages, uint32_t size);
 
 
 		GraphicsPipelineOutBundle build();
@@ -69,6 +96,7 @@ namespace vkInit {
 		vk::PipelineColorBlendStateCreateInfo colorBlending = {};
 
 		std::vector<vk::DescriptorSetLayout> descriptorSetLayouts;
+		std::vector<vk::PushConstantRange> pushConstantRanges;
 		void resetVertexFormat();
 		void resetShaderModules();
 		void resetRenderpassAttachments();
@@ -12,20 +12,30 @@ vkUtil::QueueFamilyIndices vkUtil::findQueueFamilies(const vk::PhysicalDevice& d
 
 	uint32_t i = 0;
 	for (const auto& queueFamily : queueFamilies) {
-		if (queueFamily.queueFlags & vk::QueueFlagBits::eGraphics) {
-			indices.graphicsFamily = i;
+		if (!indices.isComplete()) {
+			if (queueFamily.queueFlags & vk::QueueFlagBits::eGraphics) {
+				indices.graphicsFamily = i;
 #ifndef NDEBUG
-			std::cout << "Queue family " << i << " is suitable for graphics.\n";
+				std::cout << "Queue family " << i << " is suitable for graphics.\n";
 #endif // !NDEBUG
+			}
+
+			if (device.getSurfaceSupportKHR(i, surface)) {
+				indices.presentFamily = i;
+#ifndef NDEBUG
+				std::cout << "Queue family " << i << " is suitable for presenting.\n";
+#endif // !NDEBUG
+			}
 		}
 
-		if (device.getSurfaceSupportKHR(i, surface)) {
-			indices.presentFamily = i;
+		bool transferOnly = (queueFamily.queueFlags & vk::QueueFlagBits::eTransfer)
+			&& !(queueFamily.queueFlags & (vk::QueueFlagBits::eGraphics | vk::QueueFlagBits::eCompute));
+		if (transferOnly && !indices.transferFamily.has_value()) {
+			indices.transferFamily = i;
 #ifndef NDEBUG
-			std::cout << "Queue family " << i << " is suitable for presenting.\n";
+			std::cout << "Queue family " << i << " is transfer only.\n";
 #endif // !NDEBUG
 		}
-		if (indices.isComplete()) break;
 		i++;
 	}
 	return indices;
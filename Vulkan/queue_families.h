@@ -5,8 +5,12 @@ namespace vkUtil {
 	struct QueueFamilyIndices {
 		std::optional<uint32_t> graphicsFamily;
 		std::optional<uint32_t> presentFamily;
+		// a family that can transfer but neither draw nor compute, if the device has one
+		std::optional<uint32_t> transferFamily;
 
 		bool isComplete() const { return graphicsFamily.has_value() && presentFamily.has_value(); }
+		// where uploads are recorded: the dedicated family or, without one, graphics
+		uint32_t uploadFamily() const { return transferFamily.value_or(graphicsFamily.value()); }
 	};
 	QueueFamilyIndices findQueueFamilies(const vk::PhysicalDevice& device, const vk::SurfaceKHR& surface);
-}
\ No newline at end of file
+}
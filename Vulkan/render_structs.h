@@ -6,4 +6,61 @@ namespace vkUtil {
 	struct ObjectData {
 		glm::mat4 model;
 	};
+
+	// Instances of one mesh drawn at one level of detail; their object
+	// indices are contiguous in the frame's object index buffer.
+	struct DrawBatch {
+		meshTypes type;
+		uint32_t lod;
+		uint32_t firstInstance;
+		uint32_t instanceCount;
+	};
+
+	// One mesh type as the culling shaders read it, std430. lodCount is 0
+	// while the mesh isn't loaded.
+	struct CullMesh {
+		// center, radius
+		glm::vec4 sphere;
+		// half extent, w unused
+		glm::vec4 extent;
+		uint32_t lodCount;
+		uint32_t padding[3];
+		struct Lod {
+			uint32_t indexCount;
+			uint32_t firstIndex;
+			int32_t vertexOffset;
+			float error;
+		} lods[maxDrawLods];
+	};
+
+	// Push constants of the culling passes; 128 bytes, the least every
+	// device supports.
+	struct CullConstants {
+		glm::vec4 planes[6];
+		// camera position, w = pixels per unit at distance 1
+		glm::vec4 eye;
+		uint32_t objectCount;
+		float maxPixelError;
+		// cullPhaseEarly or cullPhaseLate
+		uint32_t phase;
+		// depth buffer width | height << 16
+		uint32_t depthSize;
+	};
+
+	// The early phase draws what the last frame saw; the late phase tests
+	// everything against this frame's depth pyramid and draws the rest.
+	constexpr uint32_t cullPhaseEarly = 0;
+	constexpr uint32_t cullPhaseLate = 1;
+
+	// What the culling passes count. Slot type * maxDrawLods + lod holds the
+	// instances of one mesh at one level; draw commands are laid out the same
+	// way, each mesh's non-empty levels first.
+	struct CullCounters {
+		uint32_t drawCounts[meshTypeCount];
+		uint32_t visible;
+		uint32_t culled;
+		uint32_t occluded;
+		uint32_t slotInstances[meshTypeCount * maxDrawLods];
+		uint32_t slotFirst[meshTypeCount * maxDrawLods];
+	};
 }
@@ -1,9 +1,103 @@
 #include "scene.h"
 
-Scene::Scene() {
-	positions.insert({ meshTypes::GROUND, {} });
-	positions.insert({ meshTypes::GIRL, {} });
+// distance between neighbours of the --objects grid
+static constexpr float gridSpacing = 4.0f;
 
-	positions[meshTypes::GROUND].push_back(glm::vec3(10.f, 0.0f, 0.0f));
-	positions[meshTypes::GIRL].push_back(glm::vec3(17.0f, 0.0f, 0.0f));
-}
\ No newline at end of file
+Scene::Scene(size_t objectCount) {
+	if (objectCount == 0) {
+		add(meshTypes::GROUND, glm::vec3(10.f, 0.0f, 0.0f));
+		add(meshTypes::GIRL, glm::vec3(17.0f, 0.0f, 0.0f));
+		return;
+	}
+
+	// rows run away from the camera, ground and girl alternate like a checkerboard
+	size_t side = static_cast<size_t>(std::ceil(std::sqrt(static_cast<double>(objectCount))));
+	for (size_t i = 0; i < objectCount; ++i) {
+		size_t row = i / side, column = i % side;
+		meshTypes mesh = (row + column) % 2 ? meshTypes::GIRL : meshTypes::GROUND;
+		float across = (static_cast<float>(column) - 0.5f * static_cast<float>(side - 1)) * gridSpacing;
+		add(mesh, glm::vec3(10.0f + static_cast<float>(row) * gridSpacing, across, 0.0f));
+	}
+}
+
+uint32_t Scene::add(meshTypes mesh, glm::vec3 position, glm::quat rotation, glm::vec3 scale)
+{
+	auto object = static_cast<uint32_t>(meshes.size());
+	meshes.push_back(mesh);
+	for (int i = 0; i < 3; ++i) {
+		positions[i].push_back(position[i]);
+		scales[i].push_back(scale[i]);
+	}
+	rotations[0].push_back(rotation.x);
+	rotations[1].push_back(rotation.y);
+	rotations[2].push_back(rotation.z);
+	rotations[3].push_back(rotation.w);
+	dirty.push_back(0);
+	mark_dirty(object);
+	return object;
+}
+
+void Scene::remove(uint32_t object)
+{
+	uint32_t last = static_cast<uint32_t>(meshes.size() - 1);
+	if (object != last) {
+		meshes[object] = meshes[last];
+		for (auto& component : positions) component[object] = component[last];
+		for (auto& component : rotations) component[object] = component[last];
+		for (auto& component : scales) component[object] = component[last];
+		mark_dirty(object);
+	}
+
+	meshes.pop_back();
+	for (auto& component : positions) component.pop_back();
+	for (auto& component : rotations) component.pop_back();
+	for (auto& component : scales) component.pop_back();
+	dirty.pop_back();
+}
+
+void Scene::set_position(uint32_t object, glm::vec3 position)
+{
+	for (int i = 0; i < 3; ++i) positions[i][object] = position[i];
+	mark_dirty(object);
+}
+
+void Scene::set_rotation(uint32_t object, glm::quat rotation)
+{
+	rotations[0][object] = rotation.x;
+	rotations[1][object] = rotation.y;
+	rotations[2][object] = rotation.z;
+	rotations[3][object] = rotation.w;
+	mark_dirty(object);
+}
+
+void Scene::set_scale(uint32_t object, glm::vec3 scale)
+{
+	for (int i = 0; i < 3; ++i) scales[i][object] = scale[i];
+	mark_dirty(object);
+}
+
+void Scene::mark_dirty(uint32_t object)
+{
+	if (dirty[object]) return;
+	dirty[object] = 1;
+	dirtyObjects.push_back(object);
+}
+
+std::span<const uint32_t> Scene::take_changes()
+{
+	changedObjects.swap(dirtyObjects);
+	dirtyObjects.clear();
+	for (uint32_t object : changedObjects) {
+		if (object < dirty.size()) dirty[object] = 0;
+	}
+	return changedObjects;
+}
+
+vkUtil::TransformStreams Scene::transform_streams() const
+{
+	return {
+		{ positions[0].data(), positions[1].data(), positions[2].data() },
+		{ rotations[0].data(), rotations[1].data(), rotations[2].data(), rotations[3].data() },
+		{ scales[0].data(), scales[1].data(), scales[2].data() }
+	};
+}
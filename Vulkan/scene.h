@@ -1,11 +1,47 @@
 #pragma once
 #include "config.h"
+#include "transform_kernel.h"
+#include <span>
+#include <glm/gtc/quaternion.hpp>
 
 
+// Objects are kept as arrays indexed by object id, one array per
+// component of their transform, which is what vkUtil::build_transforms
+// reads. Ids are dense: removing an object moves the last one into its
+// place. Every change marks the object dirty, and take_changes() hands
+// out the dirty ids so only those matrices are rebuilt.
 class Scene
 {
 public:
-	Scene();
-	std::unordered_map<meshTypes, std::vector<glm::vec3>> positions;
-};
+	// The ground and the girl; with an objectCount, a square grid of that many
+	// ground and girl instances instead, to run the per-object paths at scale.
+	explicit Scene(size_t objectCount = 0);
+
+	uint32_t add(meshTypes mesh, glm::vec3 position, glm::quat rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f), glm::vec3 scale = glm::vec3(1.0f));
+	void remove(uint32_t object);
+
+	void set_position(uint32_t object, glm::vec3 position);
+	void set_rotation(uint32_t object, glm::quat rotation);
+	void set_scale(uint32_t object, glm::vec3 scale);
+
+	// Returns the objects changed since the last call, valid until the next
+	// change; some may be past size() after a removal.
+	std::span<const uint32_t> take_changes();
 
+	size_t size() const { return meshes.size(); }
+	const std::vector<meshTypes>& mesh_types() const { return meshes; }
+	glm::vec3 position(uint32_t object) const { return glm::vec3(positions[0][object], positions[1][object], positions[2][object]); }
+	vkUtil::TransformStreams transform_streams() const;
+
+private:
+	std::vector<meshTypes> meshes;
+	std::array<std::vector<float>, 3> positions;
+	// quaternion x, y, z, w
+	std::array<std::vector<float>, 4> rotations;
+	std::array<std::vector<float>, 3> scales;
+
+	std::vector<uint8_t> dirty;
+	std::vector<uint32_t> dirtyObjects, changedObjects;
+
+	void mark_dirty(uint32_t object);
+};
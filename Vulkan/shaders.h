@@ -5,9 +5,12 @@ namespace vkUtil {
 	std::vector<char> readFile(const std::string& filename) {
 		std::ifstream file(filename, std::ios::ate | std::ios::binary);
 
+		if (!file.is_open()) {
 #ifndef NDEBUG
-		if (!file.is_open()) { std::cerr << "Failed to load\"" << filename << "\"" << std::endl; }
+			std::cerr << "Failed to load\"" << filename << "\"" << std::endl;
 #endif
+			return {};
+		}
 		size_t filesize(static_cast<size_t>(file.tellg()));
 
 		std::vector<char> buffer(filesize);
@@ -19,6 +22,7 @@ namespace vkUtil {
 
 	vk::ShaderModule createModule(const std::string& filename, const vk::Device& device) {
 		std::vector<char> sourceCode = readFile(filename);
+		if (sourceCode.empty()) return nullptr;
 		vk::ShaderModuleCreateInfo moduleInfo = {};
 		moduleInfo.flags = vk::ShaderModuleCreateFlags();
 		moduleInfo.codeSize = sourceCode.size();
@@ -32,5 +36,6 @@ namespace vkUtil {
 			std::cerr << "Failed to create shader module for \"" << filename << "\"" << std::endl;
 #endif
 		}
+		return nullptr;
 	}
 }
\ No newline at end of file
@@ -0,0 +1,84 @@
+#pragma once
+#include "config.h"
+
+// Arithmetic written once for a float, an SSE register of 4 floats and an
+// AVX register of 8, so a kernel can be instantiated for each lane width.
+// Only for the translation units of the kernels; everything is inlined.
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define SIMD_LANES_X64
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+// MSVC emits AVX for the intrinsics alone, GCC and Clang have to be told
+// per function so the rest of the file stays on the baseline.
+#if defined(SIMD_LANES_X64) && defined(__GNUC__)
+#define AVX_FUNCTION __attribute__((target("avx")))
+#define KERNEL_INLINE __attribute__((always_inline)) inline
+#elif defined(_MSC_VER)
+#define AVX_FUNCTION
+#define KERNEL_INLINE __forceinline
+#else
+#define AVX_FUNCTION
+#define KERNEL_INLINE inline
+#endif
+
+namespace vkUtil::lanes {
+	// The upper 3x3 of a transform, [column][row], for one object per lane.
+	// Written once for every lane type through these overloads.
+	template<typename V>
+	struct Basis {
+		V m[3][3];
+	};
+
+	KERNEL_INLINE float add(float a, float b) { return a + b; }
+	KERNEL_INLINE float sub(float a, float b) { return a - b; }
+	KERNEL_INLINE float mul(float a, float b) { return a * b; }
+	KERNEL_INLINE float splat(float value, float) { return value; }
+
+#ifdef SIMD_LANES_X64
+	KERNEL_INLINE __m128 add(__m128 a, __m128 b) { return _mm_add_ps(a, b); }
+	KERNEL_INLINE __m128 sub(__m128 a, __m128 b) { return _mm_sub_ps(a, b); }
+	KERNEL_INLINE __m128 mul(__m128 a, __m128 b) { return _mm_mul_ps(a, b); }
+	KERNEL_INLINE __m128 splat(float value, __m128) { return _mm_set1_ps(value); }
+
+#ifdef _MSC_VER
+	KERNEL_INLINE __m256 add(__m256 a, __m256 b) { return _mm256_add_ps(a, b); }
+	KERNEL_INLINE __m256 sub(__m256 a, __m256 b) { return _mm256_sub_ps(a, b); }
+	KERNEL_INLINE __m256 mul(__m256 a, __m256 b) { return _mm256_mul_ps(a, b); }
+	KERNEL_INLINE __m256 splat(float value, __m256) { return _mm256_set1_ps(value); }
+#else
+	// vector extensions rather than intrinsics: these have no target of
+	// their own and become AVX where they are inlined
+	KERNEL_INLINE __m256 add(__m256 a, __m256 b) { return a + b; }
+	KERNEL_INLINE __m256 sub(__m256 a, __m256 b) { return a - b; }
+	KERNEL_INLINE __m256 mul(__m256 a, __m256 b) { return a * b; }
+	KERNEL_INLINE __m256 splat(float value, __m256) { return __m256{ value, value, value, value, value, value, value, value }; }
+#endif
+#endif
+
+	// inlined into each caller, so the AVX instance is compiled as AVX
+	template<typename V>
+	KERNEL_INLINE Basis<V> rotation_scale(V x, V y, V z, V w, V sx, V sy, V sz)
+	{
+		V one = splat(1.0f, x), two = splat(2.0f, x);
+		V xx = mul(x, x), yy = mul(y, y), zz = mul(z, z);
+		V xy = mul(x, y), xz = mul(x, z), yz = mul(y, z);
+		V wx = mul(w, x), wy = mul(w, y), wz = mul(w, z);
+
+		Basis<V> basis;
+		basis.m[0][0] = mul(sub(one, mul(two, add(yy, zz))), sx);
+		basis.m[0][1] = mul(mul(two, add(xy, wz)), sx);
+		basis.m[0][2] = mul(mul(two, sub(xz, wy)), sx);
+		basis.m[1][0] = mul(mul(two, sub(xy, wz)), sy);
+		basis.m[1][1] = mul(sub(one, mul(two, add(xx, zz))), sy);
+		basis.m[1][2] = mul(mul(two, add(yz, wx)), sy);
+		basis.m[2][0] = mul(mul(two, add(xz, wy)), sz);
+		basis.m[2][1] = mul(mul(two, sub(yz, wx)), sz);
+		basis.m[2][2] = mul(sub(one, mul(two, add(xx, yy))), sz);
+		return basis;
+	}
+}
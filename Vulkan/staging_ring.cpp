@@ -0,0 +1,85 @@
+#include "staging_ring.h"
+#include "upload_batch.h"
+#include <stdexcept>
+
+namespace {
+	// keeps every copy's source offset aligned for any element type and texel size
+	constexpr vk::DeviceSize copyAlignment = 16;
+}
+
+vkUtil::StagingRing::StagingRing(vk::Device device, vk::PhysicalDevice physicalDevice, DeviceAllocator* allocator, TransferQueue& transfer, vk::DeviceSize capacity)
+	: capacity(capacity), device(device), transfer(transfer)
+{
+	BufferInput input;
+	input.device = device;
+	input.physicalDevice = physicalDevice;
+	input.size = capacity;
+	input.usage = vk::BufferUsageFlagBits::eTransferSrc;
+	input.memoryProperties = vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent;
+	input.allocator = allocator;
+	buffer = createBuffer(input);
+	mapped = static_cast<char*>(buffer.allocation.mapped);
+}
+
+vkUtil::StagingRing::~StagingRing()
+{
+	transfer.wait(transfer.submitted);
+	destroyBuffer(device, buffer);
+}
+
+void vkUtil::StagingRing::reclaim()
+{
+	while (!segments.empty() && segments.front().value && transfer.is_complete(segments.front().value)) {
+		segments.pop_front();
+	}
+	if (segments.empty()) head = 0;
+}
+
+bool vkUtil::StagingRing::find_room(vk::DeviceSize size, vk::DeviceSize& offset)
+{
+	if (segments.empty()) {
+		offset = 0;
+		return size <= capacity;
+	}
+
+	vk::DeviceSize tail = segments.front().begin;
+	if (head > tail) {
+		// free: [head, capacity) and, wrapping around, [0, tail)
+		if (head + size <= capacity) offset = head;
+		else if (size <= tail) offset = 0;
+		else return false;
+		return true;
+	}
+	// free: [head, tail)
+	offset = head;
+	return head + size <= tail;
+}
+
+vkUtil::StagingSpace vkUtil::StagingRing::allocate(UploadBatch& batch, vk::DeviceSize size)
+{
+	size = (size + copyAlignment - 1) & ~(copyAlignment - 1);
+	// no amount of waiting makes room for it
+	if (size > capacity) throw std::runtime_error("staging allocation larger than the ring!");
+	for (;;) {
+		reclaim();
+		vk::DeviceSize offset;
+		if (find_room(size, offset)) {
+			segments.push_back({ offset, offset + size, &batch, 0 });
+			head = offset + size;
+			bytesStaged += size;
+			return { mapped + offset, buffer.buffer, offset };
+		}
+
+		// the oldest space has to come back first
+		if (!segments.front().value) segments.front().batch->submit_async();
+		++waits;
+		transfer.wait(segments.front().value);
+	}
+}
+
+void vkUtil::StagingRing::retire(const UploadBatch& batch, uint64_t value)
+{
+	for (auto& segment : segments) {
+		if (segment.batch == &batch && !segment.value) segment.value = value;
+	}
+}
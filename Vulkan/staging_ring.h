@@ -0,0 +1,66 @@
+#pragma once
+#include "config.h"
+#include "memory.h"
+#include "transfer_queue.h"
+#include <deque>
+
+namespace vkUtil {
+	class UploadBatch;
+
+	struct StagingSpace {
+		void* data;
+		vk::Buffer buffer;
+		vk::DeviceSize offset;
+	};
+
+	// One persistently mapped staging buffer that every upload passes
+	// through. Space is handed out front to back on behalf of an UploadBatch
+	// and comes back once the transfer timeline passes the value of the
+	// submission that copied out of it. When the ring is full, the oldest
+	// space is waited for, after submitting its batch if that has not
+	// happened yet. Uploads of any size pass through capacity bytes of host
+	// memory at a steady rate.
+	class StagingRing {
+	public:
+		StagingRing(vk::Device device, vk::PhysicalDevice physicalDevice, DeviceAllocator* allocator, TransferQueue& transfer, vk::DeviceSize capacity);
+		~StagingRing();
+
+		StagingRing(const StagingRing&) = delete;
+		StagingRing& operator=(const StagingRing&) = delete;
+
+		// size bytes for batch to copy out of. Fill them before the next
+		// allocate, which may submit batch. Throws when size is more than
+		// capacity.
+		StagingSpace allocate(UploadBatch& batch, vk::DeviceSize size);
+		// Called by batch when it is submitted: its space is in flight until
+		// the timeline reaches value.
+		void retire(const UploadBatch& batch, uint64_t value);
+
+		// largest piece worth asking for, keeps several uploads in flight
+		vk::DeviceSize piece_size() const { return capacity / 4; }
+
+		vk::DeviceSize capacity;
+		vk::DeviceSize bytesStaged = 0;
+		// allocations that found the ring full and waited
+		size_t waits = 0;
+
+	private:
+		struct Segment {
+			vk::DeviceSize begin, end;
+			UploadBatch* batch;
+			// 0 until the batch is submitted
+			uint64_t value;
+		};
+
+		vk::Device device;
+		TransferQueue& transfer;
+		Buffer buffer;
+		char* mapped = nullptr;
+		// oldest first; the space in use runs from the first begin to head
+		std::deque<Segment> segments;
+		vk::DeviceSize head = 0;
+
+		void reclaim();
+		bool find_room(vk::DeviceSize size, vk::DeviceSize& offset);
+	};
+}
@@ -0,0 +1,138 @@
+#include "transfer_queue.h"
+
+vkUtil::TransferQueue::TransferQueue(vk::Device device, vk::Queue queue, uint32_t family, uint32_t graphicsFamily)
+	: family(family), graphicsFamily(graphicsFamily), device(device), queue(queue)
+{
+	vk::CommandPoolCreateInfo poolInfo;
+	poolInfo.flags = vk::CommandPoolCreateFlagBits::eResetCommandBuffer;
+	poolInfo.queueFamilyIndex = family;
+
+	vk::SemaphoreTypeCreateInfo typeInfo;
+	typeInfo.semaphoreType = vk::SemaphoreType::eTimeline;
+	typeInfo.initialValue = 0;
+	vk::SemaphoreCreateInfo semaphoreInfo;
+	semaphoreInfo.pNext = &typeInfo;
+
+	try {
+		commandPool = device.createCommandPool(poolInfo);
+		timeline = device.createSemaphore(semaphoreInfo);
+	}
+	catch (vk::SystemError err) {
+#ifndef NDEBUG
+		std::cerr << "Failed to create transfer queue resources" << std::endl;
+#endif
+	}
+}
+
+vkUtil::TransferQueue::~TransferQueue()
+{
+	wait(submitted);
+	collect();
+	device.destroySemaphore(timeline);
+	device.destroyCommandPool(commandPool);
+}
+
+vk::CommandBuffer vkUtil::TransferQueue::begin()
+{
+	collect();
+
+	vk::CommandBuffer commandBuffer;
+	if (!idle.empty()) {
+		commandBuffer = idle.back();
+		idle.pop_back();
+	}
+	else {
+		vk::CommandBufferAllocateInfo allocInfo;
+		allocInfo.commandPool = commandPool;
+		allocInfo.level = vk::CommandBufferLevel::ePrimary;
+		allocInfo.commandBufferCount = 1;
+		commandBuffer = device.allocateCommandBuffers(allocInfo).at(0);
+	}
+
+	commandBuffer.reset();
+	vk::CommandBufferBeginInfo beginInfo;
+	beginInfo.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit;
+	commandBuffer.begin(beginInfo);
+	return commandBuffer;
+}
+
+uint64_t vkUtil::TransferQueue::submit(vk::CommandBuffer commandBuffer, std::vector<Buffer> released,
+	std::vector<vk::BufferMemoryBarrier> bufferBarriers, std::vector<vk::ImageMemoryBarrier> imageBarriers)
+{
+	commandBuffer.end();
+
+	uint64_t value = submitted + 1;
+	vk::TimelineSemaphoreSubmitInfo timelineInfo;
+	timelineInfo.signalSemaphoreValueCount = 1;
+	timelineInfo.pSignalSemaphoreValues = &value;
+
+	vk::SubmitInfo submitInfo;
+	submitInfo.pNext = &timelineInfo;
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &commandBuffer;
+	submitInfo.signalSemaphoreCount = 1;
+	submitInfo.pSignalSemaphores = &timeline;
+	queue.submit(1, &submitInfo, nullptr);
+	submitted = value;
+
+	inFlight.push_back({ value, commandBuffer, std::move(released) });
+	bufferAcquires.insert(bufferAcquires.end(), bufferBarriers.begin(), bufferBarriers.end());
+	imageAcquires.insert(imageAcquires.end(), imageBarriers.begin(), imageBarriers.end());
+	return value;
+}
+
+void vkUtil::TransferQueue::release(std::vector<Buffer> buffers)
+{
+	if (buffers.empty()) return;
+	if (is_complete(submitted)) {
+		for (auto& buffer : buffers) destroyBuffer(device, buffer);
+		return;
+	}
+	inFlight.push_back({ submitted, nullptr, std::move(buffers) });
+}
+
+bool vkUtil::TransferQueue::is_complete(uint64_t value) const
+{
+	return device.getSemaphoreCounterValue(timeline) >= value;
+}
+
+void vkUtil::TransferQueue::wait(uint64_t value) const
+{
+	if (value == 0) return;
+	vk::SemaphoreWaitInfo waitInfo;
+	waitInfo.semaphoreCount = 1;
+	waitInfo.pSemaphores = &timeline;
+	waitInfo.pValues = &value;
+	device.waitSemaphores(waitInfo, UINT64_MAX);
+}
+
+void vkUtil::TransferQueue::collect()
+{
+	uint64_t completed = device.getSemaphoreCounterValue(timeline);
+	auto done = std::partition(inFlight.begin(), inFlight.end(), [completed](const InFlight& upload) {
+		return upload.value > completed;
+	});
+	for (auto upload = done; upload != inFlight.end(); ++upload) {
+		if (upload->commandBuffer) idle.push_back(upload->commandBuffer);
+		for (auto& buffer : upload->released) {
+			destroyBuffer(device, buffer);
+		}
+	}
+	inFlight.erase(done, inFlight.end());
+}
+
+uint64_t vkUtil::TransferQueue::acquire(vk::CommandBuffer graphicsCommandBuffer)
+{
+	if (acquired == submitted) return 0;
+
+	if (!bufferAcquires.empty() || !imageAcquires.empty()) {
+		// the semaphore wait covers uploadConsumerStages, chain the barrier to it
+		graphicsCommandBuffer.pipelineBarrier(uploadConsumerStages, uploadConsumerStages, vk::DependencyFlags(),
+			nullptr, bufferAcquires, imageAcquires);
+		bufferAcquires.clear();
+		imageAcquires.clear();
+	}
+
+	acquired = submitted;
+	return acquired;
+}
@@ -0,0 +1,76 @@
+#pragma once
+#include "config.h"
+#include "memory.h"
+
+namespace vkUtil {
+	// What uploaded resources are read by once they reach the graphics queue,
+	// including the copies that move geometry to a grown or compacted buffer.
+	constexpr vk::PipelineStageFlags uploadConsumerStages = vk::PipelineStageFlagBits::eTransfer | vk::PipelineStageFlagBits::eVertexInput
+		| vk::PipelineStageFlagBits::eVertexShader | vk::PipelineStageFlagBits::eFragmentShader;
+	constexpr vk::AccessFlags uploadConsumerAccess = vk::AccessFlagBits::eTransferRead | vk::AccessFlagBits::eVertexAttributeRead
+		| vk::AccessFlagBits::eIndexRead | vk::AccessFlagBits::eUniformRead | vk::AccessFlagBits::eShaderRead;
+
+	// The queue uploads are submitted to. With a dedicated transfer family the
+	// uploaded resources are released to the graphics family at the end of each
+	// submission and acquired by the next frame; with a single family (Lavapipe,
+	// most integrated GPUs) the same code runs on the graphics queue and no
+	// ownership changes hands. Either way every submission signals the next
+	// value of a timeline semaphore, so nothing on the render path waits on
+	// the host for a load.
+	class TransferQueue {
+	public:
+		TransferQueue(vk::Device device, vk::Queue queue, uint32_t family, uint32_t graphicsFamily);
+		~TransferQueue();
+
+		TransferQueue(const TransferQueue&) = delete;
+		TransferQueue& operator=(const TransferQueue&) = delete;
+
+		bool dedicated() const { return family != graphicsFamily; }
+
+		// A command buffer of this family, reset and recording.
+		vk::CommandBuffer begin();
+		// Ends and submits commandBuffer and returns the timeline value it
+		// signals. The staging buffers are freed once that value is reached;
+		// the barriers are the acquire halves of the ownership transfers
+		// commandBuffer released and are recorded by acquire().
+		uint64_t submit(vk::CommandBuffer commandBuffer, std::vector<Buffer> released,
+			std::vector<vk::BufferMemoryBarrier> bufferBarriers, std::vector<vk::ImageMemoryBarrier> imageBarriers);
+		// Frees buffers whose copies were part of an earlier submission.
+		void release(std::vector<Buffer> buffers);
+
+		bool is_complete(uint64_t value) const;
+		void wait(uint64_t value) const;
+		// Recycles the command buffers and staging buffers of finished
+		// submissions without blocking.
+		void collect();
+
+		// Records the acquire half of every ownership transfer submitted since
+		// the last call into a graphics command buffer, outside of a render
+		// pass. Returns the timeline value that command buffer's submission has
+		// to wait for at uploadConsumerStages, or 0 if there is nothing new.
+		uint64_t acquire(vk::CommandBuffer graphicsCommandBuffer);
+
+		uint32_t family, graphicsFamily;
+		vk::Semaphore timeline;
+		// value of the latest submission
+		uint64_t submitted = 0;
+
+	private:
+		struct InFlight {
+			uint64_t value;
+			vk::CommandBuffer commandBuffer;
+			std::vector<Buffer> released;
+		};
+
+		vk::Device device;
+		vk::Queue queue;
+		vk::CommandPool commandPool;
+		std::vector<InFlight> inFlight;
+		std::vector<vk::CommandBuffer> idle;
+
+		std::vector<vk::BufferMemoryBarrier> bufferAcquires;
+		std::vector<vk::ImageMemoryBarrier> imageAcquires;
+		// highest value a graphics submission already waits for
+		uint64_t acquired = 0;
+	};
+}
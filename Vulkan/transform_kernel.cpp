@@ -0,0 +1,227 @@
+#include "transform_kernel.h"
+#include "simd_lanes.h"
+#include <cstring>
+
+namespace {
+	using namespace vkUtil::lanes;
+
+	void build_one(const vkUtil::TransformStreams& input, size_t object, glm::mat4& destination)
+	{
+		auto basis = rotation_scale(
+			input.rotation[0][object], input.rotation[1][object], input.rotation[2][object], input.rotation[3][object],
+			input.scale[0][object], input.scale[1][object], input.scale[2][object]);
+
+		float matrix[16] = {
+			basis.m[0][0], basis.m[0][1], basis.m[0][2], 0.0f,
+			basis.m[1][0], basis.m[1][1], basis.m[1][2], 0.0f,
+			basis.m[2][0], basis.m[2][1], basis.m[2][2], 0.0f,
+			input.position[0][object], input.position[1][object], input.position[2][object], 1.0f
+		};
+		std::memcpy(&destination, matrix, sizeof(matrix));
+	}
+
+#ifdef SIMD_LANES_X64
+	// Transposes one column of 4 objects and stores it to each of them.
+	template<bool Stream>
+	void store_column4(__m128 r0, __m128 r1, __m128 r2, __m128 r3, float* const columns[4])
+	{
+		_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+		__m128 values[4] = { r0, r1, r2, r3 };
+		for (int lane = 0; lane < 4; ++lane) {
+			if constexpr (Stream) _mm_stream_ps(columns[lane], values[lane]);
+			else _mm_storeu_ps(columns[lane], values[lane]);
+		}
+	}
+
+	// 4 objects whose components are already loaded; column c of object
+	// lane goes to matrices[lane] + 4 * c.
+	template<bool Stream>
+	void store_matrices4(const Basis<__m128>& basis, __m128 px, __m128 py, __m128 pz, float* const matrices[4])
+	{
+		__m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f);
+		float* columns[4];
+		for (int c = 0; c < 3; ++c) {
+			for (int lane = 0; lane < 4; ++lane) columns[lane] = matrices[lane] + 4 * c;
+			store_column4<Stream>(basis.m[c][0], basis.m[c][1], basis.m[c][2], zero, columns);
+		}
+		for (int lane = 0; lane < 4; ++lane) columns[lane] = matrices[lane] + 12;
+		store_column4<Stream>(px, py, pz, one, columns);
+	}
+
+	template<bool Stream>
+	void build_sse(const vkUtil::TransformStreams& input, size_t first, size_t count, glm::mat4* destination)
+	{
+		size_t end = first + count;
+		size_t object = first;
+		for (; object + 4 <= end; object += 4) {
+			auto load = [&](const float* stream) { return _mm_loadu_ps(stream + object); };
+			auto basis = rotation_scale(
+				load(input.rotation[0]), load(input.rotation[1]), load(input.rotation[2]), load(input.rotation[3]),
+				load(input.scale[0]), load(input.scale[1]), load(input.scale[2]));
+
+			float* matrices[4];
+			for (int lane = 0; lane < 4; ++lane) matrices[lane] = &destination[object + lane][0][0];
+			store_matrices4<Stream>(basis, load(input.position[0]), load(input.position[1]), load(input.position[2]), matrices);
+		}
+		for (; object < end; ++object) build_one(input, object, destination[object]);
+	}
+
+	void build_sse_indexed(const vkUtil::TransformStreams& input, std::span<const uint32_t> objects, glm::mat4* destination)
+	{
+		size_t i = 0;
+		for (; i + 4 <= objects.size(); i += 4) {
+			const uint32_t* lanes = objects.data() + i;
+			auto gather = [&](const float* stream) { return _mm_setr_ps(stream[lanes[0]], stream[lanes[1]], stream[lanes[2]], stream[lanes[3]]); };
+			auto basis = rotation_scale(
+				gather(input.rotation[0]), gather(input.rotation[1]), gather(input.rotation[2]), gather(input.rotation[3]),
+				gather(input.scale[0]), gather(input.scale[1]), gather(input.scale[2]));
+
+			float* matrices[4];
+			for (int lane = 0; lane < 4; ++lane) matrices[lane] = &destination[lanes[lane]][0][0];
+			store_matrices4<false>(basis, gather(input.position[0]), gather(input.position[1]), gather(input.position[2]), matrices);
+		}
+		for (; i < objects.size(); ++i) build_one(input, objects[i], destination[objects[i]]);
+	}
+
+	// Transposes column c of 8 objects; the low half of each result belongs
+	// to objects 0-3, the high half to objects 4-7.
+	AVX_FUNCTION KERNEL_INLINE void transpose_column8(__m256 r0, __m256 r1, __m256 r2, __m256 r3, __m256 out[4])
+	{
+		__m256 t0 = _mm256_unpacklo_ps(r0, r1), t1 = _mm256_unpackhi_ps(r0, r1);
+		__m256 t2 = _mm256_unpacklo_ps(r2, r3), t3 = _mm256_unpackhi_ps(r2, r3);
+		out[0] = _mm256_shuffle_ps(t0, t2, 0x44);
+		out[1] = _mm256_shuffle_ps(t0, t2, 0xEE);
+		out[2] = _mm256_shuffle_ps(t1, t3, 0x44);
+		out[3] = _mm256_shuffle_ps(t1, t3, 0xEE);
+	}
+
+	template<bool Stream>
+	AVX_FUNCTION void build_avx(const vkUtil::TransformStreams& input, size_t first, size_t count, glm::mat4* destination)
+	{
+		size_t end = first + count;
+		size_t object = first;
+		__m256 zero = _mm256_setzero_ps(), one = _mm256_set1_ps(1.0f);
+		const float* streams[10] = { input.position[0], input.position[1], input.position[2],
+			input.rotation[0], input.rotation[1], input.rotation[2], input.rotation[3], input.scale[0], input.scale[1], input.scale[2] };
+		for (; object + 8 <= end; object += 8) {
+			// no lambda: it would not inherit the target attribute
+			__m256 v[10];
+			for (int stream = 0; stream < 10; ++stream) v[stream] = _mm256_loadu_ps(streams[stream] + object);
+			auto basis = rotation_scale(v[3], v[4], v[5], v[6], v[7], v[8], v[9]);
+
+			__m256 columns[4][4];
+			for (int c = 0; c < 3; ++c) transpose_column8(basis.m[c][0], basis.m[c][1], basis.m[c][2], zero, columns[c]);
+			transpose_column8(v[0], v[1], v[2], one, columns[3]);
+
+			// two columns of one object per 256-bit store
+			for (int lane = 0; lane < 4; ++lane) {
+				for (int c = 0; c < 4; c += 2) {
+					__m256 low = _mm256_permute2f128_ps(columns[c][lane], columns[c + 1][lane], 0x20);
+					__m256 high = _mm256_permute2f128_ps(columns[c][lane], columns[c + 1][lane], 0x31);
+					float* lowMatrix = &destination[object + lane][0][0] + 4 * c;
+					float* highMatrix = &destination[object + 4 + lane][0][0] + 4 * c;
+					if constexpr (Stream) {
+						_mm256_stream_ps(lowMatrix, low);
+						_mm256_stream_ps(highMatrix, high);
+					}
+					else {
+						_mm256_storeu_ps(lowMatrix, low);
+						_mm256_storeu_ps(highMatrix, high);
+					}
+				}
+			}
+		}
+		for (; object < end; ++object) build_one(input, object, destination[object]);
+	}
+
+	bool cpu_supports_avx()
+	{
+#ifdef _MSC_VER
+		int registers[4];
+		__cpuid(registers, 1);
+		bool osxsave = registers[2] & (1 << 27), avx = registers[2] & (1 << 28);
+		// the OS saves the upper halves of the ymm registers
+		return osxsave && avx && (_xgetbv(0) & 0x6) == 0x6;
+#else
+		return __builtin_cpu_supports("avx");
+#endif
+	}
+#endif
+}
+
+vkUtil::SimdPath vkUtil::best_simd_path()
+{
+#ifdef SIMD_LANES_X64
+	static const SimdPath best = cpu_supports_avx() ? SimdPath::AVX : SimdPath::SSE;
+	return best;
+#else
+	return SimdPath::SCALAR;
+#endif
+}
+
+const char* vkUtil::simd_path_name(SimdPath path)
+{
+	switch (path) {
+	case SimdPath::SSE: return "SSE";
+	case SimdPath::AVX: return "AVX";
+	default: return "scalar";
+	}
+}
+
+void vkUtil::build_transforms(const TransformStreams& input, size_t first, size_t count, glm::mat4* destination, SimdPath path)
+{
+#ifdef SIMD_LANES_X64
+	// 32 bytes covers both paths; every matrix after the first stays aligned
+	bool stream = (reinterpret_cast<uintptr_t>(destination + first) & 31) == 0;
+	if (path == SimdPath::AVX) {
+		if (stream) build_avx<true>(input, first, count, destination);
+		else build_avx<false>(input, first, count, destination);
+	}
+	else if (path == SimdPath::SSE) {
+		if (stream) build_sse<true>(input, first, count, destination);
+		else build_sse<false>(input, first, count, destination);
+	}
+	else {
+		for (size_t object = first; object < first + count; ++object) build_one(input, object, destination[object]);
+	}
+	// non-temporal stores are weakly ordered, finish them before the submit
+	if (stream) _mm_sfence();
+#else
+	for (size_t object = first; object < first + count; ++object) build_one(input, object, destination[object]);
+#endif
+}
+
+void vkUtil::build_transforms(const TransformStreams& input, std::span<const uint32_t> objects, glm::mat4* destination, SimdPath path)
+{
+#ifdef SIMD_LANES_X64
+	if (path != SimdPath::SCALAR) {
+		build_sse_indexed(input, objects, destination);
+		return;
+	}
+#endif
+	for (uint32_t object : objects) build_one(input, object, destination[object]);
+}
+
+void vkUtil::build_transforms(const TransformStreams& input, size_t count, glm::mat4* destination, WorkerPool* workers)
+{
+	if (!workers || count <= transformJobSize) {
+		build_transforms(input, 0, count, destination);
+		return;
+	}
+	workers->parallel_for((count + transformJobSize - 1) / transformJobSize, [&](size_t job) {
+		size_t first = job * transformJobSize;
+		build_transforms(input, first, std::min(transformJobSize, count - first), destination);
+	});
+}
+
+void vkUtil::build_transforms(const TransformStreams& input, std::span<const uint32_t> objects, glm::mat4* destination, WorkerPool* workers)
+{
+	if (!workers || objects.size() <= transformJobSize) {
+		build_transforms(input, objects, destination);
+		return;
+	}
+	workers->parallel_for((objects.size() + transformJobSize - 1) / transformJobSize, [&](size_t job) {
+		size_t first = job * transformJobSize;
+		build_transforms(input, objects.subspan(first, std::min(transformJobSize, objects.size() - first)), destination);
+	});
+}
@@ -0,0 +1,41 @@
+#pragma once
+#include "config.h"
+#include "worker_pool.h"
+#include <span>
+
+namespace vkUtil {
+	// Object transforms with every component in an array of its own, so a
+	// vector register loads the same component of consecutive objects.
+	struct TransformStreams {
+		const float* position[3];
+		// quaternion x, y, z, w
+		const float* rotation[4];
+		const float* scale[3];
+	};
+
+	enum class SimdPath {
+		SCALAR,
+		// 4 objects at a time, the x64 baseline
+		SSE,
+		// 8 objects at a time, when the CPU and OS support it
+		AVX
+	};
+
+	// The widest path this machine runs.
+	SimdPath best_simd_path();
+	const char* simd_path_name(SimdPath path);
+
+	// Writes translate(position) * mat4_cast(rotation) * scale(scale) of
+	// objects [first, first + count) to destination[first...]. Aligned
+	// destinations get non-temporal stores, meant for mapped device memory.
+	void build_transforms(const TransformStreams& input, size_t first, size_t count, glm::mat4* destination, SimdPath path = best_simd_path());
+	// The same for a list of objects, each written to destination[object].
+	// Gathered loads and scattered stores stay on SSE.
+	void build_transforms(const TransformStreams& input, std::span<const uint32_t> objects, glm::mat4* destination, SimdPath path = best_simd_path());
+
+	// Both, split into jobs of transformJobSize objects across workers once
+	// there are more than that.
+	constexpr size_t transformJobSize = 8192;
+	void build_transforms(const TransformStreams& input, size_t count, glm::mat4* destination, WorkerPool* workers);
+	void build_transforms(const TransformStreams& input, std::span<const uint32_t> objects, glm::mat4* destination, WorkerPool* workers);
+}
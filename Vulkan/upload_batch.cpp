@@ -0,0 +1,266 @@
+#include "upload_batch.h"
+#include <algorithm>
+#include <cstring>
+#include <tuple>
+
+vkUtil::UploadBatch::UploadBatch(TransferQueue& transfer, StagingRing& ring)
+	: transfer(transfer), ring(ring)
+{
+}
+
+vkUtil::UploadBatch::~UploadBatch()
+{
+	submit_async();
+}
+
+void vkUtil::UploadBatch::write_buffer(const void* data, vk::DeviceSize size, const Buffer& dstBuffer, vk::DeviceSize dstOffset)
+{
+	if (size && dstBuffer.allocation.mapped) {
+		std::memcpy(static_cast<char*>(dstBuffer.allocation.mapped) + dstOffset, data, size);
+		directBytes += size;
+		return;
+	}
+
+	const char* bytes = static_cast<const char*>(data);
+	for (vk::DeviceSize done = 0; done < size; ) {
+		vk::DeviceSize piece = std::min(size - done, ring.piece_size());
+		std::memcpy(allocate_buffer(piece, dstBuffer, dstOffset + done), bytes + done, piece);
+		done += piece;
+	}
+}
+
+void* vkUtil::UploadBatch::allocate_buffer(vk::DeviceSize size, const Buffer& dstBuffer, vk::DeviceSize dstOffset)
+{
+	// device-local and host-visible (UMA, resizable BAR): host writes are
+	// visible to every later submission, nothing to copy or transfer
+	if (dstBuffer.allocation.mapped) {
+		directBytes += size;
+		return static_cast<char*>(dstBuffer.allocation.mapped) + dstOffset;
+	}
+
+	StagingSpace space = ring.allocate(*this, size);
+	stagedBytes += size;
+	vk::BufferCopy region;
+	region.srcOffset = space.offset;
+	region.dstOffset = dstOffset;
+	region.size = size;
+	copy_buffer(space.buffer, dstBuffer.buffer, region);
+	return space.data;
+}
+
+void vkUtil::UploadBatch::write_image(const void* texels, uint32_t width, uint32_t height, uint32_t texelSize, vk::Image dstImage)
+{
+	const char* bytes = static_cast<const char*>(texels);
+	vk::DeviceSize rowSize = vk::DeviceSize(width) * texelSize;
+
+	// rows wider than a piece go over in spans of a row each
+	if (rowSize > ring.piece_size()) {
+		uint32_t spanTexels = static_cast<uint32_t>(std::max<vk::DeviceSize>(1, ring.piece_size() / texelSize));
+		for (uint32_t row = 0; row < height; ++row) {
+			for (uint32_t x = 0; x < width; x += spanTexels) {
+				uint32_t texelCount = std::min(spanTexels, width - x);
+				stage_image(bytes + row * rowSize + vk::DeviceSize(x) * texelSize, vk::DeviceSize(texelCount) * texelSize, dstImage,
+					vk::Offset3D(static_cast<int32_t>(x), static_cast<int32_t>(row), 0), vk::Extent3D(texelCount, 1, 1));
+			}
+		}
+		return;
+	}
+
+	uint32_t bandRows = static_cast<uint32_t>(ring.piece_size() / rowSize);
+	for (uint32_t row = 0; row < height; row += bandRows) {
+		uint32_t rows = std::min(bandRows, height - row);
+		stage_image(bytes + row * rowSize, rows * rowSize, dstImage, vk::Offset3D(0, static_cast<int32_t>(row), 0), vk::Extent3D(width, rows, 1));
+	}
+}
+
+void vkUtil::UploadBatch::stage_image(const char* texels, vk::DeviceSize size, vk::Image dstImage, vk::Offset3D offset, vk::Extent3D extent)
+{
+	StagingSpace space = ring.allocate(*this, size);
+	std::memcpy(space.data, texels, size);
+	stagedBytes += size;
+
+	vk::BufferImageCopy region;
+	region.bufferOffset = space.offset;
+	region.bufferRowLength = 0;
+	region.bufferImageHeight = 0;
+	region.imageSubresource = vk::ImageSubresourceLayers(vk::ImageAspectFlagBits::eColor, 0, 0, 1);
+	region.imageOffset = offset;
+	region.imageExtent = extent;
+	copy_buffer_to_image(space.buffer, dstImage, region);
+}
+
+void vkUtil::UploadBatch::copy_buffer(vk::Buffer srcBuffer, vk::Buffer dstBuffer, const vk::BufferCopy& region)
+{
+	if (region.size == 0) return;
+	bufferCopies.push_back({ srcBuffer, dstBuffer, region });
+}
+
+void vkUtil::UploadBatch::copy_buffer_to_image(vk::Buffer srcBuffer, vk::Image dstImage, const vk::BufferImageCopy& region)
+{
+	imageCopies.push_back({ srcBuffer, dstImage, region });
+}
+
+void vkUtil::UploadBatch::transition_image(vk::Image image, vk::ImageLayout oldLayout, vk::ImageLayout newLayout, vk::ImageAspectFlags aspect)
+{
+	vk::ImageMemoryBarrier barrier;
+	barrier.oldLayout = oldLayout;
+	barrier.newLayout = newLayout;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.image = image;
+	barrier.subresourceRange = vk::ImageSubresourceRange(aspect, 0, 1, 0, 1);
+
+	if (newLayout == vk::ImageLayout::eTransferDstOptimal) {
+		barrier.srcAccessMask = vk::AccessFlagBits::eNoneKHR;
+		barrier.dstAccessMask = vk::AccessFlagBits::eTransferWrite;
+		toTransfer.push_back(barrier);
+	}
+	else {
+		barrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+		barrier.dstAccessMask = vk::AccessFlagBits::eShaderRead;
+		fromTransfer.push_back(barrier);
+	}
+}
+
+void vkUtil::UploadBatch::release(Buffer stagingBuffer)
+{
+	released.push_back(stagingBuffer);
+}
+
+bool vkUtil::UploadBatch::empty() const
+{
+	return toTransfer.empty() && fromTransfer.empty() && bufferCopies.empty() && imageCopies.empty();
+}
+
+void vkUtil::UploadBatch::record_copies(vk::CommandBuffer commandBuffer)
+{
+	if (!toTransfer.empty()) {
+		commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe, vk::PipelineStageFlagBits::eTransfer,
+			vk::DependencyFlags(), nullptr, nullptr, toTransfer);
+		++barrierCount;
+	}
+
+	// one vkCmdCopyBuffer per source/destination pair, regions in the order
+	// they were added
+	std::stable_sort(bufferCopies.begin(), bufferCopies.end(), [](const BufferCopy& a, const BufferCopy& b) {
+		return std::tie(a.srcBuffer, a.dstBuffer) < std::tie(b.srcBuffer, b.dstBuffer);
+	});
+	std::vector<vk::BufferCopy> regions;
+	for (size_t first = 0; first < bufferCopies.size(); ) {
+		size_t last = first;
+		regions.clear();
+		while (last < bufferCopies.size() && bufferCopies[last].srcBuffer == bufferCopies[first].srcBuffer
+			&& bufferCopies[last].dstBuffer == bufferCopies[first].dstBuffer) {
+			regions.push_back(bufferCopies[last++].region);
+		}
+		commandBuffer.copyBuffer(bufferCopies[first].srcBuffer, bufferCopies[first].dstBuffer, regions);
+		first = last;
+	}
+	bufferCopyCount += bufferCopies.size();
+
+	for (const auto& copy : imageCopies) {
+		commandBuffer.copyBufferToImage(copy.srcBuffer, copy.dstImage, vk::ImageLayout::eTransferDstOptimal, copy.region);
+	}
+	imageCopyCount += imageCopies.size();
+}
+
+std::vector<vk::BufferMemoryBarrier> vkUtil::UploadBatch::written_ranges() const
+{
+	std::vector<std::tuple<vk::Buffer, vk::DeviceSize, vk::DeviceSize>> ranges;
+	ranges.reserve(bufferCopies.size());
+	for (const auto& copy : bufferCopies) {
+		ranges.emplace_back(copy.dstBuffer, copy.region.dstOffset, copy.region.dstOffset + copy.region.size);
+	}
+	std::sort(ranges.begin(), ranges.end());
+
+	std::vector<vk::BufferMemoryBarrier> barriers;
+	for (const auto& [buffer, begin, end] : ranges) {
+		if (!barriers.empty() && barriers.back().buffer == buffer && begin <= barriers.back().offset + barriers.back().size) {
+			vk::DeviceSize merged = std::max(barriers.back().offset + barriers.back().size, end);
+			barriers.back().size = merged - barriers.back().offset;
+			continue;
+		}
+		vk::BufferMemoryBarrier barrier;
+		barrier.buffer = buffer;
+		barrier.offset = begin;
+		barrier.size = end - begin;
+		barriers.push_back(barrier);
+	}
+	return barriers;
+}
+
+uint64_t vkUtil::UploadBatch::submit_async()
+{
+	if (empty()) {
+		transfer.release(std::move(released));
+		released.clear();
+		return 0;
+	}
+
+	vk::CommandBuffer commandBuffer = transfer.begin();
+	record_copies(commandBuffer);
+
+	std::vector<vk::BufferMemoryBarrier> bufferAcquires;
+	std::vector<vk::ImageMemoryBarrier> imageAcquires;
+	if (transfer.dedicated()) {
+		// Release to the graphics family; only the ranges written here change
+		// owner, so the rest of a shared buffer stays usable while this runs.
+		// The matching acquires are recorded by the graphics queue.
+		std::vector<vk::BufferMemoryBarrier> bufferReleases = written_ranges();
+		std::vector<vk::ImageMemoryBarrier> imageReleases = fromTransfer;
+		for (auto& barrier : bufferReleases) {
+			barrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+			barrier.srcQueueFamilyIndex = transfer.family;
+			barrier.dstQueueFamilyIndex = transfer.graphicsFamily;
+			bufferAcquires.push_back(barrier);
+			bufferAcquires.back().srcAccessMask = vk::AccessFlagBits::eNoneKHR;
+			bufferAcquires.back().dstAccessMask = uploadConsumerAccess;
+		}
+		for (auto& barrier : imageReleases) {
+			barrier.dstAccessMask = vk::AccessFlagBits::eNoneKHR;
+			barrier.srcQueueFamilyIndex = transfer.family;
+			barrier.dstQueueFamilyIndex = transfer.graphicsFamily;
+			imageAcquires.push_back(barrier);
+			imageAcquires.back().srcAccessMask = vk::AccessFlagBits::eNoneKHR;
+			imageAcquires.back().dstAccessMask = vk::AccessFlagBits::eShaderRead;
+		}
+		if (!bufferReleases.empty() || !imageReleases.empty()) {
+			commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eBottomOfPipe,
+				vk::DependencyFlags(), nullptr, bufferReleases, imageReleases);
+			++barrierCount;
+		}
+	}
+	else {
+		// buffer writes are covered by a global barrier, images need their own
+		// for the layout change
+		std::vector<vk::MemoryBarrier> bufferBarriers;
+		if (!bufferCopies.empty()) {
+			vk::MemoryBarrier barrier;
+			barrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+			barrier.dstAccessMask = uploadConsumerAccess;
+			bufferBarriers.push_back(barrier);
+		}
+		if (!bufferBarriers.empty() || !fromTransfer.empty()) {
+			commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, uploadConsumerStages, vk::DependencyFlags(),
+				bufferBarriers, nullptr, fromTransfer);
+			++barrierCount;
+		}
+	}
+
+	uint64_t value = transfer.submit(commandBuffer, std::move(released), std::move(bufferAcquires), std::move(imageAcquires));
+	ring.retire(*this, value);
+	++submissions;
+
+	toTransfer.clear();
+	fromTransfer.clear();
+	bufferCopies.clear();
+	imageCopies.clear();
+	released.clear();
+	return value;
+}
+
+void vkUtil::UploadBatch::submit()
+{
+	transfer.wait(submit_async());
+	transfer.collect();
+}
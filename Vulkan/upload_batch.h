@@ -0,0 +1,92 @@
+#pragma once
+#include "config.h"
+#include "memory.h"
+#include "transfer_queue.h"
+#include "staging_ring.h"
+
+namespace vkUtil {
+	struct UploadStats {
+		size_t submissions;
+		size_t bufferCopies, imageCopies;
+		size_t barriers;
+		// bytes that went through the staging ring, and bytes written
+		// straight into mapped destination buffers
+		vk::DeviceSize stagedBytes, directBytes;
+	};
+
+	// Collects the copies and layout transitions of a loading phase and
+	// records them into one command buffer of a TransferQueue. Data is
+	// staged in the shared StagingRing, split into pieces that fit it. A single barrier
+	// moves every image to TRANSFER_DST, the copies follow (grouped per
+	// source/destination pair), and a second barrier hands images and buffers
+	// to the shaders, releasing them to the graphics family when the transfer
+	// queue has its own.
+	class UploadBatch {
+	public:
+		UploadBatch(TransferQueue& transfer, StagingRing& ring);
+		~UploadBatch();
+
+		UploadBatch(const UploadBatch&) = delete;
+		UploadBatch& operator=(const UploadBatch&) = delete;
+
+		// Copies size bytes of data to dstOffset in dstBuffer. Host-visible
+		// (mapped) destinations are written in place at once, the range must
+		// not be in use by the GPU; others go through the ring.
+		void write_buffer(const void* data, vk::DeviceSize size, const Buffer& dstBuffer, vk::DeviceSize dstOffset);
+		// Space for size bytes (at most piece_size()) that land at dstOffset
+		// in dstBuffer: the destination itself when it is mapped, otherwise
+		// staging. Fill it before staging anything else.
+		void* allocate_buffer(vk::DeviceSize size, const Buffer& dstBuffer, vk::DeviceSize dstOffset);
+		// Copies tightly packed texels to the whole of dstImage, which must be in
+		// TRANSFER_DST by then, in bands of rows, or pieces of rows when one
+		// row is more than piece_size().
+		void write_image(const void* texels, uint32_t width, uint32_t height, uint32_t texelSize, vk::Image dstImage);
+		vk::DeviceSize piece_size() const { return ring.piece_size(); }
+
+		void copy_buffer(vk::Buffer srcBuffer, vk::Buffer dstBuffer, const vk::BufferCopy& region);
+		void copy_buffer_to_image(vk::Buffer srcBuffer, vk::Image dstImage, const vk::BufferImageCopy& region);
+		// Transitions into TRANSFER_DST run before the copies, all others after.
+		void transition_image(vk::Image image, vk::ImageLayout oldLayout, vk::ImageLayout newLayout, vk::ImageAspectFlags aspect = vk::ImageAspectFlagBits::eColor);
+		// Destroyed once the batch has executed.
+		void release(Buffer stagingBuffer);
+
+		bool empty() const;
+		// Records and submits everything pending without waiting; returns the
+		// transfer timeline value that marks its completion (0 if there was
+		// nothing to do). The graphics queue picks it up through
+		// TransferQueue::acquire.
+		uint64_t submit_async();
+		// submit_async, then waits for it on the host.
+		void submit();
+
+		UploadStats stats() const { return { submissions, bufferCopyCount, imageCopyCount, barrierCount, stagedBytes, directBytes }; }
+
+	private:
+		struct BufferCopy {
+			vk::Buffer srcBuffer, dstBuffer;
+			vk::BufferCopy region;
+		};
+		struct ImageCopy {
+			vk::Buffer srcBuffer;
+			vk::Image dstImage;
+			vk::BufferImageCopy region;
+		};
+
+		TransferQueue& transfer;
+		StagingRing& ring;
+
+		std::vector<vk::ImageMemoryBarrier> toTransfer, fromTransfer;
+		std::vector<BufferCopy> bufferCopies;
+		std::vector<ImageCopy> imageCopies;
+		std::vector<Buffer> released;
+
+		size_t submissions = 0, bufferCopyCount = 0, imageCopyCount = 0, barrierCount = 0;
+		vk::DeviceSize stagedBytes = 0, directBytes = 0;
+
+		// size bytes of texels staged and copied to the extent at offset
+		void stage_image(const char* texels, vk::DeviceSize size, vk::Image dstImage, vk::Offset3D offset, vk::Extent3D extent);
+		void record_copies(vk::CommandBuffer commandBuffer);
+		// the written part of every destination buffer, merged
+		std::vector<vk::BufferMemoryBarrier> written_ranges() const;
+	};
+}
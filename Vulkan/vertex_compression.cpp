@@ -0,0 +1,101 @@
+#include "vertex_compression.h"
+#include <glm/gtc/packing.hpp>
+#include <cmath>
+
+namespace {
+	constexpr size_t floatsPerVertex = vkMesh::fullVertexFloats;
+
+	float sign_not_zero(float value) {
+		return value >= 0.0f ? 1.0f : -1.0f;
+	}
+}
+
+void vkMesh::encode_octahedral(const glm::vec3& normal, int16_t encoded[2])
+{
+	float length = std::fabs(normal.x) + std::fabs(normal.y) + std::fabs(normal.z);
+	if (length == 0.0f) {
+		encoded[0] = 0;
+		encoded[1] = 0;
+		return;
+	}
+
+	float x = normal.x / length;
+	float y = normal.y / length;
+	// fold the lower hemisphere over the diagonals
+	if (normal.z < 0.0f) {
+		float foldedX = (1.0f - std::fabs(y)) * sign_not_zero(x);
+		float foldedY = (1.0f - std::fabs(x)) * sign_not_zero(y);
+		x = foldedX;
+		y = foldedY;
+	}
+
+	encoded[0] = static_cast<int16_t>(glm::packSnorm1x16(x));
+	encoded[1] = static_cast<int16_t>(glm::packSnorm1x16(y));
+}
+
+glm::vec3 vkMesh::decode_octahedral(const int16_t encoded[2])
+{
+	glm::vec3 normal(
+		std::max(encoded[0] / 32767.0f, -1.0f),
+		std::max(encoded[1] / 32767.0f, -1.0f),
+		0.0f);
+	normal.z = 1.0f - std::fabs(normal.x) - std::fabs(normal.y);
+	float fold = std::max(-normal.z, 0.0f);
+	normal.x += normal.x >= 0.0f ? -fold : fold;
+	normal.y += normal.y >= 0.0f ? -fold : fold;
+	return glm::normalize(normal);
+}
+
+vkMesh::VertexQuantizer::VertexQuantizer(const glm::vec3& low, const glm::vec3& high, uint32_t paletteBase)
+	: low(low), extent(high - low), paletteBase(paletteBase)
+{
+	for (int axis = 0; axis < 3; ++axis) {
+		if (extent[axis] <= 0.0f) extent[axis] = 1.0f;
+	}
+	bounds.origin = glm::vec4(low, 0.0f);
+	bounds.scale = glm::vec4(extent / 65535.0f, 0.0f);
+}
+
+void vkMesh::VertexQuantizer::encode(std::span<const float> vertices, CompactVertex* out)
+{
+	size_t vertexCount = vertices.size() / floatsPerVertex;
+	for (size_t i = 0; i < vertexCount; ++i) {
+		const float* source = &vertices[i * floatsPerVertex];
+		CompactVertex& vertex = out[i];
+
+		for (int axis = 0; axis < 3; ++axis) {
+			vertex.position[axis] = glm::packUnorm1x16((source[axis] - low[axis]) / extent[axis]);
+		}
+
+		glm::vec3 color(source[3], source[4], source[5]);
+		auto [entry, added] = colors.try_emplace(color, static_cast<uint32_t>(palette.size()));
+		if (added) palette.push_back(glm::vec4(color, 1.0f));
+		vertex.position[3] = static_cast<uint16_t>(paletteBase + entry->second);
+
+		vertex.texcoord[0] = glm::packHalf1x16(source[6]);
+		vertex.texcoord[1] = glm::packHalf1x16(source[7]);
+
+		encode_octahedral(glm::vec3(source[8], source[9], source[10]), vertex.normal);
+	}
+}
+
+vkMesh::CompactMesh vkMesh::compress_vertices(std::span<const float> vertices, uint32_t paletteBase)
+{
+	CompactMesh mesh;
+	size_t vertexCount = vertices.size() / floatsPerVertex;
+	mesh.vertices.resize(vertexCount);
+
+	glm::vec3 low(0.0f), high(0.0f);
+	for (size_t i = 0; i < vertexCount; ++i) {
+		glm::vec3 position(vertices[i * floatsPerVertex], vertices[i * floatsPerVertex + 1], vertices[i * floatsPerVertex + 2]);
+		low = i ? glm::min(low, position) : position;
+		high = i ? glm::max(high, position) : position;
+	}
+
+	VertexQuantizer quantizer(low, high, paletteBase);
+	quantizer.encode(vertices, mesh.vertices.data());
+	mesh.bounds = quantizer.bounds;
+	mesh.palette = std::move(quantizer.palette);
+
+	return mesh;
+}
@@ -0,0 +1,75 @@
+#pragma once
+#include "config.h"
+#include "vertex_layout.h"
+#include <span>
+
+namespace vkMesh {
+	// 16-byte vertex used by VertexFormat::COMPACT, against 44 bytes for the
+	// 11-float layout:
+	//   position: unorm16 xyz inside the mesh bounds, w = material palette index
+	//   normal:   octahedral snorm16
+	//   texcoord: half float
+	struct CompactVertex {
+		uint16_t position[4];
+		int16_t normal[2];
+		uint16_t texcoord[2];
+
+		static constexpr std::array<VertexAttribute, 3> attributes() {
+			return { {
+				{ 0, vk::Format::eR16G16B16A16Uint, offsetof(CompactVertex, position) },
+				{ 2, vk::Format::eR16G16Sfloat, offsetof(CompactVertex, texcoord) },
+				{ 3, vk::Format::eR16G16Snorm, offsetof(CompactVertex, normal) },
+			} };
+		}
+	};
+	static_assert(sizeof(CompactVertex) == 16);
+
+	// Palette entries a 16-bit CompactVertex::position[3] can address.
+	constexpr uint32_t maxPaletteEntries = 65536;
+
+	// Pushed per draw; the vertex shader rebuilds a position as
+	// origin + quantized * scale.
+	struct MeshBounds {
+		glm::vec4 origin;
+		glm::vec4 scale;
+	};
+
+	struct CompactMesh {
+		std::vector<CompactVertex> vertices;
+		MeshBounds bounds;
+		// distinct vertex colors, addressed by CompactVertex::position[3]
+		std::vector<glm::vec4> palette;
+	};
+
+	struct ColorHash {
+		size_t operator()(const glm::vec3& color) const {
+			size_t hash = std::hash<float>{}(color.r);
+			hash = hash * 31 + std::hash<float>{}(color.g);
+			return hash * 31 + std::hash<float>{}(color.b);
+		}
+	};
+
+	// Quantizes FullVertex floats against fixed bounds, so a mesh can be
+	// encoded block by block as it streams in. Colors not seen before are
+	// appended to palette.
+	class VertexQuantizer {
+	public:
+		VertexQuantizer(const glm::vec3& low, const glm::vec3& high, uint32_t paletteBase = 0);
+		void encode(std::span<const float> vertices, CompactVertex* out);
+
+		MeshBounds bounds;
+		std::vector<glm::vec4> palette;
+
+	private:
+		glm::vec3 low, extent;
+		uint32_t paletteBase;
+		std::unordered_map<glm::vec3, uint32_t, ColorHash> colors;
+	};
+
+	// Quantizes a FullVertex float stream. Palette indices
+	// start at paletteBase so several meshes can share one palette buffer.
+	CompactMesh compress_vertices(std::span<const float> vertices, uint32_t paletteBase = 0);
+
+	void encode_octahedral(const glm::vec3& normal, int16_t encoded[2]);
+	glm::vec3 decode_octahedral(const int16_t encoded[2]);
+}
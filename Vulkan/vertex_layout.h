@@ -0,0 +1,147 @@
+#pragma once
+#include "config.h"
+#include <array>
+#include <cstring>
+#include <span>
+
+namespace vkMesh {
+	struct VertexAttribute {
+		uint32_t location;
+		vk::Format format;
+		uint32_t offset;
+	};
+
+	constexpr uint32_t format_size(vk::Format format) {
+		switch (format) {
+		case vk::Format::eR16G16Snorm:
+		case vk::Format::eR16G16Sfloat:
+		case vk::Format::eR32Sfloat:
+			return 4;
+		case vk::Format::eR16G16B16A16Uint:
+		case vk::Format::eR32G32Sfloat:
+			return 8;
+		case vk::Format::eR32G32B32Sfloat:
+			return 12;
+		case vk::Format::eR32G32B32A32Sfloat:
+			return 16;
+		default:
+			return 0;
+		}
+	}
+
+	// Format of a plain float attribute, deduced from its member type.
+	template<typename T>
+	constexpr vk::Format attribute_format() {
+		if constexpr (std::is_same_v<T, float>) return vk::Format::eR32Sfloat;
+		else if constexpr (std::is_same_v<T, glm::vec2>) return vk::Format::eR32G32Sfloat;
+		else if constexpr (std::is_same_v<T, glm::vec3>) return vk::Format::eR32G32B32Sfloat;
+		else if constexpr (std::is_same_v<T, glm::vec4>) return vk::Format::eR32G32B32A32Sfloat;
+		else static_assert(sizeof(T) == 0, "no implicit format for this attribute type, spell it out");
+	}
+
+	// Attribute for a float member: format and offset come from the struct itself.
+	#define VKMESH_ATTRIBUTE(Vertex, member, location) \
+		vkMesh::VertexAttribute{ location, vkMesh::attribute_format<decltype(Vertex::member)>(), static_cast<uint32_t>(offsetof(Vertex, member)) }
+
+	// True when every attribute has a known size, sits inside the stride and
+	// overlaps no other attribute or location.
+	template<typename Vertex>
+	constexpr bool attributes_fit() {
+		constexpr auto attributes = Vertex::attributes();
+		for (size_t i = 0; i < attributes.size(); ++i) {
+			uint32_t size = format_size(attributes[i].format);
+			if (size == 0 || attributes[i].offset + size > sizeof(Vertex)) return false;
+			for (size_t j = 0; j < i; ++j) {
+				uint32_t otherSize = format_size(attributes[j].format);
+				bool disjoint = attributes[i].offset + size <= attributes[j].offset
+					|| attributes[j].offset + otherSize <= attributes[i].offset;
+				if (!disjoint || attributes[i].location == attributes[j].location) return false;
+			}
+		}
+		return true;
+	}
+
+	// Everything Vulkan needs to know about a vertex struct, derived from its
+	// static constexpr attributes() so stride and offsets cannot drift apart.
+	template<typename Vertex>
+	struct VertexLayout {
+		static constexpr auto attributes = Vertex::attributes();
+		static constexpr uint32_t stride = sizeof(Vertex);
+		static_assert(attributes_fit<Vertex>(), "vertex attributes overlap or run past the stride");
+
+		static std::vector<vk::VertexInputBindingDescription> binding_descriptions(uint32_t binding = 0) {
+			std::vector<vk::VertexInputBindingDescription> bindingDescriptions(1);
+			bindingDescriptions[0].binding = binding;
+			bindingDescriptions[0].stride = stride;
+			bindingDescriptions[0].inputRate = vk::VertexInputRate::eVertex;
+			return bindingDescriptions;
+		}
+
+		// locationMask picks a subset, e.g. only the position for a depth-only
+		// pipeline reading the same vertex buffer.
+		static std::vector<vk::VertexInputAttributeDescription> attribute_descriptions(uint32_t binding = 0, uint32_t locationMask = ~0u) {
+			std::vector<vk::VertexInputAttributeDescription> descriptions;
+			for (const auto& attribute : attributes) {
+				if (!(locationMask & (1u << attribute.location))) continue;
+				vk::VertexInputAttributeDescription description;
+				description.binding = binding;
+				description.location = attribute.location;
+				description.format = attribute.format;
+				description.offset = attribute.offset;
+				descriptions.push_back(description);
+			}
+			return descriptions;
+		}
+	};
+
+	// Appends typed vertices to a float stream (the importer and mesh cache format).
+	template<typename Vertex>
+	class VertexWriter {
+	public:
+		static_assert(sizeof(Vertex) % sizeof(float) == 0, "vertex must be a whole number of floats");
+		static_assert(std::is_trivially_copyable_v<Vertex>);
+		static constexpr size_t floatCount = sizeof(Vertex) / sizeof(float);
+
+		explicit VertexWriter(std::vector<float>& stream) : stream(stream) {}
+
+		void append(const Vertex& vertex) {
+			size_t end = stream.size();
+			stream.resize(end + floatCount);
+			std::memcpy(stream.data() + end, &vertex, sizeof(Vertex));
+		}
+
+		static size_t vertex_count(std::span<const float> stream) { return stream.size() / floatCount; }
+
+		static Vertex read(std::span<const float> stream, size_t index) {
+			Vertex vertex;
+			std::memcpy(&vertex, stream.data() + index * floatCount, sizeof(Vertex));
+			return vertex;
+		}
+
+	private:
+		std::vector<float>& stream;
+	};
+
+	// The importer's vertex: what the .obj path produces and the mesh cache stores.
+	struct FullVertex {
+		glm::vec3 position;
+		glm::vec3 color;
+		glm::vec2 texcoord;
+		glm::vec3 normal;
+
+		static constexpr std::array<VertexAttribute, 4> attributes() {
+			return { {
+				VKMESH_ATTRIBUTE(FullVertex, position, 0),
+				VKMESH_ATTRIBUTE(FullVertex, color, 1),
+				VKMESH_ATTRIBUTE(FullVertex, texcoord, 2),
+				VKMESH_ATTRIBUTE(FullVertex, normal, 3),
+			} };
+		}
+	};
+	static_assert(sizeof(FullVertex) == 11 * sizeof(float));
+
+	// Location mask that keeps only the position, for depth-only pipelines.
+	constexpr uint32_t positionOnly = 1u << 0;
+
+	constexpr size_t fullVertexFloats = VertexWriter<FullVertex>::floatCount;
+}
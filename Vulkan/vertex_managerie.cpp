@@ -1,81 +1,512 @@
 #include "vertex_managerie.h"
+#include <algorithm>
 
-VertexManagerie::VertexManagerie()
+namespace {
+	constexpr uint32_t noRegion = vkUtil::TlsfHeap::none;
+}
+
+VertexManagerie::VertexManagerie(VertexFormat format)
+	: format(format)
 {
-	indexOffset = 0;
+	unusedVertexBytes = 0;
+
+	buffers[VERTICES].stride = format == VertexFormat::COMPACT ? sizeof(vkMesh::CompactVertex) : sizeof(vkMesh::FullVertex);
+	buffers[VERTICES].usage = vk::BufferUsageFlagBits::eVertexBuffer;
+	buffers[INDICES16].stride = sizeof(uint16_t);
+	buffers[INDICES16].usage = vk::BufferUsageFlagBits::eIndexBuffer;
+	buffers[INDICES32].stride = sizeof(uint32_t);
+	buffers[INDICES32].usage = vk::BufferUsageFlagBits::eIndexBuffer;
+	buffers[PALETTE].stride = sizeof(glm::vec4);
+	buffers[PALETTE].usage = vk::BufferUsageFlagBits::eStorageBuffer;
 }
 
 VertexManagerie::~VertexManagerie()
 {
-	device.destroyBuffer(vertexBuffer.buffer);
-	device.freeMemory(vertexBuffer.bufferMemory);
+	for (auto& geometry : buffers) vkUtil::destroyBuffer(device, geometry.buffer);
+	for (auto& retired : retiredBuffers) vkUtil::destroyBuffer(device, retired.buffer);
+}
+
+
+MeshHandle VertexManagerie::new_slot(meshTypes type, vk::IndexType indexType)
+{
+	uint32_t index;
+	if (freeSlots.empty()) {
+		index = static_cast<uint32_t>(slots.size());
+		slots.emplace_back();
+	}
+	else {
+		index = freeSlots.back();
+		freeSlots.pop_back();
+	}
+
+	Slot& slot = slots[index];
+	slot.live = true;
+	slot.placed = false;
+	slot.regions.fill(noRegion);
+	slot.record = {};
+	slot.record.indexType = indexType;
+
+	MeshHandle handle{ index, slot.generation };
+	handles.insert_or_assign(type, handle);
+	return handle;
+}
+
+
+MeshHandle VertexManagerie::consume(meshTypes type, std::span<const float> vertexData, std::span<const uint32_t> indexData, std::span<const vkMesh::MeshLod> lodData)
+{
+	size_t vertexCount = vkMesh::VertexWriter<vkMesh::FullVertex>::vertex_count(vertexData);
+	bool narrow = vertexCount <= 65536;
+	MeshHandle handle = new_slot(type, narrow ? vk::IndexType::eUint16 : vk::IndexType::eUint32);
+	MeshRecord& record = slots[handle.index].record;
+
+	record.lods.assign(lodData.begin(), lodData.end());
+	if (record.lods.empty()) record.lods.push_back({ 0, static_cast<uint32_t>(indexData.size()), 0.0f });
+	const vkMesh::MeshLod& finest = record.lods[0];
+
+	record.meshlets = vkMesh::build_meshlets(indexData.subspan(finest.firstIndex, finest.indexCount), vertexData, vkMesh::fullVertexFloats);
+	for (auto& meshlet : record.meshlets) meshlet.firstIndex += finest.firstIndex;
+	record.volume = vkMesh::mesh_volume(vertexData, vkMesh::fullVertexFloats);
+
+	PendingMesh mesh;
+	mesh.slot = handle.index;
+	if (format == VertexFormat::COMPACT) {
+		// palette indices start at 0 here and are moved to the mesh's
+		// palette range when it is placed
+		auto compact = vkMesh::compress_vertices(vertexData);
+		record.bounds = compact.bounds;
+		mesh.compactVertices = std::move(compact.vertices);
+		mesh.palette = std::move(compact.palette);
+	}
+	else {
+		mesh.vertices.assign(vertexData.begin(), vertexData.end());
+	}
+	mesh.indices.assign(indexData.begin(), indexData.end());
+
+	mesh.counts[VERTICES] = vertexCount;
+	mesh.counts[narrow ? INDICES16 : INDICES32] = indexData.size();
+	mesh.counts[PALETTE] = mesh.palette.size();
+	pendingMeshes.push_back(std::move(mesh));
+	return handle;
+}
+
+
+MeshHandle VertexManagerie::stream(meshTypes type, const char* objFilepath, const char* mtlFilepath, glm::mat4 preTransform, const vkMesh::StreamingOptions& options)
+{
+	PendingMesh mesh;
+	mesh.source = std::make_unique<vkMesh::ObjStream>(objFilepath, mtlFilepath, preTransform, options);
+
+	// sized for the worst case, known after the stream's first pass
+	bool narrow = mesh.source->max_vertex_count() <= 65536;
+	MeshHandle handle = new_slot(type, narrow ? vk::IndexType::eUint16 : vk::IndexType::eUint32);
+	auto indexCount = static_cast<uint32_t>(mesh.source->index_count());
+	slots[handle.index].record.lods.push_back({ 0, indexCount, 0.0f });
+	slots[handle.index].record.volume = vkMesh::mesh_volume(mesh.source->low, mesh.source->high);
+
+	mesh.slot = handle.index;
+	mesh.counts[VERTICES] = mesh.source->max_vertex_count();
+	mesh.counts[narrow ? INDICES16 : INDICES32] = indexCount;
+	// every color comes from a material
+	mesh.counts[PALETTE] = format == VertexFormat::COMPACT ? mesh.source->material_count() : 0;
+	pendingMeshes.push_back(std::move(mesh));
+	return handle;
+}
+
+
+const MeshRecord* VertexManagerie::find(MeshHandle mesh) const
+{
+	if (mesh.index >= slots.size()) return nullptr;
+	const Slot& slot = slots[mesh.index];
+	if (!slot.live || !slot.placed || slot.generation != mesh.generation) return nullptr;
+	return &slot.record;
+}
 
-	device.destroyBuffer(indexBuffer.buffer);
-	device.freeMemory(indexBuffer.bufferMemory);
+const MeshRecord* VertexManagerie::find(meshTypes type) const
+{
+	auto handle = handles.find(type);
+	return handle != handles.end() ? find(handle->second) : nullptr;
 }
 
+const vkUtil::Buffer& VertexManagerie::index_buffer(vk::IndexType type) const
+{
+	return buffers[type == vk::IndexType::eUint16 ? INDICES16 : INDICES32].buffer;
+}
 
-void VertexManagerie::consume(meshTypes type, std::vector<float> vertexData, std::vector<uint32_t> indexData)
+vk::DeviceSize VertexManagerie::palette_bytes() const
 {
-	auto vertexCount = static_cast<int>(vertexData.size() / 11);
-	auto indexCount = static_cast<int>(indexData.size());
-	auto lastIndex = static_cast<int>(indexLump.size());
+	return buffers[PALETTE].heap.capacity() * buffers[PALETTE].stride;
+}
 
-	
-	firstIndices.insert(std::make_pair(type, lastIndex));
-	indexCounts.insert(std::make_pair(type, indexCount));
 
-	for (auto attribute : vertexData) vertexLump.push_back(attribute);
-	for (auto index : indexData) indexLump.push_back(index + indexOffset);
+vkUtil::Buffer VertexManagerie::create_device_buffer(vk::DeviceSize size, vk::BufferUsageFlags usage)
+{
+	vkUtil::BufferInput inputChunk;
+	inputChunk.device = device;
+	inputChunk.physicalDevice = physicalDevice;
+	inputChunk.size = size;
+	// growth and compaction copy out of it
+	inputChunk.usage = vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eTransferSrc | usage;
+	inputChunk.memoryProperties = memoryProperties;
+	inputChunk.allocator = allocator;
+	return vkUtil::createBuffer(inputChunk);
+}
 
-	indexOffset += vertexCount;
+
+void VertexManagerie::retire(vkUtil::Buffer buffer)
+{
+	if (buffer.buffer) retiredBuffers.push_back({ retire_frame(), buffer });
+}
+
+
+void VertexManagerie::grow(GeometryKind kind, vk::DeviceSize capacity, vkUtil::UploadBatch& uploads)
+{
+	GeometryBuffer& geometry = buffers[kind];
+	vk::DeviceSize current = geometry.heap.capacity();
+	if (current) capacity = std::max(capacity, current + current / 2);
+	vkUtil::Buffer grown = create_device_buffer(capacity * geometry.stride, geometry.usage);
+
+	if (geometry.buffer.buffer) {
+		// the copy runs on the graphics queue, after the uploads it waits
+		// for; whatever the batch still holds for the old buffer goes first
+		uploads.submit_async();
+
+		// ranges keep their offsets, only live meshes are copied
+		Relocation relocation{ geometry.buffer.buffer, grown.buffer, {} };
+		for (const Slot& slot : slots) {
+			if (!slot.placed || slot.regions[kind] == noRegion) continue;
+			vk::DeviceSize offset = geometry.heap.offset(slot.regions[kind]) * geometry.stride;
+			vk::DeviceSize size = geometry.heap.size(slot.regions[kind]) * geometry.stride;
+			relocation.regions.push_back({ offset, offset, size });
+			relocatedBytes += size;
+		}
+		if (!relocation.regions.empty()) relocations.push_back(std::move(relocation));
+		retire(geometry.buffer);
+	}
+
+	geometry.buffer = grown;
+	geometry.heap.grow(capacity);
+}
+
+
+uint32_t VertexManagerie::allocate(GeometryKind kind, vk::DeviceSize count, vkUtil::UploadBatch& uploads)
+{
+	if (count == 0) return noRegion;
+	vkUtil::TlsfHeap& heap = buffers[kind].heap;
+	uint32_t region = heap.allocate(count, 1);
+	if (region != noRegion) return region;
+
+	// enough room past the current end, however fragmented the rest is
+	grow(kind, heap.capacity() + count, uploads);
+	return heap.allocate(count, 1);
+}
+
+
+void VertexManagerie::update_record(Slot& slot)
+{
+	GeometryKind indexKind = slot.record.indexType == vk::IndexType::eUint16 ? INDICES16 : INDICES32;
+	uint32_t vertexRegion = slot.regions[VERTICES], indexRegion = slot.regions[indexKind];
+	slot.record.vertexOffset = vertexRegion != noRegion ? static_cast<int>(buffers[VERTICES].heap.offset(vertexRegion)) : 0;
+	slot.record.firstIndex = indexRegion != noRegion ? static_cast<uint32_t>(buffers[indexKind].heap.offset(indexRegion)) : 0;
+}
+
+
+void VertexManagerie::place(PendingMesh& mesh, vkUtil::UploadBatch& uploads)
+{
+	// Every range is taken before anything is written: a later allocation may
+	// move the buffers, and writes have to go to the buffers meshes end up in.
+	GeometryKind indexKind = slots[mesh.slot].record.indexType == vk::IndexType::eUint16 ? INDICES16 : INDICES32;
+	std::array<uint32_t, GEOMETRY_KIND_COUNT> regions;
+	regions.fill(noRegion);
+	for (GeometryKind kind : { VERTICES, indexKind, PALETTE }) {
+		regions[kind] = allocate(kind, mesh.counts[kind], uploads);
+	}
+
+	if (regions[PALETTE] != noRegion && buffers[PALETTE].heap.offset(regions[PALETTE]) + mesh.counts[PALETTE] > vkMesh::maxPaletteEntries) {
+#ifndef NDEBUG
+		std::cerr << "Mesh palette ends past entry " << vkMesh::maxPaletteEntries << ", the mesh is dropped" << std::endl;
+#endif
+		// nothing has been written to them yet
+		for (size_t kind = 0; kind < GEOMETRY_KIND_COUNT; ++kind) {
+			if (regions[kind] != noRegion) buffers[kind].heap.free(regions[kind]);
+		}
+		release_slot(mesh.slot);
+		return;
+	}
+
+	Slot& slot = slots[mesh.slot];
+	slot.regions = regions;
+	slot.placed = true;
+	update_record(slot);
+
+	if (mesh.source) {
+		stream_mesh(slot, *mesh.source, uploads);
+		// drops the spilled attributes
+		mesh.source.reset();
+		return;
+	}
+
+	const GeometryBuffer& vertexBuffer = buffers[VERTICES];
+	vk::DeviceSize vertexOffset = vertexBuffer.stride * slot.record.vertexOffset;
+	if (format == VertexFormat::COMPACT) {
+		// below maxPaletteEntries, checked above
+		auto paletteBase = static_cast<uint16_t>(regions[PALETTE] != noRegion ? buffers[PALETTE].heap.offset(regions[PALETTE]) : 0);
+		for (auto& vertex : mesh.compactVertices) vertex.position[3] += paletteBase;
+		uploads.write_buffer(mesh.compactVertices.data(), sizeof(vkMesh::CompactVertex) * mesh.compactVertices.size(), vertexBuffer.buffer, vertexOffset);
+		if (!mesh.palette.empty()) {
+			uploads.write_buffer(mesh.palette.data(), sizeof(glm::vec4) * mesh.palette.size(), buffers[PALETTE].buffer,
+				sizeof(glm::vec4) * paletteBase);
+		}
+	}
+	else {
+		uploads.write_buffer(mesh.vertices.data(), sizeof(float) * mesh.vertices.size(), vertexBuffer.buffer, vertexOffset);
+	}
+
+	const GeometryBuffer& indexBuffer = buffers[indexKind];
+	vk::DeviceSize indexOffset = indexBuffer.stride * slot.record.firstIndex;
+	if (indexKind == INDICES16) {
+		size_t indexPiece = uploads.piece_size() / sizeof(uint16_t);
+		for (size_t first = 0; first < mesh.indices.size(); first += indexPiece) {
+			size_t count = std::min(indexPiece, mesh.indices.size() - first);
+			auto narrowed = static_cast<uint16_t*>(uploads.allocate_buffer(sizeof(uint16_t) * count, indexBuffer.buffer, indexOffset + sizeof(uint16_t) * first));
+			for (size_t i = 0; i < count; ++i) narrowed[i] = static_cast<uint16_t>(mesh.indices[first + i]);
+		}
+	}
+	else {
+		uploads.write_buffer(mesh.indices.data(), sizeof(uint32_t) * mesh.indices.size(), indexBuffer.buffer, indexOffset);
+	}
+}
+
+
+void VertexManagerie::stream_mesh(Slot& slot, vkMesh::ObjStream& source, vkUtil::UploadBatch& uploads)
+{
+	bool narrow = slot.record.indexType == vk::IndexType::eUint16;
+	const vkUtil::Buffer& vertexBuffer = buffers[VERTICES].buffer;
+	const vkUtil::Buffer& indexBuffer = buffers[narrow ? INDICES16 : INDICES32].buffer;
+	size_t vertexStride = buffers[VERTICES].stride;
+	uint32_t paletteBase = slot.regions[PALETTE] != noRegion ? static_cast<uint32_t>(buffers[PALETTE].heap.offset(slot.regions[PALETTE])) : 0;
+	vkMesh::VertexQuantizer quantizer(source.low, source.high, paletteBase);
+
+	// blocks are converted straight into the ring, in pieces it can hold
+	auto stats = source.emit([&](const vkMesh::MeshBlock& block) {
+		size_t blockVertices = vkMesh::VertexWriter<vkMesh::FullVertex>::vertex_count(block.vertices);
+		size_t vertexPiece = std::max<size_t>(1, uploads.piece_size() / vertexStride);
+		for (size_t first = 0; first < blockVertices; first += vertexPiece) {
+			size_t count = std::min(vertexPiece, blockVertices - first);
+			auto vertices = block.vertices.subspan(first * vkMesh::fullVertexFloats, count * vkMesh::fullVertexFloats);
+			vk::DeviceSize offset = (slot.record.vertexOffset + block.firstVertex + first) * vertexStride;
+
+			if (format == VertexFormat::COMPACT) {
+				quantizer.encode(vertices, static_cast<vkMesh::CompactVertex*>(uploads.allocate_buffer(count * vertexStride, vertexBuffer, offset)));
+			}
+			else {
+				uploads.write_buffer(vertices.data(), count * vertexStride, vertexBuffer, offset);
+			}
+		}
+
+		if (!narrow) {
+			uploads.write_buffer(block.indices.data(), sizeof(uint32_t) * block.indices.size(), indexBuffer, sizeof(uint32_t) * (slot.record.firstIndex + block.firstIndex));
+			return;
+		}
+		size_t indexPiece = uploads.piece_size() / sizeof(uint16_t);
+		for (size_t first = 0; first < block.indices.size(); first += indexPiece) {
+			size_t count = std::min(indexPiece, block.indices.size() - first);
+			vk::DeviceSize offset = sizeof(uint16_t) * (slot.record.firstIndex + block.firstIndex + first);
+			auto narrowed = static_cast<uint16_t*>(uploads.allocate_buffer(sizeof(uint16_t) * count, indexBuffer, offset));
+			for (size_t i = 0; i < count; ++i) narrowed[i] = static_cast<uint16_t>(block.indices[first + i]);
+		}
+	});
+
+	if (format == VertexFormat::COMPACT) {
+		slot.record.bounds = quantizer.bounds;
+		uploads.write_buffer(quantizer.palette.data(), sizeof(glm::vec4) * quantizer.palette.size(), buffers[PALETTE].buffer, sizeof(glm::vec4) * paletteBase);
+	}
+	unusedVertexBytes += (source.max_vertex_count() - stats.vertexCount) * vertexStride;
+
+#ifndef NDEBUG
+	std::cout << "Streamed " << stats.vertexCount << " vertices, " << stats.indexCount << " indices in "
+		<< stats.blockCount << " blocks, " << stats.windowResets << " dedup window restarts, peak "
+		<< stats.peakBytes << " bytes + " << uploads.piece_size() << " byte staging pieces" << std::endl;
+#endif
 }
 
 
 void VertexManagerie::finalize(FinalizationChunk input)
 {
 	device = input.device;
+	physicalDevice = input.physicalDevice;
+	allocator = input.allocator;
+	vkUtil::UploadBatch& uploads = *input.uploads;
+	// Written straight into the buffers rather than through the staging ring
+	// when device memory is host-visible. Only ranges the GPU is not using are
+	// ever written, so no frame waits for the upload.
+	if (vkUtil::supportsDirectUpload(physicalDevice)) {
+		memoryProperties = vk::MemoryPropertyFlagBits::eDeviceLocal | vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent;
+	}
 
-	vkUtil::BufferInput inputChunk;
-	inputChunk.device = input.device;
-	inputChunk.physicalDevice = input.physicalDevice;
-	inputChunk.size = sizeof(float) * vertexLump.size();
-	inputChunk.usage = vk::BufferUsageFlagBits::eTransferSrc;
-	inputChunk.memoryProperties = vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent;
-	vkUtil::Buffer stagingBuffer = vkUtil::createBuffer(inputChunk);
+	// room for everything queued in one step, exactly so on the first call
+	std::array<vk::DeviceSize, GEOMETRY_KIND_COUNT> needed{};
+	for (const auto& mesh : pendingMeshes) {
+		for (size_t kind = 0; kind < GEOMETRY_KIND_COUNT; ++kind) needed[kind] += mesh.counts[kind];
+	}
+	for (size_t kind = 0; kind < GEOMETRY_KIND_COUNT; ++kind) {
+		const vkUtil::TlsfHeap& heap = buffers[kind].heap;
+		if (needed[kind] > heap.capacity() - heap.used_bytes()) {
+			grow(static_cast<GeometryKind>(kind), heap.used_bytes() + needed[kind], uploads);
+		}
+	}
 
-	auto memoryLocation = input.device.mapMemory(stagingBuffer.bufferMemory, 0, inputChunk.size);
-	memcpy(memoryLocation, vertexLump.data(), inputChunk.size);
-	input.device.unmapMemory(stagingBuffer.bufferMemory);
+	for (auto& mesh : pendingMeshes) place(mesh, uploads);
+	pendingMeshes.clear();
+}
 
-	inputChunk.usage = vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eVertexBuffer;
-	inputChunk.memoryProperties = vk::MemoryPropertyFlagBits::eDeviceLocal;
-	vertexBuffer = vkUtil::createBuffer(inputChunk);
 
-	vkUtil::copyBuffer(stagingBuffer, vertexBuffer, inputChunk.size, input.queue, input.commandBuffer);
+void VertexManagerie::remove(MeshHandle mesh)
+{
+	if (mesh.index >= slots.size() || !slots[mesh.index].live || slots[mesh.index].generation != mesh.generation) return;
+	Slot& slot = slots[mesh.index];
 
+	if (slot.placed) {
+		for (size_t kind = 0; kind < GEOMETRY_KIND_COUNT; ++kind) {
+			if (slot.regions[kind] == noRegion) continue;
+			retiredRegions.push_back({ retire_frame(), static_cast<GeometryKind>(kind), buffers[kind].epoch, slot.regions[kind] });
+		}
+	}
+	else {
+		std::erase_if(pendingMeshes, [&](const PendingMesh& pending) { return pending.slot == mesh.index; });
+	}
 
-	device.destroyBuffer(stagingBuffer.buffer);
-	device.freeMemory(stagingBuffer.bufferMemory);
+	release_slot(mesh.index);
+}
 
-	inputChunk.size = sizeof(uint32_t) * indexLump.size();
-	inputChunk.usage = vk::BufferUsageFlagBits::eTransferSrc;
-	inputChunk.memoryProperties = vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent;
-	stagingBuffer = vkUtil::createBuffer(inputChunk);
 
-	memoryLocation = input.device.mapMemory(stagingBuffer.bufferMemory, 0, inputChunk.size);
-	memcpy(memoryLocation, indexLump.data(), inputChunk.size);
-	input.device.unmapMemory(stagingBuffer.bufferMemory);
+void VertexManagerie::release_slot(uint32_t index)
+{
+	Slot& slot = slots[index];
+	slot.live = false;
+	slot.placed = false;
+	slot.record = {};
+	++slot.generation;
+	freeSlots.push_back(index);
+	std::erase_if(handles, [&](const auto& named) { return named.second.index == index; });
+}
+
+
+vk::DeviceSize VertexManagerie::compact()
+{
+	vk::DeviceSize moved = 0;
+	for (GeometryKind kind : { VERTICES, INDICES16, INDICES32 }) {
+		GeometryBuffer& geometry = buffers[kind];
+		if (!geometry.buffer.buffer) continue;
+
+		// in address order, so meshes keep their relative placement
+		std::vector<uint32_t> users;
+		vk::DeviceSize live = 0;
+		for (uint32_t index = 0; index < slots.size(); ++index) {
+			if (!slots[index].placed || slots[index].regions[kind] == noRegion) continue;
+			users.push_back(index);
+			live += geometry.heap.size(slots[index].regions[kind]);
+		}
+		std::sort(users.begin(), users.end(), [&](uint32_t a, uint32_t b) {
+			return geometry.heap.offset(slots[a].regions[kind]) < geometry.heap.offset(slots[b].regions[kind]);
+		});
+
+		// nothing retired and all free space in one piece: already packed
+		vk::DeviceSize capacity = geometry.heap.capacity();
+		if (geometry.heap.used_bytes() == live && geometry.heap.largest_free_range() == capacity - live) continue;
+
+		// a quarter of slack so the next few meshes do not grow it straight away
+		capacity = std::max<vk::DeviceSize>(1, live + live / 4);
+		vkUtil::TlsfHeap heap(capacity);
+		vkUtil::Buffer packed = create_device_buffer(capacity * geometry.stride, geometry.usage);
+
+		Relocation relocation{ geometry.buffer.buffer, packed.buffer, {} };
+		for (uint32_t index : users) {
+			uint32_t& region = slots[index].regions[kind];
+			vk::DeviceSize size = geometry.heap.size(region);
+			uint32_t packedRegion = heap.allocate(size, 1);
+			relocation.regions.push_back({ geometry.heap.offset(region) * geometry.stride, heap.offset(packedRegion) * geometry.stride, size * geometry.stride });
+			moved += size * geometry.stride;
+			region = packedRegion;
+		}
+		if (!relocation.regions.empty()) relocations.push_back(std::move(relocation));
+
+		retire(geometry.buffer);
+		geometry.buffer = packed;
+		geometry.heap = std::move(heap);
+		++geometry.epoch;
+	}
+
+	for (auto& slot : slots) {
+		if (slot.placed) update_record(slot);
+	}
+	relocatedBytes += moved;
+	return moved;
+}
 
-	inputChunk.usage = vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eIndexBuffer;
-	inputChunk.memoryProperties = vk::MemoryPropertyFlagBits::eDeviceLocal;
-	indexBuffer = vkUtil::createBuffer(inputChunk);
 
-	vkUtil::copyBuffer(stagingBuffer, indexBuffer, inputChunk.size, input.queue, input.commandBuffer);
+void VertexManagerie::record_relocations(vk::CommandBuffer commandBuffer, uint64_t frame)
+{
+	lastRecordedFrame = frame;
+	if (relocations.empty()) return;
+
+	// a compaction may read what a growth before it wrote
+	vk::MemoryBarrier chain;
+	chain.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+	chain.dstAccessMask = vk::AccessFlagBits::eTransferRead | vk::AccessFlagBits::eTransferWrite;
+	for (size_t i = 0; i < relocations.size(); ++i) {
+		if (i) {
+			commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eTransfer,
+				vk::DependencyFlags(), chain, nullptr, nullptr);
+		}
+		commandBuffer.copyBuffer(relocations[i].srcBuffer, relocations[i].dstBuffer, relocations[i].regions);
+	}
+
+	vk::MemoryBarrier barrier;
+	barrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+	barrier.dstAccessMask = vk::AccessFlagBits::eVertexAttributeRead | vk::AccessFlagBits::eIndexRead | vk::AccessFlagBits::eShaderRead;
+	commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eVertexInput | vk::PipelineStageFlagBits::eVertexShader,
+		vk::DependencyFlags(), barrier, nullptr, nullptr);
+	relocations.clear();
+}
+
+
+void VertexManagerie::collect(uint64_t completedFrame)
+{
+	std::erase_if(retiredRegions, [&](const RetiredRegion& retired) {
+		if (retired.frame > completedFrame) return false;
+		// ranges of a heap compaction replaced went with it
+		GeometryBuffer& geometry = buffers[retired.kind];
+		if (retired.epoch == geometry.epoch) geometry.heap.free(retired.region);
+		return true;
+	});
+	std::erase_if(retiredBuffers, [&](RetiredBuffer& retired) {
+		if (retired.frame > completedFrame) return false;
+		vkUtil::destroyBuffer(device, retired.buffer);
+		return true;
+	});
+}
+
 
-	device.destroyBuffer(stagingBuffer.buffer);
-	device.freeMemory(stagingBuffer.bufferMemory);
+GeometryStats VertexManagerie::stats() const
+{
+	GeometryStats stats{};
+	auto bytes = [&](GeometryKind kind, vk::DeviceSize elements) { return elements * buffers[kind].stride; };
+	stats.vertexBytes = bytes(VERTICES, buffers[VERTICES].heap.capacity());
+	stats.indexBytes = bytes(INDICES16, buffers[INDICES16].heap.capacity()) + bytes(INDICES32, buffers[INDICES32].heap.capacity());
+	stats.paletteBytes = palette_bytes();
+	stats.usedVertexBytes = bytes(VERTICES, buffers[VERTICES].heap.used_bytes());
+	stats.usedIndexBytes = bytes(INDICES16, buffers[INDICES16].heap.used_bytes()) + bytes(INDICES32, buffers[INDICES32].heap.used_bytes());
+	stats.largestFreeVertexBytes = bytes(VERTICES, buffers[VERTICES].heap.largest_free_range());
+	stats.meshCount = std::count_if(slots.begin(), slots.end(), [](const Slot& slot) { return slot.placed; });
+	stats.relocatedBytes = relocatedBytes;
+	return stats;
+}
 
-	vertexLump.clear();
 
+std::vector<vkMesh::Meshlet> VertexManagerie::all_meshlets() const
+{
+	std::vector<vkMesh::Meshlet> meshlets;
+	for (const auto& slot : slots) {
+		if (slot.placed) meshlets.insert(meshlets.end(), slot.record.meshlets.begin(), slot.record.meshlets.end());
+	}
+	return meshlets;
 }
@@ -1,29 +1,215 @@
 #pragma once
 #include "config.h"
 #include "memory.h"
+#include "upload_batch.h"
+#include "vertex_compression.h"
+#include "meshlet.h"
+#include "obj_mesh.h"
+#include "obj_stream.h"
+#include <array>
+#include <span>
 
 
 struct FinalizationChunk {
 	vk::Device device;
 	vk::PhysicalDevice physicalDevice;
-	vk::Queue queue;
-	vk::CommandBuffer commandBuffer;
+	// copies are added here and run when the batch is submitted
+	vkUtil::UploadBatch* uploads;
+	vkUtil::DeviceAllocator* allocator;
 };
 
+// Names a mesh in a VertexManagerie. Removing the mesh invalidates every copy
+// of the handle, even once its slot is reused.
+struct MeshHandle {
+	uint32_t index = UINT32_MAX;
+	uint32_t generation = 0;
+};
+
+// Where a mesh lives in the geometry buffers. LOD and meshlet index ranges
+// are relative to firstIndex; all of them point into the index buffer of
+// indexType. Offsets change when the buffers grow or are compacted.
+struct MeshRecord {
+	vk::IndexType indexType;
+	// base vertex handed to drawIndexed
+	int vertexOffset;
+	uint32_t firstIndex;
+	std::vector<vkMesh::MeshLod> lods;
+	std::vector<vkMesh::Meshlet> meshlets;
+	// COMPACT only: dequantization push constants
+	vkMesh::MeshBounds bounds;
+	// what instances are culled against, in model space
+	vkMesh::MeshVolume volume;
+};
+
+struct GeometryStats {
+	vk::DeviceSize vertexBytes, indexBytes, paletteBytes;
+	// taken by meshes, including removed ones frames may still be drawing
+	vk::DeviceSize usedVertexBytes, usedIndexBytes;
+	// the largest mesh that fits without growing the vertex buffer
+	vk::DeviceSize largestFreeVertexBytes;
+	size_t meshCount;
+	// moved by growth and compaction so far
+	vk::DeviceSize relocatedBytes;
+};
+
+// Vertex, index and (COMPACT) palette buffers shared by every mesh, each
+// carved into ranges by a vkUtil::TlsfHeap. Meshes can be added and removed
+// at any time:
+//  - consume/stream queue a mesh and finalize places everything queued,
+//    growing a buffer that is out of room by moving it to a bigger one;
+//  - remove frees a mesh's ranges once the frames that may draw it are done
+//    (see collect);
+//  - compact packs the vertex and index buffers again.
+// Moves are GPU copies recorded into the next frame by record_relocations,
+// so rendering carries on meanwhile and old buffers are released after the
+// frame fences, like removed ranges.
 class VertexManagerie {
 public:
-	VertexManagerie();
+	VertexManagerie(VertexFormat format = VertexFormat::FULL);
 	~VertexManagerie();
 
-	void consume(meshTypes type, std::vector<float> vertexData, std::vector<uint32_t> indexData);
+	// Takes FullVertex floats; with VertexFormat::COMPACT they are quantized
+	// when placed. Without lods the whole index range is a single level.
+	// Indices stay relative to the mesh and are stored as 16-bit whenever
+	// they fit. type names the mesh in handles.
+	MeshHandle consume(meshTypes type, std::span<const float> vertexData, std::span<const uint32_t> indexData, std::span<const vkMesh::MeshLod> lodData = {});
+	// For .obj files too big to import whole. The stream's first pass runs
+	// here to size the mesh; finalize then streams it straight into the device
+	// buffers through the upload batch's staging ring. Streamed
+	// meshes are not optimized and get one LOD and no meshlets.
+	MeshHandle stream(meshTypes type, const char* objFilepath, const char* mtlFilepath, glm::mat4 preTransform, const vkMesh::StreamingOptions& options);
+	// Places every mesh queued since the last call and queues its upload on
+	// the batch; the data is there once the batch has been submitted. The
+	// first call sizes the buffers to fit exactly.
 	void finalize(FinalizationChunk finalizationChunk);
-	vkUtil::Buffer vertexBuffer, indexBuffer;
 
-	std::unordered_map<meshTypes, int> firstIndices;
-	std::unordered_map<meshTypes, int> indexCounts;
+	// The mesh's ranges are reused once the frame after the last recorded
+	// one has completed.
+	void remove(MeshHandle mesh);
+	// Moves every mesh to the front of new vertex and index buffers. Batches
+	// writing to the current ones must have been submitted. Returns the
+	// bytes that will be copied. The palette is never moved, vertices point
+	// into it.
+	vk::DeviceSize compact();
+
+	// Records the copies growth and compaction left for the graphics queue,
+	// outside of a render pass and after TransferQueue::acquire. frame is
+	// the serial of the frame being recorded.
+	void record_relocations(vk::CommandBuffer commandBuffer, uint64_t frame);
+	// Frees ranges and buffers no frame up to completedFrame can still read.
+	void collect(uint64_t completedFrame);
+
+	// nullptr once the mesh has been removed
+	const MeshRecord* find(MeshHandle mesh) const;
+	const MeshRecord* find(meshTypes type) const;
+
+	const vkUtil::Buffer& vertex_buffer() const { return buffers[VERTICES].buffer; }
+	// Either may be empty (null handle) when no mesh uses that width.
+	const vkUtil::Buffer& index_buffer(vk::IndexType type) const;
+	// COMPACT only: one vec4 color per palette entry, read by the vertex shader
+	const vkUtil::Buffer& palette_buffer() const { return buffers[PALETTE].buffer; }
+	vk::DeviceSize palette_bytes() const;
+
+	GeometryStats stats() const;
+	// Clusters of every live mesh, index ranges relative to their mesh.
+	std::vector<vkMesh::Meshlet> all_meshlets() const;
+
+	VertexFormat format;
+	// streamed meshes are given room for one vertex per index; this is what
+	// deduplication left unused
+	size_t unusedVertexBytes;
+
+	// the engine's named meshes
+	std::unordered_map<meshTypes, MeshHandle> handles;
+
 private:
-	int indexOffset;
+	enum GeometryKind {
+		VERTICES,
+		INDICES16,
+		INDICES32,
+		PALETTE,
+		GEOMETRY_KIND_COUNT
+	};
+
+	// One device-local buffer and the heap handing out its ranges, in
+	// elements of stride bytes.
+	struct GeometryBuffer {
+		vkUtil::Buffer buffer;
+		vkUtil::TlsfHeap heap{ 0 };
+		vk::DeviceSize stride;
+		vk::BufferUsageFlags usage;
+		// bumped when compaction replaces heap, so ranges retired from the
+		// old one are not freed into the new one
+		uint32_t epoch = 0;
+	};
+
+	struct Slot {
+		MeshRecord record;
+		uint32_t generation = 0;
+		bool live = false;
+		bool placed = false;
+		std::array<uint32_t, GEOMETRY_KIND_COUNT> regions;
+	};
+
+	// Input of a mesh that has not been placed yet: FullVertex floats or,
+	// with COMPACT, quantized vertices and their palette; or a stream.
+	struct PendingMesh {
+		uint32_t slot;
+		std::vector<float> vertices;
+		std::vector<vkMesh::CompactVertex> compactVertices;
+		std::vector<glm::vec4> palette;
+		std::vector<uint32_t> indices;
+		std::unique_ptr<vkMesh::ObjStream> source;
+		// elements it takes in each buffer
+		std::array<vk::DeviceSize, GEOMETRY_KIND_COUNT> counts{};
+	};
+
+	struct Relocation {
+		vk::Buffer srcBuffer, dstBuffer;
+		std::vector<vk::BufferCopy> regions;
+	};
+
+	struct RetiredRegion {
+		uint64_t frame;
+		GeometryKind kind;
+		uint32_t epoch, region;
+	};
+	struct RetiredBuffer {
+		uint64_t frame;
+		vkUtil::Buffer buffer;
+	};
+
 	vk::Device device;
-	std::vector<float> vertexLump;
-	std::vector<uint32_t> indexLump;
-};
\ No newline at end of file
+	vk::PhysicalDevice physicalDevice;
+	vkUtil::DeviceAllocator* allocator = nullptr;
+	// adds host visibility when the device can take geometry written in place
+	vk::MemoryPropertyFlags memoryProperties = vk::MemoryPropertyFlagBits::eDeviceLocal;
+
+	std::array<GeometryBuffer, GEOMETRY_KIND_COUNT> buffers;
+	std::vector<Slot> slots;
+	std::vector<uint32_t> freeSlots;
+	std::vector<PendingMesh> pendingMeshes;
+
+	std::vector<Relocation> relocations;
+	std::vector<RetiredRegion> retiredRegions;
+	std::vector<RetiredBuffer> retiredBuffers;
+	// serial of the latest frame record_relocations saw
+	uint64_t lastRecordedFrame = 0;
+	vk::DeviceSize relocatedBytes = 0;
+
+	MeshHandle new_slot(meshTypes type, vk::IndexType indexType);
+	vkUtil::Buffer create_device_buffer(vk::DeviceSize size, vk::BufferUsageFlags usage);
+	// count elements of kind for a mesh, growing the buffer if they do not fit
+	uint32_t allocate(GeometryKind kind, vk::DeviceSize count, vkUtil::UploadBatch& uploads);
+	void grow(GeometryKind kind, vk::DeviceSize capacity, vkUtil::UploadBatch& uploads);
+	// the frame that will run relocations recorded from now on
+	uint64_t retire_frame() const { return lastRecordedFrame + 1; }
+	void retire(vkUtil::Buffer buffer);
+	void update_record(Slot& slot);
+	// Frees the slot and forgets its handles; its regions are the caller's.
+	void release_slot(uint32_t index);
+	// Drops the mesh instead when its palette range is past what 16-bit
+	// palette indices reach.
+	void place(PendingMesh& mesh, vkUtil::UploadBatch& uploads);
+	void stream_mesh(Slot& slot, vkMesh::ObjStream& source, vkUtil::UploadBatch& uploads);
+};
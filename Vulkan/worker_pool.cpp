@@ -0,0 +1,62 @@
+#include "worker_pool.h"
+
+vkUtil::WorkerPool::WorkerPool(unsigned int threadCount)
+{
+	for (unsigned int i = 1; i < threadCount; ++i) {
+		threads.emplace_back([this] { work(); });
+	}
+}
+
+vkUtil::WorkerPool::~WorkerPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	wake.notify_all();
+	for (auto& thread : threads) thread.join();
+}
+
+void vkUtil::WorkerPool::parallel_for(size_t count, const std::function<void(size_t)>& job)
+{
+	if (count == 0) return;
+	if (threads.empty() || count == 1) {
+		for (size_t i = 0; i < count; ++i) job(i);
+		return;
+	}
+
+	std::unique_lock<std::mutex> lock(mutex);
+	currentJob = &job;
+	jobCount = count;
+	nextJob = 0;
+	finishedJobs = 0;
+	wake.notify_all();
+
+	run_jobs(lock);
+	done.wait(lock, [this] { return finishedJobs == jobCount; });
+	currentJob = nullptr;
+}
+
+void vkUtil::WorkerPool::work()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	while (true) {
+		wake.wait(lock, [this] { return stopping || (currentJob && nextJob < jobCount); });
+		if (stopping) return;
+		run_jobs(lock);
+	}
+}
+
+void vkUtil::WorkerPool::run_jobs(std::unique_lock<std::mutex>& lock)
+{
+	while (currentJob && nextJob < jobCount) {
+		size_t index = nextJob++;
+		auto job = currentJob;
+
+		lock.unlock();
+		(*job)(index);
+		lock.lock();
+
+		if (++finishedJobs == jobCount) done.notify_all();
+	}
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include "config.h"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+namespace vkUtil {
+	// Fixed set of threads that run indexed jobs. The calling thread joins
+	// in, so a pool of size() == 1 runs everything inline.
+	class WorkerPool {
+	public:
+		WorkerPool(unsigned int threadCount = std::thread::hardware_concurrency());
+		~WorkerPool();
+
+		WorkerPool(const WorkerPool&) = delete;
+		WorkerPool& operator=(const WorkerPool&) = delete;
+
+		size_t size() const { return threads.size() + 1; }
+
+		// Calls job(i) for every i in [0, count) and returns once all of them finished.
+		// Not reentrant: only one thread may submit work at a time.
+		void parallel_for(size_t count, const std::function<void(size_t)>& job);
+
+	private:
+		std::vector<std::thread> threads;
+		std::mutex mutex;
+		std::condition_variable wake, done;
+
+		const std::function<void(size_t)>* currentJob = nullptr;
+		size_t jobCount = 0, nextJob = 0, finishedJobs = 0;
+		bool stopping = false;
+
+		void work();
+		void run_jobs(std::unique_lock<std::mutex>& lock);
+	};
+}